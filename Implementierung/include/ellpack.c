@@ -1,23 +1,17 @@
+#define _DEFAULT_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <immintrin.h>
 #include "ellpack.h"
 #include "../src/matrix_utils.h"
+#include "../src/huge_pages.h"
 
 /** Helper that frees memory from an ellpackmatrix */
 
-void clean_file_data(uint8_t *initial_star_index /* , alloc_data *data */, FILE *aptr)
-{
-    if (aptr)
-    {
-        fclose(aptr);
-    }
-    if (initial_star_index)
-    {
-        free(initial_star_index);
-    }
-}
-
 ELLPACKMatrix get_empty_ellpackmatrix() {
     ELLPACKMatrix matrix = {
         .nr_rows = 0,
@@ -27,20 +21,209 @@ ELLPACKMatrix get_empty_ellpackmatrix() {
         .sorted = false,
         .indices = NULL,
         .nr_of_non_zeros_per_col = NULL,
-        .total_non_zero_nr = 0
+        .total_non_zero_nr = 0,
+        .indices32 = NULL,
+        .entries = NULL,
+        .values16 = NULL,
+        .value_format = VALUES_FP32,
+        .mapping = NULL,
+        .mapping_size = 0,
+        .owns_arrays = true
     };
     return matrix;
 }
 
+/** Frees an array of the matrix, unless it belongs to the mapped binary file (released with the mapping) */
+static void free_matrix_array(const ELLPACKMatrix *a, void *array)
+{
+    if (a->owns_arrays)
+        free(array);
+}
+
 // cleans the allocated space of the Ellpack matrix, if it was allocated
 void clean_matrix_data(ELLPACKMatrix *a)
 {
-    free(a->values);
+    free_matrix_array(a, a->values);
     a->values = NULL;
-    free(a->indices);
+    free_matrix_array(a, a->indices);
     a->indices = NULL;
-    free(a->nr_of_non_zeros_per_col);
+    free_matrix_array(a, a->indices32);
+    a->indices32 = NULL;
+    free(a->entries);
+    a->entries = NULL;
+    free(a->values16);
+    a->values16 = NULL;
+    free_matrix_array(a, a->nr_of_non_zeros_per_col);
     a->nr_of_non_zeros_per_col = NULL;
+    if (a->mapping != NULL)
+        munmap(a->mapping, a->mapping_size);
+    a->mapping = NULL;
+    a->mapping_size = 0;
+    a->owns_arrays = true;
+}
+
+#define SMALL_SORT_LIMIT 16  // columns up to this length are sorted with a sorting network (or insertion sort)
+#define SMALL_SORT_NETWORK_MIN 5 // shorter columns are faster with insertion sort than with the whole network
+
+/** Sorts packed (index << 32 | value bits) keys with a plain insertion sort, fallback of the sorting network */
+static void small_sort_packed(uint64_t *keys, uint64_t n)
+{
+    for (uint64_t i = 1; i < n; i++)
+    {
+        uint64_t key = keys[i];
+        uint64_t j = i;
+        for (; j > 0 && keys[j - 1] > key; j--)
+        {
+            keys[j] = keys[j - 1];
+        }
+        keys[j] = key;
+    }
+}
+
+/** One compare-exchange step of the bitonic network inside a register: lane i with lane i ^ distance */
+__attribute__((target("avx512f")))
+static inline __m512i bitonic_step(__m512i keys, __m512i partners, __mmask8 take_max)
+{
+    __m512i other = _mm512_permutexvar_epi64(partners, keys);
+    return _mm512_mask_blend_epi64(take_max, _mm512_min_epu64(keys, other), _mm512_max_epu64(keys, other));
+}
+
+/**
+ * Sorts up to SMALL_SORT_LIMIT packed keys with a bitonic sorting network in two AVX-512 registers (lanes 0..7 and 8..15).
+ * Missing keys are padded with UINT64_MAX, which ends up behind the real ones.
+ */
+__attribute__((target("avx512f")))
+static void small_sort_packed_avx512(uint64_t *keys, uint64_t n)
+{
+    const __m512i distance1 = _mm512_set_epi64(6, 7, 4, 5, 2, 3, 0, 1);
+    const __m512i distance2 = _mm512_set_epi64(5, 4, 7, 6, 1, 0, 3, 2);
+    const __m512i distance4 = _mm512_set_epi64(3, 2, 1, 0, 7, 6, 5, 4);
+    const __m512i padding = _mm512_set1_epi64((long long)UINT64_MAX);
+    __mmask8 lo_mask = (__mmask8)(n >= 8 ? 0xff : (1u << n) - 1);
+    __mmask8 hi_mask = (__mmask8)(n >= 16 ? 0xff : n > 8 ? (1u << (n - 8)) - 1 : 0);
+    __m512i lo = _mm512_mask_loadu_epi64(padding, lo_mask, keys);
+    __m512i hi = _mm512_mask_loadu_epi64(padding, hi_mask, keys + 8);
+
+    // the masks mark the lanes that keep the larger key: ascending runs of 2, 4, 8 alternate with descending ones
+    lo = bitonic_step(lo, distance1, 0x66);
+    hi = bitonic_step(hi, distance1, 0x66);
+    lo = bitonic_step(lo, distance2, 0x3c);
+    hi = bitonic_step(hi, distance2, 0x3c);
+    lo = bitonic_step(lo, distance1, 0x5a);
+    hi = bitonic_step(hi, distance1, 0x5a);
+    lo = bitonic_step(lo, distance4, 0xf0);
+    hi = bitonic_step(hi, distance4, 0x0f);
+    lo = bitonic_step(lo, distance2, 0xcc);
+    hi = bitonic_step(hi, distance2, 0x33);
+    lo = bitonic_step(lo, distance1, 0xaa);
+    hi = bitonic_step(hi, distance1, 0x55);
+    // lo is sorted ascending and hi descending: merge them into one ascending run of 16
+    __m512i min = _mm512_min_epu64(lo, hi);
+    hi = _mm512_max_epu64(lo, hi);
+    lo = min;
+    lo = bitonic_step(lo, distance4, 0xf0);
+    hi = bitonic_step(hi, distance4, 0xf0);
+    lo = bitonic_step(lo, distance2, 0xcc);
+    hi = bitonic_step(hi, distance2, 0xcc);
+    lo = bitonic_step(lo, distance1, 0xaa);
+    hi = bitonic_step(hi, distance1, 0xaa);
+
+    _mm512_mask_storeu_epi64(keys, lo_mask, lo);
+    _mm512_mask_storeu_epi64(keys + 8, hi_mask, hi);
+}
+
+static int compare_packed(const void *lhs, const void *rhs)
+{
+    uint64_t a = *(const uint64_t *)lhs;
+    uint64_t b = *(const uint64_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+/** (index, value) pair for matrices with 64-bit indices, which cannot be packed into one key */
+typedef struct
+{
+    uint64_t index;
+    float value;
+} index_value_pair;
+
+static int compare_pairs(const void *lhs, const void *rhs)
+{
+    uint64_t a = ((const index_value_pair *)lhs)->index;
+    uint64_t b = ((const index_value_pair *)rhs)->index;
+    return (a > b) - (a < b);
+}
+
+int sort_ellpack_columns(ELLPACKMatrix *a)
+{
+    uint64_t longest_col = 0;
+    for (uint64_t col = 0; col < a->nr_cols; col++)
+    {
+        if (a->nr_of_non_zeros_per_col[col] > longest_col)
+            longest_col = a->nr_of_non_zeros_per_col[col];
+    }
+    // scratch space for one column (packed keys or pairs)
+    void *scratch = malloc((longest_col > 0 ? longest_col : 1) * sizeof(index_value_pair));
+    if (scratch == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory to sort the columns\n");
+        return 1;
+    }
+
+    __builtin_cpu_init();
+    bool sort_network = __builtin_cpu_supports("avx512f");
+
+    int duplicate_found = 0;
+    for (uint64_t col = 0, start = 0; col < a->nr_cols; start += a->nr_of_non_zeros_per_col[col], col++)
+    {
+        uint64_t n = a->nr_of_non_zeros_per_col[col];
+        if (a->indices32 != NULL)
+        {
+            // the index is the upper half, so sorting the keys sorts by index and keeps the value with it
+            uint64_t *keys = scratch;
+            bool already_sorted = true;
+            for (uint64_t k = 0; k < n; k++)
+            {
+                uint32_t value_bits;
+                memcpy(&value_bits, &a->values[start + k], sizeof(float));
+                keys[k] = ((uint64_t)a->indices32[start + k] << 32) | value_bits;
+                already_sorted &= k == 0 || a->indices32[start + k - 1] < a->indices32[start + k];
+            }
+            if (already_sorted)
+                continue;
+            if (sort_network && n >= SMALL_SORT_NETWORK_MIN && n <= SMALL_SORT_LIMIT)
+                small_sort_packed_avx512(keys, n);
+            else if (n <= SMALL_SORT_LIMIT)
+                small_sort_packed(keys, n);
+            else
+                qsort(keys, n, sizeof(uint64_t), compare_packed);
+            for (uint64_t k = 0; k < n; k++)
+            {
+                uint32_t value_bits = (uint32_t)keys[k];
+                a->indices32[start + k] = (uint32_t)(keys[k] >> 32);
+                memcpy(&a->values[start + k], &value_bits, sizeof(float));
+                duplicate_found |= k > 0 && a->indices32[start + k - 1] == a->indices32[start + k];
+            }
+        }
+        else
+        {
+            index_value_pair *pairs = scratch;
+            for (uint64_t k = 0; k < n; k++)
+            {
+                pairs[k].index = a->indices[start + k];
+                pairs[k].value = a->values[start + k];
+            }
+            qsort(pairs, n, sizeof(index_value_pair), compare_pairs);
+            for (uint64_t k = 0; k < n; k++)
+            {
+                a->indices[start + k] = pairs[k].index;
+                a->values[start + k] = pairs[k].value;
+                duplicate_found |= k > 0 && pairs[k - 1].index == pairs[k].index;
+            }
+        }
+    }
+    free(scratch);
+    a->sorted = true;
+    return duplicate_found;
 }
 
 int check_ellpack_multiplication(const const_ELLPACKMatrix *a, const const_ELLPACKMatrix *b, bool should_be_sorted) {
@@ -88,9 +271,109 @@ void print_ellpack_matrix_2(ELLPACKMatrix *a) {
     for (uint64_t i = 0; i < a->nr_cols; i++) {
         printf("Column %" PRIu64 " has %" PRIu64 " non-zero elements\n", i, a->nr_of_non_zeros_per_col[i]);
         for (uint64_t j = 0; j < a->nr_of_non_zeros_per_col[i]; j++) {
-            printf("(%f, %" PRIu64 ")", a->values[idx + j], a->indices[idx + j]);
+            printf("(%f, %" PRIu64 ")", ellpack_value((const const_ELLPACKMatrix *) a, idx + j), ellpack_index((const const_ELLPACKMatrix *) a, idx + j));
         }
         idx += a->nr_of_non_zeros_per_col[i];
         printf("\n");
     }
-}
\ No newline at end of file
+}
+int pack_ellpack_entries(ELLPACKMatrix *a)
+{
+    if (a->indices32 == NULL)
+    {
+        fprintf(stderr, "The packed layout needs 32-bit indices (at most UINT32_MAX rows)\n");
+        return 1;
+    }
+    free(a->entries);
+    // allocate at least one element, so that NULL always means "not packed"
+    a->entries = huge_page_alloc((a->total_non_zero_nr > 0 ? a->total_non_zero_nr : 1) * sizeof(ellpack_entry));
+    if (a->entries == NULL)
+    {
+        fprintf(stderr, "Could not allocate the packed entries\n");
+        return 1;
+    }
+    for (uint64_t k = 0; k < a->total_non_zero_nr; k++)
+    {
+        a->entries[k].index = a->indices32[k];
+        a->entries[k].value = ellpack_value((const const_ELLPACKMatrix *) a, k);
+    }
+    return 0;
+}
+
+/** Rounds to the nearest bfloat16 (ties to even), NaN stays NaN */
+static uint16_t float_to_bf16(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7FFFFFFF) > 0x7F800000)
+        return (bits >> 16) | 0x40; // quiet NaN, the payload may only be in the lower bits
+    bits += 0x7FFF + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+/** Rounds to the nearest IEEE half (ties to even); too big values become infinity */
+static uint16_t float_to_fp16(float f)
+{
+    const uint32_t f32_infinity = 255u << 23;
+    const uint32_t f16_overflow = (127u + 16) << 23; // 2^16, everything above rounds to infinity
+    const uint32_t denormal_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+    uint16_t half;
+    if (bits >= f16_overflow)
+    {
+        half = bits > f32_infinity ? 0x7E00 : 0x7C00;
+    }
+    else if (bits < (113u << 23))
+    { // result is subnormal: let the fp32 addition do the rounding
+        float value, magic;
+        memcpy(&value, &bits, sizeof(value));
+        memcpy(&magic, &denormal_magic, sizeof(magic));
+        value += magic;
+        memcpy(&bits, &value, sizeof(bits));
+        half = bits - denormal_magic;
+    }
+    else
+    {
+        uint32_t mantissa_odd = (bits >> 13) & 1;
+        bits += ((uint32_t) (15 - 127) << 23) + 0xFFF; // rebias the exponent and round
+        bits += mantissa_odd;
+        half = bits >> 13;
+    }
+    return half | (sign >> 16);
+}
+
+int convert_ellpack_values(ELLPACKMatrix *a, ellpack_value_format format)
+{
+    if (format == VALUES_FP32 || a->values16 != NULL)
+        return 0;
+    a->values16 = huge_page_alloc((a->total_non_zero_nr > 0 ? a->total_non_zero_nr : 1) * sizeof(uint16_t));
+    if (a->values16 == NULL)
+    {
+        fprintf(stderr, "Could not allocate the half-width values\n");
+        return 1;
+    }
+    uint64_t overflows = 0;
+    for (uint64_t k = 0; k < a->total_non_zero_nr; k++)
+    {
+        if (format == VALUES_BF16)
+        {
+            a->values16[k] = float_to_bf16(a->values[k]);
+        }
+        else
+        {
+            a->values16[k] = float_to_fp16(a->values[k]);
+            overflows += (a->values16[k] & 0x7FFF) == 0x7C00 && !isinf(a->values[k]);
+        }
+    }
+    if (overflows > 0)
+    {
+        fprintf(stderr, "Warning: %" PRIu64 " values are outside of the fp16 range and were stored as infinity\n", overflows);
+    }
+    a->value_format = format;
+    free_matrix_array(a, a->values);
+    a->values = NULL;
+    return 0;
+}
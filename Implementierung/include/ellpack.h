@@ -11,6 +11,28 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+
+/**
+ * @struct ellpack_entry
+ * @brief One stored element of a column in the packed layout (index and value next to each other).
+ */
+typedef struct
+{
+    uint32_t index;
+    float value;
+} ellpack_entry;
+
+/**
+ * @enum ellpack_value_format
+ * @brief Storage format of the values of a matrix. Computation always happens in fp32.
+ */
+typedef enum
+{
+    VALUES_FP32 = 0, ///< `values` is used
+    VALUES_BF16,     ///< `values16` holds the upper 16 bits of each float
+    VALUES_FP16      ///< `values16` holds IEEE half precision values
+} ellpack_value_format;
 
 /**
  * @struct ELLPACKMatrix
@@ -19,6 +41,14 @@
  * - `values` and `indices` store up to `nr_ellpack_elts` entries per column.
  * - `nr_of_non_zeros_per_col` holds the actual count for each column.
  * - When `sorted` is true, indices within columns are in ascending order.
+ * - Exactly one of `indices`/`indices32` is used: the reader stores compact 32-bit
+ *   row indices whenever `nr_rows` fits in 32 bits (see `ellpack_index`).
+ * - `entries` optionally holds a copy of `indices32`/`values` as (index, value) records
+ *   (see `pack_ellpack_entries`); the dot product kernels prefer it if it is set.
+ * - Exactly one of `values`/`values16` is used, depending on `value_format` (see `ellpack_value`).
+ * - `owns_arrays` is false if `values`, `indices`/`indices32` and `nr_of_non_zeros_per_col` point into
+ *   `mapping`, a mapped binary file (see `ellpack_binary_header`); `clean_matrix_data` then unmaps the file
+ *   instead of freeing these arrays. `entries` and `values16` are always allocated.
  */
 typedef struct
 {
@@ -30,6 +60,13 @@ typedef struct
     uint64_t *indices;
     uint64_t *nr_of_non_zeros_per_col; ///< Non-zero count per column
     uint64_t total_non_zero_nr;        ///< Total non-zeros in matrix
+    uint32_t *indices32;               ///< Compact row indices (NULL if `indices` is used)
+    ellpack_entry *entries;            ///< Packed copy of `indices32`/`values` (NULL if not built)
+    uint16_t *values16;                ///< Half-width values (NULL if `values` is used)
+    ellpack_value_format value_format;
+    void *mapping;                     ///< Mapped binary file that holds the arrays (NULL if they are allocated)
+    size_t mapping_size;               ///< Size of `mapping` in bytes
+    bool owns_arrays;                  ///< The main arrays are allocated and freed by `clean_matrix_data`
 } ELLPACKMatrix;
 
 /**
@@ -45,8 +82,67 @@ typedef struct {
     const uint64_t *indices;
     const uint64_t *nr_of_non_zeros_per_col; ///< Non-zero count per column
     uint64_t total_non_zero_nr;        ///< Total non-zeros in matrix
+    const uint32_t *indices32;         ///< Compact row indices (NULL if `indices` is used)
+    const ellpack_entry *entries;      ///< Packed copy of `indices32`/`values` (NULL if not built)
+    const uint16_t *values16;          ///< Half-width values (NULL if `values` is used)
+    ellpack_value_format value_format;
+    const void *mapping;               ///< Mapped binary file that holds the arrays (NULL if they are allocated)
+    size_t mapping_size;               ///< Size of `mapping` in bytes
+    bool owns_arrays;                  ///< The main arrays are allocated and freed by `clean_matrix_data`
 } const_ELLPACKMatrix;
 
+/**
+ * @brief Row index of the k-th stored element, independent of the index width.
+ */
+static inline uint64_t ellpack_index(const const_ELLPACKMatrix *mat, uint64_t k)
+{
+    return mat->indices32 != NULL ? mat->indices32[k] : mat->indices[k];
+}
+
+/**
+ * @brief Widen a bfloat16 value to fp32 (the lower 16 bits of the mantissa are zero).
+ */
+static inline float bf16_to_float(uint16_t h)
+{
+    uint32_t bits = (uint32_t) h << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief Widen an IEEE half precision value to fp32 (exact, including subnormals, inf and NaN).
+ */
+static inline float fp16_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F)
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    else if (exponent != 0)
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else
+    { // zero or subnormal: mantissa * 2^-24
+        float f = (float) mantissa * (1.0f / 16777216.0f);
+        memcpy(&bits, &f, sizeof(bits));
+        bits |= sign;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief Value of the k-th stored element as fp32, independent of the storage format.
+ */
+static inline float ellpack_value(const const_ELLPACKMatrix *mat, uint64_t k)
+{
+    if (mat->values16 == NULL) return mat->values[k];
+    return mat->value_format == VALUES_BF16 ? bf16_to_float(mat->values16[k]) : fp16_to_float(mat->values16[k]);
+}
+
 
 /**
  * @struct result_file
@@ -59,24 +155,41 @@ typedef struct
 } result_file;
 
 
-/**
- * @brief Reset parsing state for input files.
- * @param initial_star_index Pointer to the first '*' marker index buffer.
- * @param aptr Open file pointer to clear/rewind as needed.
- */
-void clean_file_data(uint8_t *initial_star_index, FILE *aptr);
-
 /**
  * @brief Create a zero-initialized ELLPACK matrix with no allocated buffers.
  */
 ELLPACKMatrix get_empty_ellpackmatrix();
 
 /**
- * @brief Free all allocated buffers and reset the matrix to empty state.
+ * @brief Free all allocated buffers (or unmap the binary file they point into) and reset the matrix to empty state.
  * @param a Matrix to clean.
  */
 void clean_matrix_data(ELLPACKMatrix *a);
 
+/**
+ * @brief Sort the (index, value) pairs of every column by index, in place, and set `sorted`.
+ * @param a Matrix to normalize.
+ * @return 0 on success, 1 if an index appears twice in a column (matrix is left sorted but invalid).
+ */
+int sort_ellpack_columns(ELLPACKMatrix *a);
+
+/**
+ * @brief Build the packed (index, value) layout `entries` of a matrix with 32-bit indices.
+ *        The separate arrays are kept, since I/O and the row index use them.
+ * @param a Matrix to pack.
+ * @return 0 on success, 1 on allocation failure or if the matrix uses 64-bit indices.
+ */
+int pack_ellpack_entries(ELLPACKMatrix *a);
+
+/**
+ * @brief Convert the values of a matrix to a half-width format (round to nearest even) and free the fp32 values.
+ *        Values outside of the fp16 range become infinity, which is reported once.
+ * @param a Matrix with fp32 values (load time, before any other layout is built).
+ * @param format Target format; VALUES_FP32 leaves the matrix unchanged.
+ * @return 0 on success, 1 on allocation failure.
+ */
+int convert_ellpack_values(ELLPACKMatrix *a, ellpack_value_format format);
+
 /**
  * @brief Check if two matrices can be multiplied in ELLPACK format.
  * @param a Left operand (A) in const ELLPACK view.
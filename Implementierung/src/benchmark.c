@@ -8,20 +8,27 @@
 #include <unistd.h>
 
 //see docs in benchmark.h
-void run_benchmark(int n_times, const ELLPACKMatrix* data_a, const ELLPACKMatrix* data_b, result_mat* result_matrix, matmul_func matmul) {
+void run_benchmark(int n_times, const ELLPACKMatrix* data_a, const ELLPACKMatrix* data_b, result_mat* result_matrix, matmul_func matmul, const matmul_context* context) {
     struct timespec result;
     result.tv_sec = 0;
     result.tv_nsec = 0;
 
-    result_mat tmp;
+    // the iterations after the first one write into tmp, which is allocated once and reset between the iterations,
+    // so allocation and page faults are not measured once it has reached its final size
+    result_mat tmp = { .cols = NULL };
 
     for (int i = 0; i < n_times; i++)
     {
-        tmp = malloc_init_result_mat_from_ellpack(data_a, data_b);
-        if (tmp.cols == NULL) {
-            fprintf(stderr, "Could not allocate memory for temporary result matrix in benchmark\n");
-            free_result_mat(result_matrix); // signal that the matmul was invalid
-            return;
+        if (i > 0 && tmp.cols != NULL) {
+            reset_result_mat(&tmp);
+        }
+        else if (i > 0) { // first use, or the last iteration failed and freed it
+            tmp = malloc_init_result_mat_for(matmul, data_a, data_b, context->left);
+            if (tmp.cols == NULL) {
+                fprintf(stderr, "Could not allocate memory for temporary result matrix in benchmark\n");
+                free_result_mat(result_matrix); // signal that the matmul was invalid
+                return;
+            }
         }
         struct timespec start;
         struct timespec end;
@@ -30,7 +37,7 @@ void run_benchmark(int n_times, const ELLPACKMatrix* data_a, const ELLPACKMatrix
         //start
         clock_gettime(CLOCK_MONOTONIC, &start);
 
-        matmul(data_a, data_b, i == 0 ? result_matrix : &tmp);
+        matmul(data_a, data_b, i == 0 ? result_matrix : &tmp, context);
 
         clock_gettime(CLOCK_MONOTONIC, &end);
         //end
@@ -44,13 +51,13 @@ void run_benchmark(int n_times, const ELLPACKMatrix* data_a, const ELLPACKMatrix
         if(result_matrix->cols == NULL) {
             fprintf(stderr, "Warning: benchmark failed on iteration %d of %d, benchmark results are potentially invalid\n", (i + 1), n_times);
         }
-        free_result_mat(&tmp);
-
         if(i != n_times - 1) {
             sleep(1); // sleep for 1 second to avoid overheating
         }
     }
 
+    free_result_mat(&tmp);
+
     double total_time = result.tv_sec + (result.tv_nsec * 1e-9); 
     double average_time = total_time / n_times;
 
@@ -13,5 +13,6 @@
  * @param data_b Second input matrix.
  * @param result_mat Pre-initialized result matrix accumulator.
  * @param matmul Matmul implementation to benchmark.
+ * @param context Settings passed to every call of `matmul`.
  */
-void run_benchmark(int n_times, ELLPACKMatrix* data_a, ELLPACKMatrix* data_b, result_mat* result_mat, matmul_func matmul);
\ No newline at end of file
+void run_benchmark(int n_times, ELLPACKMatrix* data_a, ELLPACKMatrix* data_b, result_mat* result_mat, matmul_func matmul, const matmul_context* context);
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <inttypes.h>
+#include "chain_planner.h"
+
+/** Number of floats all estimated row and column counts of intermediate products may use together. */
+#define CHAIN_PROFILE_BUDGET (1ULL << 25)
+
+/**
+ * Estimated shape of a (sub-)chain product. If the per-row or per-column counts are NULL,
+ * the non-zeros are assumed to be spread uniformly over the rows / columns.
+ */
+typedef struct {
+    uint64_t nr_rows;
+    uint64_t nr_cols;
+    double nnz;
+    float *row_nnz;
+    float *col_nnz;
+} chain_stats;
+
+static void free_chain_stats(chain_stats *stats)
+{
+    free(stats->row_nnz);
+    free(stats->col_nnz);
+    stats->row_nnz = NULL;
+    stats->col_nnz = NULL;
+}
+
+static double row_count(const chain_stats *stats, uint64_t row)
+{
+    if (stats->row_nnz != NULL) return stats->row_nnz[row];
+    return stats->nr_rows == 0 ? 0 : stats->nnz / (double) stats->nr_rows;
+}
+
+static double col_count(const chain_stats *stats, uint64_t col)
+{
+    if (stats->col_nnz != NULL) return stats->col_nnz[col];
+    return stats->nr_cols == 0 ? 0 : stats->nnz / (double) stats->nr_cols;
+}
+
+static double density(const chain_stats *stats)
+{
+    double size = (double) stats->nr_rows * (double) stats->nr_cols;
+    return size == 0 ? 0 : stats->nnz / size;
+}
+
+/**
+ * Expected number of non-zeros of the union of `picks` random vectors of `length` elements,
+ * whose elements are non-zero with probability `density` each.
+ */
+static double estimated_union(double length, double density, double picks)
+{
+    if (picks <= 0 || density <= 0) return 0;
+    if (density >= 1) return length;
+    return -length * expm1(picks * log1p(-density));
+}
+
+/**
+ * Number of multiply-adds of left * right: every element of column k of left meets every element of row k of right.
+ */
+static double product_flops(const chain_stats *left, const chain_stats *right)
+{
+    double flops = 0;
+    for (uint64_t k = 0; k < left->nr_cols; k++)
+    {
+        flops += col_count(left, k) * row_count(right, k);
+    }
+    return flops;
+}
+
+/**
+ * Column j of left * right is the union of the columns of left that column j of right selects.
+ * A product can not have more non-zeros than multiply-adds.
+ */
+static double product_nnz(const chain_stats *left, const chain_stats *right, double flops)
+{
+    double left_density = density(left);
+    double nnz = 0;
+    for (uint64_t col = 0; col < right->nr_cols; col++)
+    {
+        nnz += estimated_union((double) left->nr_rows, left_density, col_count(right, col));
+    }
+    return nnz < flops ? nnz : flops;
+}
+
+/**
+ * Scales the counts so that they add up to nnz (the row and column estimates are made independently).
+ */
+static void normalize_counts(float *counts, uint64_t len, double nnz)
+{
+    double sum = 0;
+    for (uint64_t i = 0; i < len; i++)
+    {
+        sum += counts[i];
+    }
+    double scale = sum > 0 ? nnz / sum : 0;
+    for (uint64_t i = 0; i < len; i++)
+    {
+        counts[i] = (float) (counts[i] * scale);
+    }
+}
+
+/**
+ * Estimates the row and column counts of left * right. They are only kept while `*budget` allows it,
+ * otherwise the product is treated as uniform.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE (allocation failure)
+ */
+static int product_stats(const chain_stats *left, const chain_stats *right, double nnz, uint64_t *budget, chain_stats *product)
+{
+    *product = (chain_stats) {
+        .nr_rows = left->nr_rows,
+        .nr_cols = right->nr_cols,
+        .nnz = nnz,
+        .row_nnz = NULL,
+        .col_nnz = NULL
+    };
+    uint64_t profile_size = product->nr_rows + product->nr_cols;
+    if (profile_size > *budget) return EXIT_SUCCESS;
+
+    product->row_nnz = malloc((product->nr_rows > 0 ? product->nr_rows : 1) * sizeof(float));
+    product->col_nnz = malloc((product->nr_cols > 0 ? product->nr_cols : 1) * sizeof(float));
+    if (product->row_nnz == NULL || product->col_nnz == NULL)
+    {
+        free_chain_stats(product);
+        return EXIT_FAILURE;
+    }
+    *budget -= profile_size;
+
+    double left_density = density(left);
+    double right_density = density(right);
+    for (uint64_t col = 0; col < product->nr_cols; col++)
+    {
+        product->col_nnz[col] = (float) estimated_union((double) left->nr_rows, left_density, col_count(right, col));
+    }
+    for (uint64_t row = 0; row < product->nr_rows; row++)
+    {
+        product->row_nnz[row] = (float) estimated_union((double) right->nr_cols, right_density, row_count(left, row));
+    }
+    normalize_counts(product->col_nnz, product->nr_cols, nnz);
+    normalize_counts(product->row_nnz, product->nr_rows, nnz);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Exact row and column counts of an operand.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE (allocation failure)
+ */
+static int operand_stats(const const_ELLPACKMatrix *mat, chain_stats *stats)
+{
+    *stats = (chain_stats) {
+        .nr_rows = mat->nr_rows,
+        .nr_cols = mat->nr_cols,
+        .nnz = 0,
+        .row_nnz = calloc(mat->nr_rows > 0 ? mat->nr_rows : 1, sizeof(float)),
+        .col_nnz = malloc((mat->nr_cols > 0 ? mat->nr_cols : 1) * sizeof(float))
+    };
+    if (stats->row_nnz == NULL || stats->col_nnz == NULL)
+    {
+        free_chain_stats(stats);
+        return EXIT_FAILURE;
+    }
+    uint64_t non_zeros = 0;
+    for (uint64_t col = 0; col < mat->nr_cols; col++)
+    {
+        stats->col_nnz[col] = (float) mat->nr_of_non_zeros_per_col[col];
+        non_zeros += mat->nr_of_non_zeros_per_col[col];
+    }
+    for (uint64_t k = 0; k < non_zeros; k++)
+    {
+        stats->row_nnz[ellpack_index(mat, k)] += 1.0f;
+    }
+    stats->nnz = (double) non_zeros;
+    return EXIT_SUCCESS;
+}
+
+int plan_matrix_chain(const const_ELLPACKMatrix *operands, int nr_operands, chain_plan *plan)
+{
+    int n = nr_operands;
+    plan->nr_operands = n;
+    plan->estimated_cost = 0;
+    plan->split = NULL;
+    if (n < 1) return EXIT_FAILURE;
+    for (int op = 0; op + 1 < n; op++)
+    {
+        if (operands[op].nr_cols != operands[op + 1].nr_rows)
+        {
+            fprintf(stderr, "Incompatible matrices provided :( operand %d has %" PRIu64 " columns, operand %d has %" PRIu64 " rows\n",
+                    op + 1, operands[op].nr_cols, op + 2, operands[op + 1].nr_rows);
+            return EXIT_FAILURE;
+        }
+    }
+    plan->split = malloc((size_t) n * n * sizeof(int));
+    if (plan->split != NULL && n <= 2)
+    { // there is only one order, the statistics are not needed
+        for (int op = 0; op < n; op++)
+        {
+            plan->split[op * n + op] = op;
+        }
+        if (n == 2) plan->split[1] = 0;
+        return EXIT_SUCCESS;
+    }
+    // cost and stats of the sub-chain first..last are at [first * n + last]
+    double *cost = malloc((size_t) n * n * sizeof(double));
+    chain_stats *stats = calloc((size_t) n * n, sizeof(chain_stats));
+    uint64_t budget = CHAIN_PROFILE_BUDGET;
+    if (plan->split == NULL || cost == NULL || stats == NULL)
+    {
+        fprintf(stderr, "Could not allocate the chain planner\n");
+        goto cleanup_error;
+    }
+
+    for (int op = 0; op < n; op++)
+    {
+        cost[op * n + op] = 0;
+        plan->split[op * n + op] = op;
+        if (operand_stats(&operands[op], &stats[op * n + op]))
+        {
+            fprintf(stderr, "Could not allocate the statistics of operand %d\n", op + 1);
+            goto cleanup_error;
+        }
+    }
+
+    // classic matrix chain order: all sub-chains of one length are planned before the longer ones
+    for (int len = 2; len <= n; len++)
+    {
+        for (int first = 0; first + len <= n; first++)
+        {
+            int last = first + len - 1;
+            double best_cost = INFINITY;
+            double best_nnz = 0;
+            int best_split = last - 1;
+            // the left-to-right split is tried first, so that it wins ties
+            for (int split = last - 1; split >= first; split--)
+            {
+                const chain_stats *left = &stats[first * n + split];
+                const chain_stats *right = &stats[(split + 1) * n + last];
+                double flops = product_flops(left, right);
+                double nnz = product_nnz(left, right, flops);
+                double split_cost = cost[first * n + split] + cost[(split + 1) * n + last] + flops + nnz;
+                if (split_cost < best_cost)
+                {
+                    best_cost = split_cost;
+                    best_nnz = nnz;
+                    best_split = split;
+                }
+            }
+            cost[first * n + last] = best_cost;
+            plan->split[first * n + last] = best_split;
+            if (product_stats(&stats[first * n + best_split], &stats[(best_split + 1) * n + last], best_nnz, &budget, &stats[first * n + last]))
+            {
+                fprintf(stderr, "Could not allocate the statistics of a sub-chain\n");
+                goto cleanup_error;
+            }
+        }
+    }
+    plan->estimated_cost = cost[n - 1];
+
+    bool error_occured = false;
+    goto cleanup;
+cleanup_error:
+    error_occured = true;
+    free_chain_plan(plan);
+cleanup:
+    if (stats != NULL)
+    {
+        for (int i = 0; i < n * n; i++)
+        {
+            free_chain_stats(&stats[i]);
+        }
+    }
+    free(stats);
+    free(cost);
+    return error_occured ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int chain_split(const chain_plan *plan, int first, int last)
+{
+    return plan->split[first * plan->nr_operands + last];
+}
+
+void print_chain_order(FILE *stream, const chain_plan *plan, int first, int last)
+{
+    if (first == last)
+    {
+        fprintf(stream, "A%d", first + 1);
+        return;
+    }
+    int split = chain_split(plan, first, last);
+    fprintf(stream, "(");
+    print_chain_order(stream, plan, first, split);
+    fprintf(stream, " * ");
+    print_chain_order(stream, plan, split + 1, last);
+    fprintf(stream, ")");
+}
+
+void free_chain_plan(chain_plan *plan)
+{
+    free(plan->split);
+    plan->split = NULL;
+    plan->nr_operands = 0;
+}
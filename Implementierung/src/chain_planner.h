@@ -0,0 +1,53 @@
+/**
+ * @file chain_planner.h
+ * @brief Cost-based parenthesization of matrix chain products (A * B * C ...).
+ */
+#ifndef CHAIN_PLANNER_H
+#define CHAIN_PLANNER_H
+#include <stdio.h>
+#include "../include/ellpack.h"
+
+/**
+ * @struct chain_plan
+ * @brief Cheapest estimated order in which the operands of a chain are multiplied.
+ *
+ * The product of the operands `first..last` is computed as (`first..s`) * (`s+1..last`)
+ * with `s = split[first * nr_operands + last]` (see `chain_split`).
+ */
+typedef struct {
+    int nr_operands;
+    int* split;            ///< Split point of every sub-chain, size `nr_operands * nr_operands`
+    double estimated_cost; ///< Estimated multiply-adds plus stored non-zeros of all products
+} chain_plan;
+
+/**
+ * @brief Choose the parenthesization of a chain with the lowest estimated cost.
+ *
+ * The estimate starts from the exact row and column non-zero counts of every operand.
+ * A product costs its multiply-adds (sum over the shared dimension of column count of the left
+ * times row count of the right operand) plus its non-zeros; the counts of a product are
+ * estimated by assuming that the non-zeros inside a column of the left (row of the right)
+ * operand are spread uniformly. Ties are resolved in favour of the left-to-right order.
+ * @param operands The operands in multiplication order (dimensions have to match).
+ * @param nr_operands Number of operands (at least 1).
+ * @param plan Output, has to be freed with `free_chain_plan`.
+ * @return 0 on success, non-zero on allocation failure.
+ */
+int plan_matrix_chain(const const_ELLPACKMatrix *operands, int nr_operands, chain_plan *plan);
+
+/**
+ * @brief Split point of the sub-chain `first..last` (`first < last`): the left factor ends at the returned operand.
+ */
+int chain_split(const chain_plan *plan, int first, int last);
+
+/**
+ * @brief Print the order of the sub-chain `first..last`, e.g. `((A1 * A2) * A3)`.
+ */
+void print_chain_order(FILE *stream, const chain_plan *plan, int first, int last);
+
+/**
+ * @brief Free the split table and reset the plan to empty state.
+ */
+void free_chain_plan(chain_plan *plan);
+
+#endif // CHAIN_PLANNER_H
@@ -0,0 +1,647 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <immintrin.h>
+#include <string.h>
+#include "dot_product.h"
+
+static inline float dot_product(const float *row_cache, const uint32_t *col_indices, const float *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    float result_value = 0;
+    // for each element in the column
+    for (uint64_t b_col_offset = 0; b_col_offset < col_num_elts; b_col_offset++) {
+        uint64_t ellpack_idx_in_b = col_start_idx + b_col_offset;
+        float row_value = row_cache[col_indices[ellpack_idx_in_b]];
+        result_value += row_value * col_values[ellpack_idx_in_b];
+    }
+    return result_value;
+}
+
+// same as dot_product, for matrices with 64-bit indices
+static inline float dot_product_wide(const float *row_cache, const uint64_t *col_indices, const float *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    float result_value = 0;
+    for (uint64_t b_col_offset = 0; b_col_offset < col_num_elts; b_col_offset++) {
+        uint64_t ellpack_idx_in_b = col_start_idx + b_col_offset;
+        result_value += row_cache[col_indices[ellpack_idx_in_b]] * col_values[ellpack_idx_in_b];
+    }
+    return result_value;
+}
+
+static inline float dot_product_simd(const float *row_cache, const uint32_t *col_indices, const float *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+     __m128 result_vector = _mm_setzero_ps();
+     uint64_t b_col_offset = 0;
+     // for each element in the column
+     for (; b_col_offset + 4 <= col_num_elts; b_col_offset += 4) {
+
+         //step 1: load the corresponding row values into a vector
+         uint64_t idx0 = col_start_idx + b_col_offset;
+         uint64_t idx1 = col_start_idx + b_col_offset + 1;
+         uint64_t idx2 = col_start_idx + b_col_offset + 2;
+         uint64_t idx3 = col_start_idx + b_col_offset + 3;
+
+         __m128 row_vector = _mm_set_ps(
+             row_cache[col_indices[idx3]],
+             row_cache[col_indices[idx2]],
+             row_cache[col_indices[idx1]],
+             row_cache[col_indices[idx0]]
+         );
+         //step 2: load the column values into a vector
+         __m128 value_vector = _mm_loadu_ps(&col_values[idx0]);
+         //step 3: multiply the vectors and add the result to the result vector
+         __m128 product_vector = _mm_mul_ps(row_vector, value_vector);
+         //step 4: add the product to the result vector
+         result_vector = _mm_add_ps(result_vector, product_vector);
+     }
+     // aggregate the result vector to a single float
+     result_vector = _mm_hadd_ps(result_vector, result_vector);
+     result_vector = _mm_hadd_ps(result_vector, result_vector);
+     float result_value = _mm_cvtss_f32(result_vector);
+
+     // process remaining elements
+     for (; b_col_offset < col_num_elts; b_col_offset++) {
+         uint64_t ellpack_idx_in_b = col_start_idx + b_col_offset;
+         float row_value = row_cache[col_indices[ellpack_idx_in_b]];
+         result_value += row_value * col_values[ellpack_idx_in_b];
+     }
+
+     return result_value;
+}
+
+/**
+ * AVX2 version: the row values are loaded with hardware gathers (8 32-bit indices per gather) and accumulated with FMA.
+ */
+__attribute__((target("avx2,fma")))
+static inline float dot_product_avx2(const float *row_cache, const uint32_t *col_indices, const float *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const uint32_t *indices = col_indices + col_start_idx;
+    const float *values = col_values + col_start_idx;
+    __m256 result_vector = _mm256_setzero_ps();
+    uint64_t b_col_offset = 0;
+    for (; b_col_offset + 8 <= col_num_elts; b_col_offset += 8) {
+        __m256i index_vector = _mm256_loadu_si256((const __m256i *) &indices[b_col_offset]);
+        __m256 row_vector = _mm256_i32gather_ps(row_cache, index_vector, sizeof(float));
+        result_vector = _mm256_fmadd_ps(row_vector, _mm256_loadu_ps(&values[b_col_offset]), result_vector);
+    }
+    __m128 result_half = _mm_add_ps(_mm256_castps256_ps128(result_vector), _mm256_extractf128_ps(result_vector, 1));
+    if (b_col_offset + 4 <= col_num_elts) {
+        __m128i index_vector = _mm_loadu_si128((const __m128i *) &indices[b_col_offset]);
+        __m128 row_vector = _mm_i32gather_ps(row_cache, index_vector, sizeof(float));
+        result_half = _mm_fmadd_ps(row_vector, _mm_loadu_ps(&values[b_col_offset]), result_half);
+        b_col_offset += 4;
+    }
+    // aggregate the result vector to a single float
+    result_half = _mm_add_ps(result_half, _mm_movehl_ps(result_half, result_half));
+    result_half = _mm_add_ss(result_half, _mm_movehdup_ps(result_half));
+    float result_value = _mm_cvtss_f32(result_half);
+
+    // process remaining elements
+    for (; b_col_offset < col_num_elts; b_col_offset++) {
+        result_value += row_cache[indices[b_col_offset]] * values[b_col_offset];
+    }
+    return result_value;
+}
+
+/**
+ * AVX-512 version: 16 elements per gather, the tail is handled with masks.
+ */
+__attribute__((target("avx512f")))
+static inline float dot_product_avx512(const float *row_cache, const uint32_t *col_indices, const float *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const uint32_t *indices = col_indices + col_start_idx;
+    const float *values = col_values + col_start_idx;
+    __m512 result_vector = _mm512_setzero_ps();
+    for (uint64_t b_col_offset = 0; b_col_offset < col_num_elts; b_col_offset += 16) {
+        uint64_t remaining = col_num_elts - b_col_offset;
+        __mmask16 mask = remaining >= 16 ? 0xFFFF : (__mmask16) ((1u << remaining) - 1);
+        // masked lanes are not read, so the loads and the gather never leave the column
+        __m512i index_vector = _mm512_maskz_loadu_epi32(mask, &indices[b_col_offset]);
+        __m512 row_vector = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index_vector, row_cache, sizeof(float));
+        result_vector = _mm512_fmadd_ps(row_vector, _mm512_maskz_loadu_ps(mask, &values[b_col_offset]), result_vector);
+    }
+    return _mm512_reduce_add_ps(result_vector);
+}
+
+/* Packed layout: index and value of an element are read from one record, i.e. one memory stream per column */
+
+static inline float dot_product_packed(const float *row_cache, const ellpack_entry *col_entries, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const ellpack_entry *entries = col_entries + col_start_idx;
+    float result_value = 0;
+    for (uint64_t b_col_offset = 0; b_col_offset < col_num_elts; b_col_offset++) {
+        result_value += row_cache[entries[b_col_offset].index] * entries[b_col_offset].value;
+    }
+    return result_value;
+}
+
+static inline float dot_product_packed_simd(const float *row_cache, const ellpack_entry *col_entries, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const ellpack_entry *entries = col_entries + col_start_idx;
+    __m128 result_vector = _mm_setzero_ps();
+    uint64_t b_col_offset = 0;
+    for (; b_col_offset + 4 <= col_num_elts; b_col_offset += 4) {
+        const ellpack_entry *e = &entries[b_col_offset];
+        __m128 row_vector = _mm_set_ps(row_cache[e[3].index], row_cache[e[2].index], row_cache[e[1].index], row_cache[e[0].index]);
+        __m128 value_vector = _mm_set_ps(e[3].value, e[2].value, e[1].value, e[0].value);
+        result_vector = _mm_add_ps(result_vector, _mm_mul_ps(row_vector, value_vector));
+    }
+    result_vector = _mm_hadd_ps(result_vector, result_vector);
+    result_vector = _mm_hadd_ps(result_vector, result_vector);
+    float result_value = _mm_cvtss_f32(result_vector);
+    for (; b_col_offset < col_num_elts; b_col_offset++) {
+        result_value += row_cache[entries[b_col_offset].index] * entries[b_col_offset].value;
+    }
+    return result_value;
+}
+
+/**
+ * AVX2 version: 8 records are loaded with two 256-bit loads and split into indices and values with one shuffle each.
+ * The shuffle mixes the order of the elements, but indices and values are mixed the same way.
+ */
+__attribute__((target("avx2,fma")))
+static inline float dot_product_packed_avx2(const float *row_cache, const ellpack_entry *col_entries, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const ellpack_entry *entries = col_entries + col_start_idx;
+    __m256 result_vector = _mm256_setzero_ps();
+    uint64_t b_col_offset = 0;
+    for (; b_col_offset + 8 <= col_num_elts; b_col_offset += 8) {
+        __m256 records_low = _mm256_loadu_ps((const float *) &entries[b_col_offset]);
+        __m256 records_high = _mm256_loadu_ps((const float *) &entries[b_col_offset + 4]);
+        __m256i index_vector = _mm256_castps_si256(_mm256_shuffle_ps(records_low, records_high, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256 value_vector = _mm256_shuffle_ps(records_low, records_high, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 row_vector = _mm256_i32gather_ps(row_cache, index_vector, sizeof(float));
+        result_vector = _mm256_fmadd_ps(row_vector, value_vector, result_vector);
+    }
+    __m128 result_half = _mm_add_ps(_mm256_castps256_ps128(result_vector), _mm256_extractf128_ps(result_vector, 1));
+    result_half = _mm_add_ps(result_half, _mm_movehl_ps(result_half, result_half));
+    result_half = _mm_add_ss(result_half, _mm_movehdup_ps(result_half));
+    float result_value = _mm_cvtss_f32(result_half);
+    for (; b_col_offset < col_num_elts; b_col_offset++) {
+        result_value += row_cache[entries[b_col_offset].index] * entries[b_col_offset].value;
+    }
+    return result_value;
+}
+
+/**
+ * AVX-512 version: 16 records per iteration, split with two-source permutes; the tail uses masked loads.
+ */
+__attribute__((target("avx512f")))
+static inline float dot_product_packed_avx512(const float *row_cache, const ellpack_entry *col_entries, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const float *records = (const float *) (col_entries + col_start_idx);
+    const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+    __m512 result_vector = _mm512_setzero_ps();
+    for (uint64_t b_col_offset = 0; b_col_offset < col_num_elts; b_col_offset += 16) {
+        uint64_t remaining = col_num_elts - b_col_offset;
+        __mmask16 mask = remaining >= 16 ? 0xFFFF : (__mmask16) ((1u << remaining) - 1);
+        // two floats per record: the low load covers records 0-7, the high load records 8-15
+        __mmask16 mask_low = remaining >= 8 ? 0xFFFF : (__mmask16) ((1u << (2 * remaining)) - 1);
+        __mmask16 mask_high = remaining >= 16 ? 0xFFFF : remaining <= 8 ? 0 : (__mmask16) ((1u << (2 * (remaining - 8))) - 1);
+        __m512 records_low = _mm512_maskz_loadu_ps(mask_low, &records[2 * b_col_offset]);
+        __m512 records_high = _mm512_maskz_loadu_ps(mask_high, &records[2 * b_col_offset + 16]);
+        __m512i index_vector = _mm512_castps_si512(_mm512_permutex2var_ps(records_low, even, records_high));
+        __m512 value_vector = _mm512_permutex2var_ps(records_low, odd, records_high);
+        __m512 row_vector = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index_vector, row_cache, sizeof(float));
+        result_vector = _mm512_fmadd_ps(row_vector, value_vector, result_vector);
+    }
+    return _mm512_reduce_add_ps(result_vector);
+}
+
+/* Half-width values: 16-bit loads, widened to fp32 before the multiplication */
+
+// works for all index widths and value formats
+static inline float dot_product_generic(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    float result_value = 0;
+    for (uint64_t k = col_start_idx; k < col_start_idx + col_num_elts; k++) {
+        result_value += row_cache[ellpack_index(matr_b, k)] * ellpack_value(matr_b, k);
+    }
+    return result_value;
+}
+
+__attribute__((target("avx2,fma")))
+static inline float reduce_add_avx2(__m256 vector) {
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(vector), _mm256_extractf128_ps(vector, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_movehdup_ps(half));
+    return _mm_cvtss_f32(half);
+}
+
+/**
+ * AVX2 version for bfloat16 values: widening is a zero extension to 32 bits and a shift by 16.
+ */
+__attribute__((target("avx2,fma")))
+static inline float dot_product_bf16_avx2(const float *row_cache, const uint32_t *col_indices, const uint16_t *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const uint32_t *indices = col_indices + col_start_idx;
+    const uint16_t *values = col_values + col_start_idx;
+    __m256 result_vector = _mm256_setzero_ps();
+    uint64_t b_col_offset = 0;
+    for (; b_col_offset + 8 <= col_num_elts; b_col_offset += 8) {
+        __m256i index_vector = _mm256_loadu_si256((const __m256i *) &indices[b_col_offset]);
+        __m256 row_vector = _mm256_i32gather_ps(row_cache, index_vector, sizeof(float));
+        __m256i value_bits = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) &values[b_col_offset]));
+        result_vector = _mm256_fmadd_ps(row_vector, _mm256_castsi256_ps(_mm256_slli_epi32(value_bits, 16)), result_vector);
+    }
+    float result_value = reduce_add_avx2(result_vector);
+    for (; b_col_offset < col_num_elts; b_col_offset++) {
+        result_value += row_cache[indices[b_col_offset]] * bf16_to_float(values[b_col_offset]);
+    }
+    return result_value;
+}
+
+/**
+ * AVX2 version for fp16 values, widened with the F16C conversion.
+ */
+__attribute__((target("avx2,fma,f16c")))
+static inline float dot_product_fp16_avx2(const float *row_cache, const uint32_t *col_indices, const uint16_t *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const uint32_t *indices = col_indices + col_start_idx;
+    const uint16_t *values = col_values + col_start_idx;
+    __m256 result_vector = _mm256_setzero_ps();
+    uint64_t b_col_offset = 0;
+    for (; b_col_offset + 8 <= col_num_elts; b_col_offset += 8) {
+        __m256i index_vector = _mm256_loadu_si256((const __m256i *) &indices[b_col_offset]);
+        __m256 row_vector = _mm256_i32gather_ps(row_cache, index_vector, sizeof(float));
+        __m256 value_vector = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) &values[b_col_offset]));
+        result_vector = _mm256_fmadd_ps(row_vector, value_vector, result_vector);
+    }
+    float result_value = reduce_add_avx2(result_vector);
+    for (; b_col_offset < col_num_elts; b_col_offset++) {
+        result_value += row_cache[indices[b_col_offset]] * fp16_to_float(values[b_col_offset]);
+    }
+    return result_value;
+}
+
+/**
+ * Loads the 16-bit values [offset, offset + 16) of a column for the AVX-512 half kernels. AVX-512F has no 16-bit masked load,
+ * so the tail is loaded as whole 32-bit pairs; lanes from 2 * pairs on are zero (the odd last value is left to the caller).
+ */
+__attribute__((target("avx512f")))
+static inline __m256i load_values16_avx512(const uint16_t *values, uint64_t remaining, __mmask16 *lane_mask) {
+    if (remaining >= 16) {
+        *lane_mask = 0xFFFF;
+        return _mm256_loadu_si256((const __m256i *) values);
+    }
+    uint64_t pairs = remaining / 2;
+    *lane_mask = (__mmask16) ((1u << (2 * pairs)) - 1);
+    return _mm512_castsi512_si256(_mm512_maskz_loadu_epi32((__mmask16) ((1u << pairs) - 1), values));
+}
+
+/**
+ * AVX-512 versions for half-width values: 16 elements per gather, the widening is the same as in the AVX2 versions.
+ */
+__attribute__((target("avx512f")))
+static inline float dot_product_bf16_avx512(const float *row_cache, const uint32_t *col_indices, const uint16_t *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const uint32_t *indices = col_indices + col_start_idx;
+    const uint16_t *values = col_values + col_start_idx;
+    __m512 result_vector = _mm512_setzero_ps();
+    uint64_t b_col_offset = 0;
+    for (; b_col_offset + 1 < col_num_elts; b_col_offset += 16) {
+        __mmask16 mask;
+        __m256i value_halves = load_values16_avx512(&values[b_col_offset], col_num_elts - b_col_offset, &mask);
+        __m512i index_vector = _mm512_maskz_loadu_epi32(mask, &indices[b_col_offset]);
+        __m512 row_vector = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index_vector, row_cache, sizeof(float));
+        __m512 value_vector = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(value_halves), 16));
+        result_vector = _mm512_fmadd_ps(row_vector, value_vector, result_vector);
+    }
+    float result_value = _mm512_reduce_add_ps(result_vector);
+    if (col_num_elts % 2 == 1) { // the last value was not covered by the 32-bit pairs
+        result_value += row_cache[indices[col_num_elts - 1]] * bf16_to_float(values[col_num_elts - 1]);
+    }
+    return result_value;
+}
+
+__attribute__((target("avx512f")))
+static inline float dot_product_fp16_avx512(const float *row_cache, const uint32_t *col_indices, const uint16_t *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
+    const uint32_t *indices = col_indices + col_start_idx;
+    const uint16_t *values = col_values + col_start_idx;
+    __m512 result_vector = _mm512_setzero_ps();
+    uint64_t b_col_offset = 0;
+    for (; b_col_offset + 1 < col_num_elts; b_col_offset += 16) {
+        __mmask16 mask;
+        __m256i value_halves = load_values16_avx512(&values[b_col_offset], col_num_elts - b_col_offset, &mask);
+        __m512i index_vector = _mm512_maskz_loadu_epi32(mask, &indices[b_col_offset]);
+        __m512 row_vector = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index_vector, row_cache, sizeof(float));
+        result_vector = _mm512_fmadd_ps(row_vector, _mm512_cvtph_ps(value_halves), result_vector);
+    }
+    float result_value = _mm512_reduce_add_ps(result_vector);
+    if (col_num_elts % 2 == 1) {
+        result_value += row_cache[indices[col_num_elts - 1]] * fp16_to_float(values[col_num_elts - 1]);
+    }
+    return result_value;
+}
+
+/* Row kernels: one call per row of A, so the dispatch cost is paid once per row and the dot products can be inlined */
+
+void row_kernel_scalar(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    // j is uint32_t because this is checked in the matrix validator
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        uint64_t b_col_start = col_begin[j];
+        uint64_t num_col_elts = col_end[j] - b_col_start;
+        if (matr_b->entries != NULL)
+            row_result[t] = dot_product_packed(row_cache, matr_b->entries, b_col_start, num_col_elts);
+        else if (matr_b->values16 != NULL)
+            row_result[t] = dot_product_generic(row_cache, matr_b, b_col_start, num_col_elts);
+        else if (matr_b->indices32 != NULL)
+            row_result[t] = dot_product(row_cache, matr_b->indices32, matr_b->values, b_col_start, num_col_elts);
+        else
+            row_result[t] = dot_product_wide(row_cache, matr_b->indices, matr_b->values, b_col_start, num_col_elts);
+    }
+}
+
+static void row_kernel_sse(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_simd(row_cache, matr_b->indices32, matr_b->values, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void row_kernel_avx2(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_avx2(row_cache, matr_b->indices32, matr_b->values, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void row_kernel_avx512(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_avx512(row_cache, matr_b->indices32, matr_b->values, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+static void row_kernel_packed_sse(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_packed_simd(row_cache, matr_b->entries, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void row_kernel_packed_avx2(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_packed_avx2(row_cache, matr_b->entries, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void row_kernel_packed_avx512(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_packed_avx512(row_cache, matr_b->entries, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void row_kernel_bf16_avx2(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_bf16_avx2(row_cache, matr_b->indices32, matr_b->values16, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static void row_kernel_fp16_avx2(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_fp16_avx2(row_cache, matr_b->indices32, matr_b->values16, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void row_kernel_bf16_avx512(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_bf16_avx512(row_cache, matr_b->indices32, matr_b->values16, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void row_kernel_fp16_avx512(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        row_result[t] = dot_product_fp16_avx512(row_cache, matr_b->indices32, matr_b->values16, col_begin[j], col_end[j] - col_begin[j]);
+    }
+}
+
+/* Panel kernels: every element of a column of b is loaded once and multiplied with PANEL_ROWS rows of a */
+
+void panel_kernel_scalar(const float *panel, const const_ELLPACKMatrix *matr_b, const uint64_t *b_col_starts, const uint32_t *cols, uint64_t nr_cols, float *panel_result)
+{
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        float acc[PANEL_ROWS] = {0};
+        for (uint64_t b_idx = b_col_starts[j]; b_idx < b_col_starts[j + 1]; b_idx++)
+        {
+            const float *panel_row = panel + ellpack_index(matr_b, b_idx) * PANEL_ROWS;
+            float b_value = ellpack_value(matr_b, b_idx);
+            for (int r = 0; r < PANEL_ROWS; r++)
+            {
+                acc[r] += panel_row[r] * b_value;
+            }
+        }
+        memcpy(&panel_result[t * PANEL_ROWS], acc, sizeof(acc));
+    }
+}
+
+static void panel_kernel_sse(const float *panel, const const_ELLPACKMatrix *matr_b, const uint64_t *b_col_starts, const uint32_t *cols, uint64_t nr_cols, float *panel_result)
+{
+    const uint32_t *indices = matr_b->indices32;
+    const float *values = matr_b->values;
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        // rows 0-3 and 4-7 of the panel
+        __m128 acc_low = _mm_setzero_ps();
+        __m128 acc_high = _mm_setzero_ps();
+        for (uint64_t b_idx = b_col_starts[j]; b_idx < b_col_starts[j + 1]; b_idx++)
+        {
+            const float *panel_row = panel + (uint64_t) indices[b_idx] * PANEL_ROWS;
+            __m128 b_vector = _mm_set1_ps(values[b_idx]);
+            acc_low = _mm_add_ps(acc_low, _mm_mul_ps(_mm_loadu_ps(panel_row), b_vector));
+            acc_high = _mm_add_ps(acc_high, _mm_mul_ps(_mm_loadu_ps(panel_row + 4), b_vector));
+        }
+        _mm_storeu_ps(&panel_result[t * PANEL_ROWS], acc_low);
+        _mm_storeu_ps(&panel_result[t * PANEL_ROWS + 4], acc_high);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void panel_kernel_avx2(const float *panel, const const_ELLPACKMatrix *matr_b, const uint64_t *b_col_starts, const uint32_t *cols, uint64_t nr_cols, float *panel_result)
+{
+    const uint32_t *indices = matr_b->indices32;
+    const float *values = matr_b->values;
+    for (uint64_t t = 0; t < nr_cols; t++)
+    {
+        uint32_t j = cols != NULL ? cols[t] : t;
+        // two accumulators so consecutive FMAs do not wait for each other
+        __m256 acc_even = _mm256_setzero_ps();
+        __m256 acc_odd = _mm256_setzero_ps();
+        uint64_t b_idx = b_col_starts[j];
+        const uint64_t b_end = b_col_starts[j + 1];
+        for (; b_idx + 2 <= b_end; b_idx += 2)
+        {
+            acc_even = _mm256_fmadd_ps(_mm256_loadu_ps(panel + (uint64_t) indices[b_idx] * PANEL_ROWS), _mm256_set1_ps(values[b_idx]), acc_even);
+            acc_odd = _mm256_fmadd_ps(_mm256_loadu_ps(panel + (uint64_t) indices[b_idx + 1] * PANEL_ROWS), _mm256_set1_ps(values[b_idx + 1]), acc_odd);
+        }
+        if (b_idx < b_end)
+        {
+            acc_even = _mm256_fmadd_ps(_mm256_loadu_ps(panel + (uint64_t) indices[b_idx] * PANEL_ROWS), _mm256_set1_ps(values[b_idx]), acc_even);
+        }
+        _mm256_storeu_ps(&panel_result[t * PANEL_ROWS], _mm256_add_ps(acc_even, acc_odd));
+    }
+}
+
+/* SELL kernels: SELL_CHUNK columns per pass, the elements of a chunk are stored position-major so one load covers all columns */
+
+static void sell_kernel_sse(const float *row_cache, const sell_matrix *sell, const uint32_t *chunks, uint64_t nr_chunks, float *slot_result)
+{
+    for (uint64_t t = 0; t < nr_chunks; t++)
+    {
+        uint32_t chunk = chunks != NULL ? chunks[t] : t;
+        const uint32_t *indices = sell->indices;
+        const float *values = sell->values;
+        // slots 0-3 and 4-7 of the chunk
+        __m128 acc_low = _mm_setzero_ps();
+        __m128 acc_high = _mm_setzero_ps();
+        for (uint64_t k = sell->chunk_starts[chunk]; k < sell->chunk_starts[chunk + 1]; k += SELL_CHUNK)
+        {
+            __m128 row_low = _mm_set_ps(row_cache[indices[k + 3]], row_cache[indices[k + 2]], row_cache[indices[k + 1]], row_cache[indices[k]]);
+            __m128 row_high = _mm_set_ps(row_cache[indices[k + 7]], row_cache[indices[k + 6]], row_cache[indices[k + 5]], row_cache[indices[k + 4]]);
+            acc_low = _mm_add_ps(acc_low, _mm_mul_ps(row_low, _mm_loadu_ps(&values[k])));
+            acc_high = _mm_add_ps(acc_high, _mm_mul_ps(row_high, _mm_loadu_ps(&values[k + 4])));
+        }
+        _mm_storeu_ps(&slot_result[(uint64_t) chunk * SELL_CHUNK], acc_low);
+        _mm_storeu_ps(&slot_result[(uint64_t) chunk * SELL_CHUNK + 4], acc_high);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void sell_kernel_avx2(const float *row_cache, const sell_matrix *sell, const uint32_t *chunks, uint64_t nr_chunks, float *slot_result)
+{
+    for (uint64_t t = 0; t < nr_chunks; t++)
+    {
+        uint32_t chunk = chunks != NULL ? chunks[t] : t;
+        __m256 acc = _mm256_setzero_ps();
+        for (uint64_t k = sell->chunk_starts[chunk]; k < sell->chunk_starts[chunk + 1]; k += SELL_CHUNK)
+        {
+            __m256i index_vector = _mm256_loadu_si256((const __m256i *) &sell->indices[k]);
+            __m256 row_vector = _mm256_i32gather_ps(row_cache, index_vector, sizeof(float));
+            acc = _mm256_fmadd_ps(row_vector, _mm256_loadu_ps(&sell->values[k]), acc);
+        }
+        _mm256_storeu_ps(&slot_result[(uint64_t) chunk * SELL_CHUNK], acc);
+    }
+}
+
+/* Runtime dispatch */
+static row_kernel_func simd_row_kernel = NULL;
+static row_kernel_func simd_row_kernel_packed = NULL; // same instruction set, for the packed layout
+static const char *simd_row_kernel_name = NULL;
+
+const char *select_simd_row_kernel(void)
+{
+    if (simd_row_kernel != NULL)
+        return simd_row_kernel_name;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        simd_row_kernel = row_kernel_avx512;
+        simd_row_kernel_packed = row_kernel_packed_avx512;
+        simd_row_kernel_name = "AVX-512";
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        simd_row_kernel = row_kernel_avx2;
+        simd_row_kernel_packed = row_kernel_packed_avx2;
+        simd_row_kernel_name = "AVX2";
+    }
+    else
+    {
+        simd_row_kernel = row_kernel_sse;
+        simd_row_kernel_packed = row_kernel_packed_sse;
+        simd_row_kernel_name = "SSE3";
+    }
+    return simd_row_kernel_name;
+}
+
+row_kernel_func get_simd_row_kernel(const const_ELLPACKMatrix *matr_b)
+{
+    select_simd_row_kernel();
+    if (matr_b->indices32 == NULL)
+    { // only the scalar kernel supports 64-bit indices
+        return row_kernel_scalar;
+    }
+    if (matr_b->entries == NULL && matr_b->values16 != NULL)
+    { // half-width values: AVX-512 or AVX2 kernels (the gathers use signed 32-bit offsets), everything else is scalar
+        bool gathers = matr_b->nr_rows <= INT32_MAX;
+        if (gathers && __builtin_cpu_supports("avx512f"))
+            return matr_b->value_format == VALUES_BF16 ? row_kernel_bf16_avx512 : row_kernel_fp16_avx512;
+        bool avx2 = gathers && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        if (avx2 && matr_b->value_format == VALUES_BF16)
+            return row_kernel_bf16_avx2;
+        if (avx2 && matr_b->value_format == VALUES_FP16 && __builtin_cpu_supports("f16c"))
+            return row_kernel_fp16_avx2;
+        return row_kernel_scalar;
+    }
+    if (matr_b->nr_rows > INT32_MAX)
+    { // the gather instructions use signed 32-bit offsets
+        return matr_b->entries != NULL ? row_kernel_packed_sse : row_kernel_sse;
+    }
+    return matr_b->entries != NULL ? simd_row_kernel_packed : simd_row_kernel;
+}
+
+const char *select_simd_panel_kernel(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? "AVX2" : "SSE3";
+}
+
+panel_kernel_func get_simd_panel_kernel(const const_ELLPACKMatrix *matr_b)
+{
+    if (matr_b->indices32 == NULL || matr_b->values16 != NULL)
+    { // only the scalar kernel supports 64-bit indices and half-width values
+        return panel_kernel_scalar;
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return panel_kernel_avx2;
+    }
+    return panel_kernel_sse;
+}
+
+const char *select_simd_sell_kernel(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? "AVX2" : "SSE3";
+}
+
+sell_kernel_func get_simd_sell_kernel(const const_ELLPACKMatrix *matr_b)
+{
+    __builtin_cpu_init();
+    // the gather instructions use signed 32-bit offsets
+    if (matr_b->nr_rows <= INT32_MAX && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return sell_kernel_avx2;
+    }
+    return sell_kernel_sse;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file dot_product.h
+ * @brief Dot products of a dense row with the columns of B, with runtime SIMD dispatch.
+ */
+#ifndef DOT_PRODUCT_H
+#define DOT_PRODUCT_H
+#include "../include/ellpack.h"
+#include "matrix_utils.h"
+
+/**
+ * @brief Kernel that multiplies one dense row of A with a set of columns of B.
+ * @param row_cache Dense row of A (size `matr_b->nr_rows`).
+ * @param matr_b Right operand.
+ * @param col_begin First position of every column of B in its values/indices arrays.
+ * @param col_end End position of every column of B (`col_begin + 1` for whole columns; tiles pass a part of each column).
+ * @param cols Columns to multiply with, or NULL for all columns of B.
+ * @param nr_cols Number of entries in `cols` (`matr_b->nr_cols` if `cols` is NULL).
+ * @param row_result Output array, entry t is the dot product with column `cols[t]` (or column t).
+ */
+typedef void (*row_kernel_func)(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result);
+
+/**
+ * @brief Scalar row kernel (no SIMD), supports 32-bit and 64-bit indices, the packed layout and half-width values.
+ */
+void row_kernel_scalar(const float *row_cache, const const_ELLPACKMatrix *matr_b, const uint64_t *col_begin, const uint64_t *col_end, const uint32_t *cols, uint64_t nr_cols, float *row_result);
+
+/**
+ * @brief Select the widest SIMD row kernel the CPU supports (AVX-512, AVX2+FMA or SSE3).
+ *        The choice is made once; later calls return the same kernel.
+ * @return Name of the selected kernel.
+ */
+const char *select_simd_row_kernel(void);
+
+/**
+ * @brief Get the SIMD row kernel chosen by `select_simd_row_kernel` (selects it if needed).
+ * @param matr_b Right operand; kernels without support for its index width are not returned.
+ *        If `matr_b->entries` is set, the kernel for the packed layout is returned; for half-width values,
+ *        the AVX-512 or AVX2 kernel of the format (F16C for fp16) or the scalar kernel.
+ */
+row_kernel_func get_simd_row_kernel(const const_ELLPACKMatrix *matr_b);
+
+/** @brief Number of rows of A multiplied at once by the panel kernels. */
+#define PANEL_ROWS 8
+
+/**
+ * @brief Kernel that multiplies a panel of PANEL_ROWS rows of A with a set of columns of B.
+ * @param panel Dense panel of A, interleaved by row: entry `k * PANEL_ROWS + r` is element k of panel row r.
+ * @param matr_b Right operand.
+ * @param b_col_starts Offset of every column of B in its values/indices arrays (size `nr_cols + 1`).
+ * @param cols Columns to multiply with, or NULL for all columns of B.
+ * @param nr_cols Number of entries in `cols` (`matr_b->nr_cols` if `cols` is NULL).
+ * @param panel_result Output array, entry `t * PANEL_ROWS + r` is the dot product of panel row r with column `cols[t]` (or column t).
+ */
+typedef void (*panel_kernel_func)(const float *panel, const const_ELLPACKMatrix *matr_b, const uint64_t *b_col_starts, const uint32_t *cols, uint64_t nr_cols, float *panel_result);
+
+/**
+ * @brief Scalar panel kernel (no SIMD), supports 32-bit and 64-bit indices and half-width values.
+ */
+void panel_kernel_scalar(const float *panel, const const_ELLPACKMatrix *matr_b, const uint64_t *b_col_starts, const uint32_t *cols, uint64_t nr_cols, float *panel_result);
+
+/**
+ * @brief Name of the widest panel kernel the CPU supports (AVX2 or SSE3), for reporting.
+ */
+const char *select_simd_panel_kernel(void);
+
+/**
+ * @brief Get the widest panel kernel the CPU supports (AVX2+FMA or SSE3).
+ * @param matr_b Right operand; kernels without support for its index width are not returned.
+ */
+panel_kernel_func get_simd_panel_kernel(const const_ELLPACKMatrix *matr_b);
+
+/**
+ * @brief Kernel that multiplies one dense row of A with chunks of a SELL-C-sigma matrix B.
+ *        All SELL_CHUNK columns of a chunk are computed at once, one SIMD lane per column.
+ * @param row_cache Dense row of A (size `matr_b->nr_rows`).
+ * @param sell SELL copy of B (see `build_sell_matrix`).
+ * @param chunks Chunks to compute, or NULL for all chunks.
+ * @param nr_chunks Number of entries in `chunks` (`sell->nr_chunks` if `chunks` is NULL).
+ * @param slot_result Output array indexed by slot (size `sell->nr_chunks * SELL_CHUNK`); only the slots of the computed chunks are written.
+ */
+typedef void (*sell_kernel_func)(const float *row_cache, const sell_matrix *sell, const uint32_t *chunks, uint64_t nr_chunks, float *slot_result);
+
+/**
+ * @brief Name of the widest SELL kernel the CPU supports (AVX2 or SSE3), for reporting.
+ */
+const char *select_simd_sell_kernel(void);
+
+/**
+ * @brief Get the widest SELL kernel the CPU supports (AVX2+FMA or SSE3).
+ * @param matr_b Right operand the SELL matrix was built from.
+ */
+sell_kernel_func get_simd_sell_kernel(const const_ELLPACKMatrix *matr_b);
+
+#endif // DOT_PRODUCT_H
@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "../include/ellpack.h"
+#include "io.h"
+#include "matrix_utils.h"
+
+/**
+ * Converts between the text formats (ELLPACK, HYB) and the binary ELLPACK format (see ellpack_binary_header):
+ * a text input is written as binary, a binary input as ELLPACK text.
+ */
+
+static void print_help()
+{
+    printf("Usage: ellpack_convert <input> <output>\n");
+    printf("A text input (ELLPACK or HYB) is written as binary ELLPACK, a binary input as ELLPACK text\n");
+}
+
+/** @returns true if the file starts with ELLPACK_BINARY_MAGIC */
+static bool is_binary_file(const char *filename)
+{
+    char magic[sizeof(ELLPACK_BINARY_MAGIC)] = {0};
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return false;
+    size_t read = fread(magic, 1, strlen(ELLPACK_BINARY_MAGIC), file);
+    fclose(file);
+    return read == strlen(ELLPACK_BINARY_MAGIC) && memcmp(magic, ELLPACK_BINARY_MAGIC, read) == 0;
+}
+
+/**
+ * Writes a loaded matrix as ELLPACK text, through the result writer.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int write_text(const char *filename, const ELLPACKMatrix *a)
+{
+    if (a->nr_cols > UINT32_MAX || a->nr_ellpack_elts > UINT32_MAX)
+    {
+        fprintf(stderr, "`%s` is too large for the text writer\n", filename);
+        return EXIT_FAILURE;
+    }
+    result_mat columns = malloc_init_result_mat_exact((unsigned int)a->nr_cols, a->nr_of_non_zeros_per_col, a->nr_ellpack_elts);
+    if (columns.cols == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for the columns\n");
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    for (uint64_t col = 0, k = 0; status == EXIT_SUCCESS && col < a->nr_cols; col++)
+    {
+        for (uint64_t end = k + a->nr_of_non_zeros_per_col[col]; status == EXIT_SUCCESS && k < end; k++)
+        {
+            status = push_to_matrix(&columns, a->values[k], ellpack_index((const const_ELLPACKMatrix *)a, k), (unsigned int)col);
+        }
+    }
+    bool error_occurred_in_write = false;
+    if (status == EXIT_SUCCESS)
+    {
+        free(write_ellpack_matrix(filename, &columns, a->nr_rows, a->nr_cols, &error_occurred_in_write));
+    }
+    free_result_mat(&columns);
+    return status == EXIT_SUCCESS && !error_occurred_in_write ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+    {
+        print_help();
+        return EXIT_SUCCESS;
+    }
+    if (argc != 3)
+    {
+        print_help();
+        return EXIT_FAILURE;
+    }
+    const char *input = argv[1];
+    const char *output = argv[2];
+    bool to_text = is_binary_file(input);
+
+    ELLPACKMatrix matrix = get_empty_ellpackmatrix();
+    if (read_ellpack_matrix(&matrix, input))
+    {
+        return EXIT_FAILURE;
+    }
+    int status = to_text ? write_text(output, &matrix) : (write_ellpack_binary(output, &matrix) ? EXIT_FAILURE : EXIT_SUCCESS);
+    if (status == EXIT_SUCCESS)
+    {
+        printf("%s: %s, %" PRIu64 "x%" PRIu64 " with %" PRIu64 " non-zeros\n", output, to_text ? "ELLPACK text" : "binary ELLPACK",
+               matrix.nr_rows, matrix.nr_cols, matrix.total_non_zero_nr);
+    }
+    clean_matrix_data(&matrix);
+    return status;
+}
@@ -0,0 +1,123 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "huge_pages.h"
+
+/** Buffers that are smaller than one huge page are allocated with malloc */
+#define HUGE_PAGE_SIZE (2ULL << 20)
+
+static _Atomic uint64_t huge_page_buffers = 0;
+static _Atomic uint64_t huge_page_bytes = 0;
+static _Atomic uint64_t huge_page_fallbacks = 0;
+
+void *huge_page_alloc(size_t bytes)
+{
+    if (bytes < HUGE_PAGE_SIZE)
+    {
+        return malloc(bytes > 0 ? bytes : 1);
+    }
+    // round up, so that the last page of the buffer is a huge page as well
+    size_t size = (bytes + HUGE_PAGE_SIZE - 1) & ~(size_t) (HUGE_PAGE_SIZE - 1);
+    void *ptr = NULL;
+    if (size < bytes || posix_memalign(&ptr, HUGE_PAGE_SIZE, size) != 0)
+    {
+        return malloc(bytes);
+    }
+#ifdef MADV_HUGEPAGE
+    if (madvise(ptr, size, MADV_HUGEPAGE) == 0)
+    {
+        atomic_fetch_add(&huge_page_buffers, 1);
+        atomic_fetch_add(&huge_page_bytes, size);
+        return ptr;
+    }
+#endif
+    atomic_fetch_add(&huge_page_fallbacks, 1);
+    return ptr;
+}
+
+void *huge_page_calloc(size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+    if (nmemb * size < HUGE_PAGE_SIZE)
+    {
+        return calloc(nmemb > 0 ? nmemb : 1, size > 0 ? size : 1);
+    }
+    void *ptr = huge_page_alloc(nmemb * size);
+    if (ptr != NULL)
+    {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+void *huge_page_realloc(void *ptr, size_t old_bytes, size_t bytes)
+{
+    if (bytes < HUGE_PAGE_SIZE)
+    {
+        return realloc(ptr, bytes > 0 ? bytes : 1);
+    }
+    // realloc may move the buffer to an address that is not 2 MB aligned, which can not be backed by huge pages
+    void *new_ptr = huge_page_alloc(bytes);
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_bytes < bytes ? old_bytes : bytes);
+    free(ptr);
+    return new_ptr;
+}
+
+/**
+ * Reads a "<key> <number> kB" line of a /proc file.
+ * @returns the number in kB, or -1 if the file or key does not exist
+ */
+static long long read_proc_kb(const char *filename, const char *key)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    char line[256];
+    long long kb = -1;
+    size_t key_len = strlen(key);
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strncmp(line, key, key_len) == 0)
+        {
+            kb = strtoll(line + key_len, NULL, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return kb;
+}
+
+void print_huge_page_report(FILE *stream)
+{
+    char mode[128] = "unknown";
+    FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (file != NULL)
+    {
+        if (fgets(mode, sizeof(mode), file) != NULL)
+        {
+            mode[strcspn(mode, "\n")] = '\0';
+        }
+        fclose(file);
+    }
+    fprintf(stream, "Huge pages: %" PRIu64 " buffers (%.1f MiB) advised for 2 MB pages, %" PRIu64 " buffers with 4 KB pages only (transparent_hugepage: %s)\n",
+            atomic_load(&huge_page_buffers), atomic_load(&huge_page_bytes) / (1024.0 * 1024.0), atomic_load(&huge_page_fallbacks), mode);
+    long long huge_kb = read_proc_kb("/proc/self/smaps_rollup", "AnonHugePages:");
+    long long rss_kb = read_proc_kb("/proc/self/smaps_rollup", "Rss:");
+    if (huge_kb >= 0 && rss_kb >= 0)
+    {
+        fprintf(stream, "Huge pages: %.1f MiB of %.1f MiB resident memory are backed by 2 MB pages\n", huge_kb / 1024.0, rss_kb / 1024.0);
+    }
+}
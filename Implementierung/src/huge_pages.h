@@ -0,0 +1,39 @@
+/**
+ * @file huge_pages.h
+ * @brief Allocation of large buffers backed by 2 MB pages, and a report of the huge page usage.
+ */
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Allocate a buffer that is backed by 2 MB pages if possible (fewer TLB misses on random gathers).
+ *        Buffers of at least 2 MB are aligned to 2 MB and advised with `madvise(MADV_HUGEPAGE)`;
+ *        smaller buffers, or if the advice is not supported, use normal pages. Free with `free`.
+ * @param bytes Size of the buffer.
+ * @return Pointer to the buffer, or NULL on allocation failure.
+ */
+void *huge_page_alloc(size_t bytes);
+
+/**
+ * @brief Zeroed `huge_page_alloc` with the interface of `calloc`.
+ */
+void *huge_page_calloc(size_t nmemb, size_t size);
+
+/**
+ * @brief Resize a buffer of `huge_page_alloc` like `realloc`; buffers of at least 2 MB stay 2 MB aligned.
+ * @param ptr Buffer to resize (freed on success, unchanged on failure).
+ * @param old_bytes Current size of the buffer.
+ * @param bytes New size of the buffer.
+ * @return Pointer to the resized buffer, or NULL on allocation failure.
+ */
+void *huge_page_realloc(void *ptr, size_t old_bytes, size_t bytes);
+
+/**
+ * @brief Print how many buffers were advised for huge pages and how much memory of the process
+ *        is actually backed by them (from /proc/self/smaps_rollup, if available).
+ */
+void print_huge_page_report(FILE *stream);
+
+#endif // HUGE_PAGES_H
@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #define BUFFER_SIZE 1024
+#define STREAM_BUFFER_SIZE (1 << 20)
 
 #include <stdio.h>
 #include <stdint.h>
@@ -7,566 +8,1661 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "../include/ellpack.h"
 #include "io.h"
 #include "matrix_utils.h"
+#include "text_parser.h"
+#include "text_format.h"
+#include "huge_pages.h"
 
 #define expect_0(x) __builtin_expect(!!(x), 0) // for unlikely error handlers
 
 /**
- * returns 1 if error occured, else 0
- * @param a Matrix to read into. Every pointer in this should be NULL
- * @param filename file in which we get the matrix
- * a->values is allocated -> freed if something failed with clean_matrix_data; else clean_matrix_data
- * ----needs to be called after the matmul (in main)
- * star_index is allocated (compares if stars in indices and values are at the same positions)-> freed if failed or successful with clean_file_data
- * a->nr_of_non_zeros_per_col -> freed if something failed with clean_matrix_data; else clean_matrix_data needs to be called after the matmul (in main)
- * a-indices -> freed if something failed with clean_matrix_data; else clean_matrix_data needs to be called after the matmul (in main)
+ * Input file in memory: mapped if it is a regular file, otherwise (pipes) read into a buffer.
  */
-int read_ellpack_matrix(ELLPACKMatrix *a, const char *filename)
+typedef struct
 {
-    uint8_t *initial_star_index = NULL;
+    const char *data;
+    size_t size;
+    bool mapped;
+} input_file;
 
-    FILE *aptr = fopen(filename, "r");
-    uint8_t *star_index = NULL;
-    memset(a, 0, sizeof(ELLPACKMatrix)); // nullify the struct to prevent undefined behaviour in clean_error -> clean_matrix_data
-    // for now, we assume that the indices are sorted
-    a->sorted = true;
-
-    if (aptr == NULL)
+/**
+ * Maps `filename` read-only (or reads it completely if it can not be mapped).
+ * @returns 1 if an error occured, else 0
+ */
+static int open_input_file(input_file *file, const char *filename)
+{
+    *file = (input_file){.data = NULL, .size = 0, .mapped = false};
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
     {
         fprintf(stderr, "opening %s failed\n", filename);
-        goto clean_error;
+        return 1;
     }
-    //* 1. line: <#rows>,<#cols>,<#Ellpackrows>
-    char first_line[100];
-
-    if (fgets(first_line, 98, aptr) == NULL)
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
     {
-        fprintf(stderr, "reading the first line of %s failed\n", filename);
-        goto clean_error;
+        void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            // both lines are walked front to back, so aggressive read-ahead pays off
+            posix_madvise(data, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+            *file = (input_file){.data = data, .size = (size_t)info.st_size, .mapped = true};
+            close(fd);
+            return 0;
+        }
     }
-    if (strchr(first_line, '-') != NULL) // if minus in first line -> get rid of neg dimensions
+    // not mappable: read everything into one growing buffer
+    size_t capacity = 1 << 16;
+    char *buffer = malloc(capacity);
+    size_t size = 0;
+    ssize_t bytes = 0;
+    while (buffer != NULL && (bytes = read(fd, buffer + size, capacity - size)) > 0)
     {
-        fprintf(stderr, "%s contained negative dimension in the first line!\n", filename);
-        goto clean_error;
+        size += (size_t)bytes;
+        if (size == capacity)
+        {
+            char *bigger = realloc(buffer, capacity * 2);
+            if (bigger == NULL)
+            {
+                free(buffer);
+                buffer = NULL;
+                break;
+            }
+            buffer = bigger;
+            capacity *= 2;
+        }
     }
-    if (sscanf(first_line, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &a->nr_rows, &a->nr_cols, &a->nr_ellpack_elts) != 3)
+    close(fd);
+    if (buffer == NULL || bytes < 0)
     {
-        fprintf(stderr, "first line of matrix `%s` had the wrong format!\n", filename);
-        goto clean_error;
-    };
+        fprintf(stderr, "reading %s failed\n", filename);
+        free(buffer);
+        return 1;
+    }
+    *file = (input_file){.data = buffer, .size = size, .mapped = false};
+    return 0;
+}
 
-    //* 2. line: values (-> only keep the non star values)
-    size_t max_nr_of_values = a->nr_ellpack_elts * a->nr_cols;
+static void close_input_file(input_file *file)
+{
+    if (file->mapped)
+        munmap((void *)file->data, file->size);
+    else
+        free((void *)file->data);
+    *file = (input_file){.data = NULL, .size = 0, .mapped = false};
+}
+
+/** Skips spaces inside a line (never the newline, so that no parser can run into the next line) */
+static inline const char *skip_blanks(const char *pos, const char *line_end)
+{
+    while (pos < line_end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\v' || *pos == '\f'))
+        pos++;
+    return pos;
+}
+
+/** End of the line starting at `pos`: its newline, or the end of the file */
+static inline const char *find_line_end(const char *pos, const char *end)
+{
+    const char *newline = memchr(pos, '\n', (size_t)(end - pos));
+    return newline != NULL ? newline : end;
+}
 
-    // allocating the space for the ellpack arrays
-    a->values = malloc(max_nr_of_values * sizeof(float));
-    if ((a->values) == NULL)
+/**
+ * Steps over the delimiter behind a token: a comma, or the end of the line behind the last token.
+ * A line that ends too early is accepted here, the caller finds it when it expects the next token.
+ * @returns false if the token is followed by something else
+ */
+static inline bool skip_delimiter(const char **pos, const char *line_end, bool last)
+{
+    const char *p = skip_blanks(*pos, line_end);
+    if (p == line_end)
     {
-        fprintf(stderr, "allocating memory for the values array of `%s` failed\n", filename);
-        goto clean_error;
+        *pos = p;
+        return true;
     }
-    a->nr_of_non_zeros_per_col = malloc(a->nr_cols * sizeof(uint64_t));
-    if (a->nr_of_non_zeros_per_col == NULL)
+    if (last || *p != ',')
+        return false;
+    *pos = p + 1;
+    return true;
+}
+
+/**
+ * Parses one line of `count` overflow entries of a HYB file: floats if `values` is set,
+ * otherwise indices below `bound`. `*pos` is moved behind the line.
+ * @returns 1 if an error occured, else 0
+ */
+static int read_overflow_line(const char **pos, const char *end, const char *filename, uint64_t count, float *values, uint64_t *indices, uint64_t bound)
+{
+    const char *line_end = find_line_end(*pos, end);
+    const char *p = *pos;
+    for (uint64_t k = 0; k < count; k++)
     {
-        fprintf(stderr, "allocating memory for the nr_of_non_zeros_per_col array of `%s` failed\n", filename);
-        goto clean_error;
+        p = skip_blanks(p, line_end);
+        if (expect_0(p == line_end))
+        {
+            fprintf(stderr, "an overflow line of `%s` had %" PRIu64 " instead of %" PRIu64 " entries\n", filename, k, count);
+            return 1;
+        }
+        if (expect_0(values == NULL && *p == '-'))
+        {
+            fprintf(stderr, "negative indices are not valid!\n");
+            return 1;
+        }
+        if (expect_0(values != NULL ? !parse_float(&p, end, &values[k]) : !parse_index(&p, end, &indices[k])))
+        {
+            if (values != NULL && errno == ERANGE)
+                fprintf(stderr, "(a value in %s cannot be represented as a float): ", filename);
+            fprintf(stderr, "error when trying to convert overflow entry %" PRIu64 " in %s!\n", k, filename);
+            return 1;
+        }
+        if (expect_0(values == NULL && indices[k] >= bound))
+        {
+            fprintf(stderr, "overflow index %" PRIu64 " of `%s` is out of range!\n", indices[k], filename);
+            return 1;
+        }
+        if (expect_0(!skip_delimiter(&p, line_end, k + 1 == count)))
+        {
+            fprintf(stderr, "an overflow line of `%s` had more than %" PRIu64 " entries or an invalid delimiter\n", filename, count);
+            return 1;
+        }
+    }
+    *pos = line_end < end ? line_end + 1 : end;
+    return 0;
+}
+
+/**
+ * Reads the COO overflow of a HYB file (line 4: values, 5: row indices, 6: column indices) and appends
+ * every entry to the end of its column. Afterwards `nr_ellpack_elts` is the longest merged column
+ * and the matrix is marked as unsorted, so that the caller sorts (and checks) the merged columns.
+ * @returns 1 if an error occured, else 0
+ */
+static int read_hyb_overflow(ELLPACKMatrix *a, const char **pos, const char *end, const char *filename, uint64_t nr_overflow)
+{
+    int status = 1;
+    bool compact_indices = a->indices32 != NULL;
+    size_t index_size = compact_indices ? sizeof(uint32_t) : sizeof(uint64_t);
+    uint64_t total = a->total_non_zero_nr + nr_overflow;
+    float *values = NULL;
+    uint64_t *rows = NULL;
+    uint64_t *cols = NULL;
+    uint64_t *fill = NULL;
+    float *merged_values = NULL;
+    void *merged_indices = NULL;
+    if (nr_overflow > SIZE_MAX / sizeof(uint64_t) || total < nr_overflow)
+    {
+        fprintf(stderr, "`%s` has too many overflow entries!\n", filename);
+        goto cleanup;
+    }
+    values = malloc(nr_overflow * sizeof(float));
+    rows = malloc(nr_overflow * sizeof(uint64_t));
+    cols = malloc(nr_overflow * sizeof(uint64_t));
+    fill = malloc((a->nr_cols > 0 ? a->nr_cols : 1) * sizeof(uint64_t));
+    if (values == NULL || rows == NULL || cols == NULL || fill == NULL)
+    {
+        fprintf(stderr, "allocating memory for the overflow of `%s` failed\n", filename);
+        goto cleanup;
+    }
+    if (read_overflow_line(pos, end, filename, nr_overflow, values, NULL, 0) ||
+        read_overflow_line(pos, end, filename, nr_overflow, NULL, rows, a->nr_rows) ||
+        read_overflow_line(pos, end, filename, nr_overflow, NULL, cols, a->nr_cols))
+    {
+        goto cleanup;
     }
 
-    // calloc -> everything is zero -> no * found so far
-    if ((star_index = calloc(max_nr_of_values, sizeof(uint8_t))) == NULL)
+    merged_values = huge_page_alloc(total * sizeof(float));
+    merged_indices = huge_page_alloc(total * index_size);
+    if (merged_values == NULL || merged_indices == NULL)
     {
-        fprintf(stderr, "allocating memory to compare the * position failed!\n");
-        goto clean_error;
+        fprintf(stderr, "allocating memory for the merged columns of `%s` failed\n", filename);
+        goto cleanup;
+    }
+    // new column start = old column start + overflow entries of all previous columns
+    memset(fill, 0, a->nr_cols * sizeof(uint64_t));
+    for (uint64_t k = 0; k < nr_overflow; k++)
+    {
+        fill[cols[k]]++;
+    }
+    uint64_t longest_col = 0;
+    for (uint64_t col = 0, old_start = 0, new_start = 0; col < a->nr_cols; col++)
+    {
+        uint64_t head = a->nr_of_non_zeros_per_col[col];
+        uint64_t length = head + fill[col];
+        memcpy(merged_values + new_start, a->values + old_start, head * sizeof(float));
+        memcpy((char *)merged_indices + new_start * index_size,
+               compact_indices ? (void *)(a->indices32 + old_start) : (void *)(a->indices + old_start), head * index_size);
+        fill[col] = new_start + head; // where the next overflow entry of this column goes
+        a->nr_of_non_zeros_per_col[col] = length;
+        longest_col = length > longest_col ? length : longest_col;
+        old_start += head;
+        new_start += length;
+    }
+    for (uint64_t k = 0; k < nr_overflow; k++)
+    {
+        uint64_t pos = fill[cols[k]]++;
+        merged_values[pos] = values[k];
+        if (compact_indices)
+            ((uint32_t *)merged_indices)[pos] = (uint32_t)rows[k];
+        else
+            ((uint64_t *)merged_indices)[pos] = rows[k];
     }
 
-    initial_star_index = star_index;
+    free(a->values);
+    a->values = merged_values;
+    merged_values = NULL;
+    if (compact_indices)
+    {
+        free(a->indices32);
+        a->indices32 = merged_indices;
+    }
+    else
+    {
+        free(a->indices);
+        a->indices = merged_indices;
+    }
+    merged_indices = NULL;
+    a->total_non_zero_nr = total;
+    a->nr_ellpack_elts = longest_col;
+    a->sorted = false;
+    status = 0;
 
-    char cur_val_buf[BUFFER_SIZE] = {0};
-    size_t old_val_buf_size = 0;
-    size_t end = 0;
-    uint64_t total_elements = 0;
-    uint64_t exp_total_elts = a->nr_cols * a->nr_ellpack_elts;
+cleanup:
+    free(merged_values);
+    free(merged_indices);
+    free(values);
+    free(rows);
+    free(cols);
+    free(fill);
+    return status;
+}
 
-    uint8_t end_of_line = 0;
-    a->total_non_zero_nr = 0;
-    size_t non_zero_elt_in_col = 0;
-    size_t elt_in_col = 0;
-    uint64_t col_index = 0;
+/** Upper bound for the threads that parse one matrix */
+#define MAX_PARSE_THREADS 64
+#ifndef PARSE_THREAD_BYTES
+/** Smallest part of the values line that is worth its own parser thread */
+#define PARSE_THREAD_BYTES (4 << 20)
+#endif
 
-    while (!end_of_line)
-    {
-        // get new values
-        if (!fgets(cur_val_buf + old_val_buf_size, BUFFER_SIZE - old_val_buf_size, aptr))
-        {
-            if (!strlen(cur_val_buf))
-                break;
-        }
+/** Byte range of a line with the number of commas and stars in it */
+typedef struct
+{
+    const char *begin;
+    const char *end;
+    uint64_t commas;
+    uint64_t stars;
+} line_range;
 
-        // define where to stop in the current buffer
-        char *breakpoint = strchr(cur_val_buf, '\n');
-        if (breakpoint)
-        { // if the line ends somewhere in this buffer -> stop then after reading the values
-            end = breakpoint - cur_val_buf;
-            *breakpoint = '\0';
-            end_of_line = 1;
-        }
+/** Parsing task of one thread: the columns [col_begin, col_end), stored at [nnz_begin, nnz_end) */
+typedef struct
+{
+    ELLPACKMatrix *matrix;
+    const char *filename;
+    const char *values_pos;
+    const char *values_end;
+    const char *indices_pos;
+    const char *indices_end;
+    uint64_t col_begin;
+    uint64_t col_end;
+    uint64_t nnz_begin;
+    uint64_t nnz_end;
+    uint64_t nr_of_non_zeros; // parsed by the task
+    bool failed;
+    bool sorted;
+    uint64_t unsorted_last; // first descending pair of indices, if sorted is false
+    uint64_t unsorted_index;
+    char message[256]; // error message, if failed is true
+} column_parse_task;
+
+/**
+ * Runs `worker` on every task, tasks 1.. on their own threads and task 0 on the calling thread.
+ * A task whose thread can not be started runs on the calling thread as well.
+ */
+static void run_parse_threads(void *(*worker)(void *), void *tasks, size_t task_size, uint64_t nr_tasks)
+{
+    pthread_t threads[2 * MAX_PARSE_THREADS];
+    bool started[2 * MAX_PARSE_THREADS] = {false};
+    for (uint64_t t = 1; t < nr_tasks; t++)
+    {
+        started[t] = pthread_create(&threads[t], NULL, worker, (char *)tasks + t * task_size) == 0;
+    }
+    worker(tasks);
+    for (uint64_t t = 1; t < nr_tasks; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
         else
+            worker((char *)tasks + t * task_size);
+    }
+}
+
+static void *line_count_worker(void *arg)
+{
+    line_range *range = arg;
+    count_delimiters(range->begin, range->end, &range->commas, &range->stars);
+    return NULL;
+}
+
+/** Stores the error message of a parsing task */
+static void *column_parse_error(column_parse_task *task, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(task->message, sizeof(task->message), format, args);
+    va_end(args);
+    task->failed = true;
+    return NULL;
+}
+
+/**
+ * Parses the columns of one task, both cursors walk their line in lockstep. Slot numbers in the
+ * messages are global, so they do not depend on the number of threads.
+ */
+static void *column_parse_worker(void *arg)
+{
+    column_parse_task *task = arg;
+    ELLPACKMatrix *a = task->matrix;
+    const char *filename = task->filename;
+    const char *values_pos = task->values_pos;
+    const char *values_end = task->values_end;
+    const char *indices_pos = task->indices_pos;
+    const char *indices_end = task->indices_end;
+    bool compact_indices = a->indices32 != NULL;
+    uint64_t max_nr_of_values = a->nr_ellpack_elts * a->nr_cols;
+    uint64_t non_zeros = task->nnz_begin;
+    uint64_t slot = task->col_begin * a->nr_ellpack_elts;
+    for (uint64_t col = task->col_begin; col < task->col_end; col++)
+    {
+        uint64_t col_start = non_zeros;
+        uint64_t last_index = 0;
+        for (uint64_t elt = 0; elt < a->nr_ellpack_elts; elt++, slot++)
         {
-            breakpoint = strrchr(cur_val_buf, ',');
-            if (breakpoint)
-            { // if no newline is in the current buffer, set the end to the last ,
-                end = breakpoint - cur_val_buf;
+            values_pos = skip_blanks(values_pos, values_end);
+            indices_pos = skip_blanks(indices_pos, indices_end);
+            if (expect_0(values_pos == values_end))
+                return column_parse_error(task, " `%s` had %" PRIu64 " instead of %" PRIu64 " values \n", filename, slot, max_nr_of_values);
+            if (expect_0(indices_pos == indices_end))
+                return column_parse_error(task, " `%s` had %" PRIu64 " instead of %" PRIu64 " indices \n", filename, slot, max_nr_of_values);
+            bool value_star = *values_pos == '*';
+            bool index_star = *indices_pos == '*';
+            if (expect_0(value_star != index_star))
+                return column_parse_error(task, value_star ? "found an index value, but value was a star!\n" : "found a index star, but no corresponding value star!\n");
+            if (value_star)
+            { // Zero_elt, runs of "*," (the padding) are skipped in both lines a vector at a time
+                uint64_t run = count_star_run(values_pos, values_end, a->nr_ellpack_elts - elt);
+                run = run > 0 ? count_star_run(indices_pos, indices_end, run) : 0;
+                if (run > 0)
+                {
+                    values_pos += 2 * run;
+                    indices_pos += 2 * run;
+                    elt += run - 1;
+                    slot += run - 1;
+                    continue;
+                }
+                values_pos++;
+                indices_pos++;
             }
             else
             {
-                end = strlen(cur_val_buf);
-            }
-        }
-        char *values_left = cur_val_buf;
-
-        // parse floats & count values
-        while (values_left < breakpoint && total_elements < max_nr_of_values)
-        {
-            char *values = strtok_r(values_left, ",", &values_left); // get everything upto the first ','
-            if (values)                                              // !=NULL
-            {
-                if (!strcmp(values, "*") || !strcmp(values, " *") || !strcmp(values, " * ") || !strcmp(values, "* "))
-                { // Zero_elt
-                    star_index[total_elements] = 1;
-                    elt_in_col++;
-                    total_elements++;
-                }
-                else
+                float value;
+                uint64_t index;
+                if (expect_0(!parse_float(&values_pos, values_end, &value)))
                 {
-                    char *endptr = NULL; // just to check if float could be matched
-                    errno = 0;
-                    float value = strtof(values, &endptr);
-                    if (expect_0(values == endptr || errno != 0))
-                    { // nothing could be matched
-                        if (errno == ERANGE)
-                            fprintf(stderr, "(a value in %s cannot be represented as a float): ", filename);
-                        fprintf(stderr, "error when trying to convert float from string in %s!\n", filename);
-                        goto clean_error;
-                    }
-                    else // will also be writing 0.0 values since otherwise the indices would not match
-                    {    // found valid value
-                        if (expect_0(isnan(value) || isinf(value)))
-                            printf("warning: found %f in %s\n", value, filename);
-                        a->values[a->total_non_zero_nr] = value;
-                        a->total_non_zero_nr++;
-                        non_zero_elt_in_col++;
-                    }
-                    elt_in_col++;
-                    total_elements++;
+                    if (errno == ERANGE)
+                        return column_parse_error(task, "(a value in %s cannot be represented as a float): error when trying to convert float from string in %s (value %" PRIu64 ")!\n", filename, filename, slot);
+                    return column_parse_error(task, "error when trying to convert float from string in %s (value %" PRIu64 ")!\n", filename, slot);
                 }
-                if (elt_in_col == a->nr_ellpack_elts)
+                if (expect_0(*indices_pos == '-'))
+                    return column_parse_error(task, "negative indices are not valid!\n");
+                if (expect_0(!parse_index(&indices_pos, indices_end, &index)))
+                    return column_parse_error(task, "error when trying to convert uint64_t from string in %s (index %" PRIu64 ")!\n", filename, slot);
+                if (expect_0(index >= a->nr_rows))
+                    return column_parse_error(task, "invalid index found in  %s (i > number of cols )!\n", filename);
+                if (expect_0(non_zeros > col_start && index <= last_index))
                 {
-                    // next col
-                    if (col_index < a->nr_cols)
+                    if (index == last_index)
+                        return column_parse_error(task, "index appeard twice in a col!\n");
+                    if (task->sorted)
                     {
-                        a->nr_of_non_zeros_per_col[col_index] = non_zero_elt_in_col;
-                        elt_in_col = 0;
-                        non_zero_elt_in_col = 0;
-                        col_index++;
+                        task->sorted = false;
+                        task->unsorted_last = last_index;
+                        task->unsorted_index = index;
                     }
+                }
+                if (expect_0(isnan(value) || isinf(value)))
+                    printf("warning: found %f in %s\n", value, filename);
+                // will also be writing 0.0 values since otherwise the indices would not match
+                if (non_zeros < task->nnz_end) // a '*' inside a token shrinks the slice, the token is reported when it is reached
+                {
+                    a->values[non_zeros] = value;
+                    if (compact_indices)
+                        a->indices32[non_zeros] = (uint32_t)index;
                     else
-                    {
-                        fprintf(stderr, "error: too many values!\n");
-                        goto clean_error;
-                    }
+                        a->indices[non_zeros] = index;
                 }
+                non_zeros++;
+                last_index = index;
             }
-            else
-            {
-                break; // current buffer is done
-            }
-        }
-
-        /* shift everthing which was behind the last comma to the beginning -> makes sure that only complete values are parsed
-        if half value was parsed -> will be completed with next buffer filling */
-        if (!end_of_line)
-        {
-            // get the size of bytes that were behind the last comma in the bufffer
-            old_val_buf_size = strlen(cur_val_buf + end + 1);
-            // move stuff from behind the last comma to the beginning of the buffer
-            memmove(cur_val_buf, cur_val_buf + end + 1, old_val_buf_size);
-            // make sure that next buffer filling starts behind half parsed values
-            cur_val_buf[old_val_buf_size] = '\0';
+            bool last = slot + 1 == max_nr_of_values;
+            if (expect_0(!skip_delimiter(&values_pos, values_end, last)))
+                return column_parse_error(task, last ? "`%s` had more than %" PRIu64 " values or an invalid value\n" : "invalid value in `%s` (value %" PRIu64 ")\n", filename, last ? max_nr_of_values : slot);
+            if (expect_0(!skip_delimiter(&indices_pos, indices_end, last)))
+                return column_parse_error(task, last ? "`%s` had more than %" PRIu64 " indices or an invalid index\n" : "invalid index in `%s` (index %" PRIu64 ")\n", filename, last ? max_nr_of_values : slot);
         }
+        a->nr_of_non_zeros_per_col[col] = non_zeros - col_start;
     }
-    if (expect_0(total_elements != exp_total_elts))
-    {
-        fprintf(stderr, " `%s` had %" PRIu64 " instead of %" PRIu64 " values \n", filename, total_elements, exp_total_elts);
-        goto clean_error;
-    }
-    /*get 3.LINE*/
-    if (!(a->indices = calloc(max_nr_of_values, sizeof(uint64_t))))
+    task->nr_of_non_zeros = non_zeros - task->nnz_begin;
+    task->values_pos = values_pos;
+    task->indices_pos = indices_pos;
+    return NULL;
+}
+
+/**
+ * Position of slot `slot` (behind its `slot`-th comma) in a line that was counted in `nr_ranges` ranges.
+ * @param stars Set to the number of stars in front of the slot.
+ */
+static const char *find_slot(const line_range *ranges, uint64_t nr_ranges, const char *line_end, uint64_t slot, uint64_t *stars)
+{
+    *stars = 0;
+    if (slot == 0)
+        return ranges[0].begin;
+    // the range that contains the comma in front of the slot
+    uint64_t commas = 0;
+    uint64_t r = 0;
+    while (r + 1 < nr_ranges && commas + ranges[r].commas < slot)
     {
-        fprintf(stderr, "allocating memory for the indices array of a failed\n");
-        goto clean_error;
+        commas += ranges[r].commas;
+        *stars += ranges[r].stars;
+        r++;
     }
+    const char *pos = skip_tokens(ranges[r].begin, line_end, slot - commas, stars);
+    return pos != NULL ? pos : line_end;
+}
 
-    uint8_t end_of_line_3 = 0;
-    char cur_ind_buf[BUFFER_SIZE] = {0};
-    size_t old_ind_buf_size = 0;
-    uint64_t total_indices = 0;
-    elt_in_col = 0;
-    size_t non_star_index = 0;
-    while (!end_of_line_3)
+/**
+ * Parses line 2 (values) and line 3 (indices) into `a`, with up to one thread per core on large files.
+ * The lines are split into byte ranges and their commas and stars are counted in parallel, which gives
+ * the exact number of non-zeros (so the arrays are allocated once with the final size). Every thread then
+ * gets the columns whose first slot lies in its range; the stars in front of that slot tell where its
+ * columns start in `values` and `indices`. Errors are reported for the first failing range, with the
+ * slot number in the whole file. A single thread skips the counting pass and shrinks the arrays afterwards.
+ * @returns 1 if an error occured, else 0
+ */
+static int parse_ellpack_lines(ELLPACKMatrix *a, const char *filename, const char *values_begin, const char *values_end,
+                               const char *indices_begin, const char *indices_end)
+{
+    uint64_t max_nr_of_values = a->nr_ellpack_elts * a->nr_cols;
+    line_range ranges[2 * MAX_PARSE_THREADS]; // nr_tasks ranges of the values line, then of the indices line
+    column_parse_task tasks[MAX_PARSE_THREADS];
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t nr_tasks = online_cpus > 0 ? (uint64_t)online_cpus : 1;
+    uint64_t thread_bytes = (uint64_t)(values_end - values_begin) / PARSE_THREAD_BYTES;
+    if (nr_tasks > thread_bytes) nr_tasks = thread_bytes;
+    if (nr_tasks > MAX_PARSE_THREADS) nr_tasks = MAX_PARSE_THREADS;
+    if (nr_tasks > a->nr_cols) nr_tasks = a->nr_cols;
+    if (nr_tasks == 0 || max_nr_of_values == 0) nr_tasks = 1;
+    // one thread: upper bound, the arrays are shrunk after parsing (the parser reports wrong counts itself)
+    uint64_t nr_of_non_zeros = max_nr_of_values;
+    if (nr_tasks > 1)
     {
-        // get new values
-        if (!fgets(cur_ind_buf + old_ind_buf_size, BUFFER_SIZE - old_ind_buf_size, aptr))
+        // equal byte ranges of both lines, their commas give the token boundaries
+        const char *begins[2] = {values_begin, indices_begin};
+        const char *ends[2] = {values_end, indices_end};
+        for (int line = 0; line < 2; line++)
         {
-            if (!strlen(cur_ind_buf))
+            uint64_t length = (uint64_t)(ends[line] - begins[line]);
+            for (uint64_t t = 0; t < nr_tasks; t++)
             {
-                break;
+                ranges[line * nr_tasks + t] = (line_range){.begin = begins[line] + length * t / nr_tasks,
+                                                           .end = begins[line] + length * (t + 1) / nr_tasks};
             }
         }
-        if (expect_0(strchr(cur_ind_buf, '-') != NULL))
-        {
-            fprintf(stderr, "negative indices are not valid!\n");
-            goto clean_error;
-        }
-
-        // where to stop parsing in the current buffer
-        char *breakpoint = strchr(cur_ind_buf, '\n');
-        if (breakpoint)
-        { // if the line ends somewhere in this buffer -> stop then
-            end = breakpoint - cur_ind_buf;
-            *breakpoint = '\0';
-            end_of_line_3 = 1;
-        }
+        run_parse_threads(line_count_worker, ranges, sizeof(line_range), 2 * nr_tasks);
 
-        else if (strlen(cur_ind_buf) < BUFFER_SIZE - 1) // if filled cur_ind_buf = max 1023
+        uint64_t commas[2] = {0, 0};
+        uint64_t value_stars = 0;
+        for (uint64_t t = 0; t < nr_tasks; t++)
         {
-            end_of_line_3 = 1;
-            end = strlen(cur_ind_buf);
-            breakpoint = strchr(cur_ind_buf, '\0');
+            commas[0] += ranges[t].commas;
+            commas[1] += ranges[nr_tasks + t].commas;
+            value_stars += ranges[t].stars;
         }
-        else
+        for (int line = 0; line < 2; line++)
         {
-            breakpoint = strrchr(cur_ind_buf, ',');
-            if (breakpoint)
-            { // if no newline is in the current buffer, set the end to the last ','
-                end = breakpoint - cur_ind_buf;
+            uint64_t tokens = skip_blanks(begins[line], ends[line]) != ends[line] ? commas[line] + 1 : 0;
+            if (tokens < max_nr_of_values)
+            {
+                fprintf(stderr, " `%s` had %" PRIu64 " instead of %" PRIu64 " %s \n", filename, tokens, max_nr_of_values, line == 0 ? "values" : "indices");
+                return 1;
             }
-            else
+            if (tokens > max_nr_of_values)
             {
-                end = strlen(cur_ind_buf);
+                fprintf(stderr, "`%s` had more than %" PRIu64 " %s\n", filename, max_nr_of_values, line == 0 ? "values or an invalid value" : "indices or an invalid index");
+                return 1;
             }
         }
+        nr_of_non_zeros = value_stars < max_nr_of_values ? max_nr_of_values - value_stars : 0;
+    }
 
-        char *indices_left = cur_ind_buf;
-        uint64_t last_indice = 0;
+    // row indices that fit into 32 bits are stored compactly (less memory bandwidth in the kernels)
+    bool compact_indices = a->nr_rows <= UINT32_MAX;
+    size_t allocated = nr_of_non_zeros > 0 ? nr_of_non_zeros : 1;
+    a->values = huge_page_alloc(allocated * sizeof(float));
+    a->nr_of_non_zeros_per_col = malloc((a->nr_cols > 0 ? a->nr_cols : 1) * sizeof(uint64_t));
+    if (compact_indices ? !(a->indices32 = huge_page_alloc(allocated * sizeof(uint32_t)))
+                        : !(a->indices = huge_page_alloc(allocated * sizeof(uint64_t))))
+    {
+        fprintf(stderr, "allocating memory for the indices array of `%s` failed\n", filename);
+        return 1;
+    }
+    if (a->values == NULL || a->nr_of_non_zeros_per_col == NULL)
+    {
+        fprintf(stderr, "allocating memory for the values of `%s` failed\n", filename);
+        return 1;
+    }
 
-        // parse indices
-        while (indices_left < breakpoint && total_indices < max_nr_of_values)
+    // thread t starts at the first column that begins inside its byte range of the values line
+    uint64_t slots_before = 0;
+    for (uint64_t t = 0; t < nr_tasks; t++)
+    {
+        tasks[t] = (column_parse_task){.matrix = a, .filename = filename, .values_pos = values_begin, .values_end = values_end,
+                                       .indices_pos = indices_begin, .indices_end = indices_end, .col_begin = 0,
+                                       .col_end = a->nr_cols, .nnz_begin = 0, .nnz_end = nr_of_non_zeros, .failed = false, .sorted = true};
+        if (t == 0)
+            continue;
+        slots_before += ranges[t - 1].commas;
+        uint64_t col = (slots_before + a->nr_ellpack_elts - 1) / a->nr_ellpack_elts;
+        col = col < a->nr_cols ? col : a->nr_cols;
+        tasks[t].col_begin = col;
+        if (col == a->nr_cols)
         {
-            char *indices = strtok_r(indices_left, ",", &indices_left);
-            // everything upto the first , -> should be first value
-            if (indices)
-            {
-                if (!strcmp(indices, "*") || !strcmp(indices, " *") || !strcmp(indices, " * ") || !strcmp(indices, "* "))
-                {                                                 // Zero_elt
-                    if (expect_0(star_index[total_indices] != 1)) // check if stars are on the same indices as for values
-                    {
-                        fprintf(stderr, "found a index star, but no corresponding value star!\n");
-                        goto clean_error;
-                    }
-                    last_indice++;
-                }
-                else
-                {
-                    char *endptr = NULL; // just to check if float could be matched
-                    uint64_t indice = strtoull(indices, &endptr, 10);
-                    if (expect_0(indices == endptr))
-                    { // nothing could be matched
-                        fprintf(stderr, "error when trying to convert uint64_t from string!\n");
-                        goto clean_error;
-                    }
-                    else if (expect_0(indice >= a->nr_rows))
-                    {
-                        fprintf(stderr, "invalid index found in  %s (i > number of cols )!\n", filename);
-                        goto clean_error;
-                    }
-                    else if (expect_0(indice == last_indice && elt_in_col != 0))
-                    {
-                        fprintf(stderr, "index appeard twice in a col!\n");
-                        goto clean_error;
-                    }
-                    else if (expect_0(star_index[total_indices] == 1))
-                    {
-                        fprintf(stderr, "found an index value, but value was a star!\n");
-                        goto clean_error;
-                    }
-                    else
-                    { // found good indice
-                        if (indice < last_indice)
-                        {
-                            fprintf(stderr, "indices are not sorted: %" PRIu64 ", %" PRIu64 "!\n", last_indice, indice);
-                            a->sorted = false;
-                        }
-                        a->indices[non_star_index] = indice;
-                        non_star_index++;
-                        last_indice = indice;
-                    }
-                }
-                total_indices++;
-                elt_in_col++;
-                if (elt_in_col == a->nr_ellpack_elts)
-                {
-                    elt_in_col = 0;
-                    last_indice = 0;
-                }
-            }
-            else
-            {
-                break; // current buffer is done
-            }
+            tasks[t].values_pos = values_end;
+            tasks[t].indices_pos = indices_end;
+            tasks[t].nnz_begin = nr_of_non_zeros;
+        }
+        else
+        {
+            uint64_t slot = col * a->nr_ellpack_elts;
+            uint64_t stars = 0;
+            tasks[t].values_pos = find_slot(ranges, nr_tasks, values_end, slot, &stars);
+            // only a stray '*' can push the start out of order, the slices stay disjoint anyway
+            uint64_t nnz_begin = stars < slot ? slot - stars : 0;
+            nnz_begin = nnz_begin > tasks[t - 1].nnz_begin ? nnz_begin : tasks[t - 1].nnz_begin;
+            tasks[t].nnz_begin = nnz_begin < nr_of_non_zeros ? nnz_begin : nr_of_non_zeros;
+            tasks[t].indices_pos = find_slot(ranges + nr_tasks, nr_tasks, indices_end, slot, &stars);
+        }
+        tasks[t - 1].col_end = col;
+        tasks[t - 1].nnz_end = tasks[t].nnz_begin;
+    }
+    run_parse_threads(column_parse_worker, tasks, sizeof(column_parse_task), nr_tasks);
+    nr_of_non_zeros = 0;
+    for (uint64_t t = 0; t < nr_tasks; t++)
+    {
+        if (tasks[t].failed)
+        {
+            fputs(tasks[t].message, stderr);
+            return 1;
+        }
+        // every '*' inside a token is a parse error, so the counted slices always match
+        if (expect_0(nr_tasks > 1 && tasks[t].nnz_begin + tasks[t].nr_of_non_zeros != tasks[t].nnz_end))
+        {
+            fprintf(stderr, "`%s` contains a '*' inside a value\n", filename);
+            return 1;
         }
-        /* shift everthing which was behind the last comma to the beginning -> makes sure that only complete indices are parsed
-       if half indice was parsed -> will be completed with next buffer filling */
-        if (!end_of_line_3)
+        nr_of_non_zeros += tasks[t].nr_of_non_zeros;
+    }
+    for (uint64_t t = 0; t < nr_tasks && a->sorted; t++)
+    {
+        if (!tasks[t].sorted)
         {
-            // get the size of what was behind the last comma in the bufffer
-            old_ind_buf_size = strlen(cur_ind_buf + end + 1);
-            // move value from behind the last comma to the beginning of the next buffer
-            memmove(cur_ind_buf, cur_ind_buf + end + 1, old_ind_buf_size);
-            // make sure that filling next buffer starts behind half parsed indices
-            cur_ind_buf[old_ind_buf_size] = '\0';
+            fprintf(stderr, "indices of `%s` are not sorted (%" PRIu64 ", %" PRIu64 "), the columns will be sorted after loading\n", filename, tasks[t].unsorted_last, tasks[t].unsorted_index);
+            a->sorted = false;
         }
     }
+    const column_parse_task *last_task = &tasks[nr_tasks - 1];
+    if (expect_0(max_nr_of_values == 0 && (skip_blanks(last_task->values_pos, values_end) != values_end || skip_blanks(last_task->indices_pos, indices_end) != indices_end)))
+    {
+        fprintf(stderr, "`%s` has no elements, but its lines are not empty\n", filename);
+        return 1;
+    }
+    a->total_non_zero_nr = nr_of_non_zeros;
 
-    if (0.9 * max_nr_of_values > a->total_non_zero_nr)
+    if (0.9 * allocated > a->total_non_zero_nr)
     { // >= 10% of allocated space is not used -> resize
-
+        size_t used = a->total_non_zero_nr > 0 ? a->total_non_zero_nr : 1;
         float *new_values = NULL;
-        if (expect_0(!(new_values = realloc(a->values, a->total_non_zero_nr * sizeof(float)))))
+        if (expect_0(!(new_values = huge_page_realloc(a->values, allocated * sizeof(float), used * sizeof(float)))))
         {
             fprintf(stderr, "reallocating memory for the values array of `%s` failed\n", filename);
-            goto clean_error;
+            return 1;
         }
         else
         {
             a->values = new_values;
         }
 
-        uint64_t *new_indices = NULL;
-        if (expect_0(!(new_indices = realloc(a->indices, a->total_non_zero_nr * sizeof(uint64_t)))))
+        size_t index_size = compact_indices ? sizeof(uint32_t) : sizeof(uint64_t);
+        void *old_indices = compact_indices ? (void *)a->indices32 : (void *)a->indices;
+        void *new_indices = NULL;
+        if (expect_0(!(new_indices = huge_page_realloc(old_indices, allocated * index_size, used * index_size))))
         {
             fprintf(stderr, "reallocating memory for the indices array of `%s` failed\n", filename);
-            ;
-            goto clean_error;
+            return 1;
+        }
+        else if (compact_indices)
+        {
+            a->indices32 = new_indices;
         }
         else
         {
             a->indices = new_indices;
         }
     }
-    goto clean_all;
+    return 0;
+}
 
-clean_error:
-    clean_file_data(initial_star_index, aptr);
-    clean_matrix_data(a);
-    return 1;
+/** Offset of a section behind `offset + bytes`, rounded up to ELLPACK_BINARY_ALIGNMENT */
+static uint64_t next_section_offset(uint64_t offset, uint64_t bytes)
+{
+    return (offset + bytes + ELLPACK_BINARY_ALIGNMENT - 1) / ELLPACK_BINARY_ALIGNMENT * ELLPACK_BINARY_ALIGNMENT;
+}
 
-clean_all:
-    clean_file_data(initial_star_index, aptr);
-    return 0;
+/** Checks that a section of a binary file is aligned and lies completely inside the file */
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size)
+{
+    return offset % ELLPACK_BINARY_ALIGNMENT == 0 && offset >= sizeof(ellpack_binary_header) && offset <= file_size &&
+           count <= (file_size - offset) / element_size;
 }
+
 /**
- * @param filename where the result will be printed into -> file is closed before return
- * @param matrix the matrix to be printed out
- * @param rows of result
- * @param cols of result
- * @param error_occurred_in_write -> to check if valid result or an error occured after the funciton is done
- * @return result has to be freed at the end of main -> free(result)
+ * Takes over the arrays of a binary file (see ellpack_binary_header). A mapped file is used in place and is owned
+ * by the matrix afterwards (`file` is emptied); a file that was read into a buffer (pipe) is copied.
+ * Only the column counts and the row indices are checked, unsorted columns are sorted like in the text reader.
+ * @returns 1 if an error occured, else 0
  */
-result_file *write_ellpack_matrix(const char *filename, result_mat *matrix, uint64_t rows, uint64_t cols, bool *error_occurred_in_write)
+static int read_ellpack_binary(ELLPACKMatrix *a, input_file *file, const char *filename)
 {
-    *error_occurred_in_write = false;
-    result_file *result = malloc(sizeof(result_file));
-    if (!result)
+    ellpack_binary_header header;
+    if (file->size < sizeof(header))
     {
-        fprintf(stderr, "could not allocate space for the result!\n");
-        *error_occurred_in_write = true;
-        goto clean_up;
+        fprintf(stderr, "`%s` is too short for a binary ELLPACK header!\n", filename);
+        return 1;
     }
-    result->filename = filename;
-    result->output = fopen(filename, "w");
-    if (!result->output || !matrix)
+    memcpy(&header, file->data, sizeof(header));
+    if (header.version != ELLPACK_BINARY_VERSION)
     {
-        fprintf(stderr, "invalid result filename or result matrix!\n");
-        *error_occurred_in_write = true;
-        goto clean_up;
+        fprintf(stderr, "`%s` has the unsupported binary version %" PRIu32 " (or the other byte order)!\n", filename, header.version);
+        return 1;
     }
-    unsigned int ellpack_col_len = get_longest_col(matrix);
-    unsigned int nr_of_cols = matrix->cols_len;
-    // first line
-    if (0 > fprintf(result->output, "%" PRIu64 ",%" PRIu64 ",%u\n", rows, cols, ellpack_col_len))
+    a->nr_rows = header.nr_rows;
+    a->nr_cols = header.nr_cols;
+    a->nr_ellpack_elts = header.nr_ellpack_elts;
+    a->total_non_zero_nr = header.nr_of_non_zeros;
+    a->sorted = header.sorted != 0;
+    bool compact_indices = a->nr_rows <= UINT32_MAX;
+    if (header.index_width != (compact_indices ? sizeof(uint32_t) : sizeof(uint64_t)))
     {
-        fprintf(stderr, "invaild result filename or result matrix!\n");
-        *error_occurred_in_write = true;
-        goto clean_up;
+        fprintf(stderr, "`%s` has %" PRIu32 " byte row indices, but %" PRIu64 " rows!\n", filename, header.index_width, a->nr_rows);
+        return 1;
     }
-    if (!nr_of_cols)
+    if (!section_fits(header.counts_offset, a->nr_cols, sizeof(uint64_t), file->size) ||
+        !section_fits(header.indices_offset, a->total_non_zero_nr, header.index_width, file->size) ||
+        !section_fits(header.values_offset, a->total_non_zero_nr, sizeof(float), file->size))
     {
-        fprintf(stderr, "matrix has no cols!\n"); // nothing more to do
-        *error_occurred_in_write = true;
-        goto clean_up;
+        fprintf(stderr, "the sections of `%s` are misaligned or do not fit into the file!\n", filename);
+        return 1;
+    }
+    const char *data = file->data;
+    if (file->mapped)
+    { // the kernels gather randomly from the arrays, so the whole file is read ahead
+        posix_madvise((void *)data, file->size, POSIX_MADV_WILLNEED);
+        a->nr_of_non_zeros_per_col = (uint64_t *)(data + header.counts_offset);
+        a->values = (float *)(data + header.values_offset);
+        if (compact_indices)
+            a->indices32 = (uint32_t *)(data + header.indices_offset);
+        else
+            a->indices = (uint64_t *)(data + header.indices_offset);
+        a->mapping = (void *)data;
+        a->mapping_size = file->size;
+        a->owns_arrays = false;
+        *file = (input_file){.data = NULL, .size = 0, .mapped = false};
     }
-    // second line + include the stars
-    // print each col
-    // last col extra -> no comma in the end
-    for (size_t col_nr = 0; col_nr < nr_of_cols - 1; col_nr++)
-    { // enough space for col, ',' and \n & \0 (16 chars per float max + comma)
-        char *col_buffer = malloc(ellpack_col_len * 18 + 2);
-        if (!col_buffer)
+    else
+    {
+        size_t index_bytes = a->total_non_zero_nr * header.index_width;
+        a->nr_of_non_zeros_per_col = malloc((a->nr_cols > 0 ? a->nr_cols : 1) * sizeof(uint64_t));
+        a->values = huge_page_alloc((a->total_non_zero_nr > 0 ? a->total_non_zero_nr : 1) * sizeof(float));
+        void *indices = huge_page_alloc(index_bytes > 0 ? index_bytes : 1);
+        if (compact_indices)
+            a->indices32 = indices;
+        else
+            a->indices = indices;
+        if (a->nr_of_non_zeros_per_col == NULL || a->values == NULL || indices == NULL)
         {
-            fprintf(stderr, "allocating memory for a Buffer to print the result values to file failed!\n");
-            *error_occurred_in_write = true;
-            goto clean_up;
+            fprintf(stderr, "allocating memory for the arrays of `%s` failed\n", filename);
+            return 1;
         }
-        result_col *cur_col = &matrix->cols[col_nr];
-        char *buf_ptr = col_buffer;
-        unsigned int height = cur_col->used_height;
-        // go through col
-        for (size_t row_in_col = 0; row_in_col < height; row_in_col++)
-        { // are all values != 0?
-            buf_ptr += sprintf(buf_ptr, "%e,", cur_col->values[row_in_col]);
+        memcpy(a->nr_of_non_zeros_per_col, data + header.counts_offset, a->nr_cols * sizeof(uint64_t));
+        memcpy(a->values, data + header.values_offset, a->total_non_zero_nr * sizeof(float));
+        memcpy(indices, data + header.indices_offset, index_bytes);
+    }
+
+    // a wrong count or row index would make the kernels read or write out of bounds
+    uint64_t non_zeros = 0;
+    for (uint64_t col = 0; col < a->nr_cols; col++)
+    {
+        uint64_t count = a->nr_of_non_zeros_per_col[col];
+        if (count > a->nr_ellpack_elts || count > a->total_non_zero_nr - non_zeros)
+        {
+            fprintf(stderr, "column %" PRIu64 " of `%s` has an invalid number of elements!\n", col, filename);
+            return 1;
         }
-        size_t nr_stars = ellpack_col_len - height;
-        // include stars
-        while (nr_stars > 0)
+        for (uint64_t k = non_zeros; k < non_zeros + count; k++)
         {
-            buf_ptr += sprintf(buf_ptr, "*,");
-            nr_stars--;
+            uint64_t index = compact_indices ? a->indices32[k] : a->indices[k];
+            if (expect_0(index >= a->nr_rows))
+            {
+                fprintf(stderr, "invalid index found in  %s (i > number of cols )!\n", filename);
+                return 1;
+            }
+            if (expect_0(a->sorted && k > non_zeros && index <= (compact_indices ? a->indices32[k - 1] : a->indices[k - 1])))
+            {
+                fprintf(stderr, "`%s` is marked as sorted, but column %" PRIu64 " is not!\n", filename, col);
+                return 1;
+            }
         }
-        int buf_size = buf_ptr - col_buffer;
-        if (buf_size > 0)
-            fprintf(result->output, "%*s", buf_size, col_buffer);
-
-        free(col_buffer);
+        non_zeros += count;
     }
-    // print last col without comma in the end
-    char *col_buffer = calloc(ellpack_col_len * 18 + 2, sizeof(char));
-    if (!col_buffer)
+    if (non_zeros != a->total_non_zero_nr)
     {
-        fprintf(stderr, "allocating memory for a Buffer to print the result values to file failed!\n");
-        *error_occurred_in_write = true;
-        goto clean_up;
+        fprintf(stderr, " `%s` had %" PRIu64 " instead of %" PRIu64 " values \n", filename, non_zeros, a->total_non_zero_nr);
+        return 1;
     }
-    result_col *cur_col = &matrix->cols[nr_of_cols - 1];
-    char *buf_ptr = col_buffer;
-    unsigned int height = cur_col->used_height;
-    if (height)
-    {
-        // go through col
-        for (size_t row_in_col = 0; row_in_col < height - 1; row_in_col++)
-        { // are all values != 0?
-            // sprintf: nr of chars printed, without counting nullbyte is returned, but adds a nullbyte -> overwritten
-            buf_ptr += sprintf(buf_ptr, "%e,", cur_col->values[row_in_col]);
+    if (!a->sorted)
+    { // sorting writes into the arrays, a private mapping only copies the touched pages
+        if (a->mapping != NULL && mprotect(a->mapping, a->mapping_size, PROT_READ | PROT_WRITE) != 0)
+        {
+            fprintf(stderr, "could not make the mapping of `%s` writable\n", filename);
+            return 1;
+        }
+        if (sort_ellpack_columns(a))
+        {
+            fprintf(stderr, "an index appeared twice in a column of `%s`!\n", filename);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * returns 1 if error occured, else 0
+ * @param a Matrix to read into. Every pointer in this should be NULL
+ * @param filename file in which we get the matrix
+ * The file is mapped and both lines are parsed in place (see parse_ellpack_lines): one cursor walks the values line,
+ * one the indices line, so a '*' in one line is checked against the other line directly.
+ * a->values, a->indices(32) and a->nr_of_non_zeros_per_col are freed if something failed with clean_matrix_data;
+ * else clean_matrix_data needs to be called after the matmul (in main)
+ */
+int read_ellpack_matrix(ELLPACKMatrix *a, const char *filename)
+{
+    input_file file = {.data = NULL, .size = 0, .mapped = false};
+    *a = get_empty_ellpackmatrix(); // nullify the struct to prevent undefined behaviour in clean_error -> clean_matrix_data
+    // for now, we assume that the indices are sorted
+    a->sorted = true;
+
+    if (open_input_file(&file, filename))
+    {
+        goto clean_error;
+    }
+    const char *end = file.data + file.size;
+    if (file.size >= strlen(ELLPACK_BINARY_MAGIC) && memcmp(file.data, ELLPACK_BINARY_MAGIC, strlen(ELLPACK_BINARY_MAGIC)) == 0)
+    {
+        if (read_ellpack_binary(a, &file, filename))
+        {
+            goto clean_error;
         }
-        buf_ptr += sprintf(buf_ptr, "%e", cur_col->values[height - 1]);
+        close_input_file(&file);
+        return 0;
+    }
+
+    //* 1. line: <#rows>,<#cols>,<#Ellpackrows>
+    const char *header_end = file.size > 0 ? memchr(file.data, '\n', file.size < 98 ? file.size : 98) : NULL;
+    if (header_end == NULL)
+    {
+        fprintf(stderr, "reading the first line of %s failed\n", filename);
+        goto clean_error;
+    }
+    char first_line[100];
+    memcpy(first_line, file.data, (size_t)(header_end - file.data));
+    first_line[header_end - file.data] = '\0';
+    if (strchr(first_line, '-') != NULL) // if minus in first line -> get rid of neg dimensions
+    {
+        fprintf(stderr, "%s contained negative dimension in the first line!\n", filename);
+        goto clean_error;
+    }
+    // a fourth field marks a HYB file: the ELLPACK part is followed by <#overflow> COO entries
+    uint64_t nr_overflow = 0;
+    if (sscanf(first_line, "%" SCNu64 ",%" SCNu64 ",%" SCNu64 ",%" SCNu64, &a->nr_rows, &a->nr_cols, &a->nr_ellpack_elts, &nr_overflow) < 3)
+    {
+        fprintf(stderr, "first line of matrix `%s` had the wrong format!\n", filename);
+        goto clean_error;
+    };
+    if (a->nr_ellpack_elts != 0 && a->nr_cols > SIZE_MAX / sizeof(uint64_t) / a->nr_ellpack_elts)
+    {
+        fprintf(stderr, "`%s` has too many elements!\n", filename);
+        goto clean_error;
+    }
+
+    //* 2. and 3. line: values and indices
+    const char *values_pos = header_end + 1;
+    const char *values_end = find_line_end(values_pos, end);
+    if (values_end == end && a->nr_ellpack_elts * a->nr_cols > 0)
+    {
+        fprintf(stderr, "`%s` has no line with indices!\n", filename);
+        goto clean_error;
+    }
+    const char *indices_pos = values_end < end ? values_end + 1 : end;
+    const char *indices_end = find_line_end(indices_pos, end);
+
+    if (parse_ellpack_lines(a, filename, values_pos, values_end, indices_pos, indices_end))
+    {
+        goto clean_error;
     }
-    size_t nr_stars = ellpack_col_len - height;
-    if (nr_stars > 0 && height > 0)
+
+    //* 4.-6. line (HYB only): overflow values, row indices and column indices
+    const char *overflow_pos = indices_end < end ? indices_end + 1 : end;
+    if (nr_overflow > 0 && read_hyb_overflow(a, &overflow_pos, end, filename, nr_overflow))
     {
-        buf_ptr += sprintf(buf_ptr, ",");
+        goto clean_error;
     }
-    // include stars
-    while (nr_stars > 0)
+
+    // normalize unsorted inputs, so that they can use the sorted implementations
+    if (!a->sorted && sort_ellpack_columns(a))
     {
-        buf_ptr += sprintf(buf_ptr, nr_stars == 1 ? "*" : "*,");
-        nr_stars--;
+        fprintf(stderr, "an index appeared twice in a column of `%s`!\n", filename);
+        goto clean_error;
     }
-    // values are done -> print them to the output file
-    buf_ptr += sprintf(buf_ptr, "\n");
-    int buf_size = buf_ptr - col_buffer;
-    if (buf_size > 0)
-        fprintf(result->output, "%*s", buf_size, col_buffer);
+    close_input_file(&file);
+    return 0;
+
+clean_error:
+    close_input_file(&file);
+    clean_matrix_data(a);
+    return 1;
+}
+
+/** Bytes of `,*` padding that are prepared once behind the text buffer of a text_output */
+#define PADDING_BLOCK_SIZE (64 << 10)
+/** Padding runs of at least this many bytes are handed to writev instead of being copied */
+#define PADDING_REFERENCE_SIZE 4096
+/** Parts of the buffer and padding runs that are collected for one writev */
+#define OUTPUT_SEGMENTS 64
+
+/**
+ * Text output of the result writers: tokens are formatted straight into one large buffer, which is written
+ * with one writev together with the long padding runs, those point into a prepared block of `,*`.
+ */
+typedef struct
+{
+    int fd;
+    char *buffer;   // STREAM_BUFFER_SIZE bytes of text, followed by PADDING_BLOCK_SIZE bytes of ",*,*..."
+    size_t used;    // bytes of text in buffer
+    size_t pending; // start of the text that is not in segments yet
+    struct iovec segments[OUTPUT_SEGMENTS];
+    int nr_segments;
+    bool failed;
+} text_output;
 
-    free(col_buffer);
+/** @returns 1 if the buffer could not be allocated, else 0 */
+static int open_text_output(text_output *out, int fd)
+{
+    memset(out, 0, sizeof(text_output));
+    out->fd = fd;
+    out->buffer = malloc(STREAM_BUFFER_SIZE + PADDING_BLOCK_SIZE);
+    if (out->buffer == NULL)
+        return 1;
+    char *padding = out->buffer + STREAM_BUFFER_SIZE;
+    for (size_t i = 0; i < PADDING_BLOCK_SIZE; i += 2)
+    {
+        padding[i] = ',';
+        padding[i + 1] = '*';
+    }
+    return 0;
+}
 
-    // third line
-    // same for indices
-    // for each col, last col extra -> no comma in the end
-    for (size_t col_nr = 0; col_nr < nr_of_cols - 1; col_nr++)
-    { // enough space for col, ',' and \n & \0 (20 chars per uint_64t max + comma)
-        char *col_buffer_ind = malloc(ellpack_col_len * 25 + 2);
-        if (!col_buffer_ind)
+/** Writes all segments and the pending text, the buffer is empty afterwards (also on failure). */
+static void flush_text_output(text_output *out)
+{
+    if (out->used > out->pending)
+        out->segments[out->nr_segments++] = (struct iovec){.iov_base = out->buffer + out->pending, .iov_len = out->used - out->pending};
+    struct iovec *segment = out->segments;
+    int remaining = out->nr_segments;
+    while (!out->failed && remaining > 0)
+    {
+        ssize_t written = writev(out->fd, segment, remaining);
+        if (written < 0)
         {
-            fprintf(stderr, "allocating memory for a Buffer to print the result indices to file failed!\n");
-            *error_occurred_in_write = true;
-            goto clean_up;
+            out->failed = errno != EINTR;
+            continue;
         }
-        result_col *cur_col_ind = &matrix->cols[col_nr];
-        char *buf_ptr_ind = col_buffer_ind;
-        unsigned int height_ind = cur_col_ind->used_height;
-
-        // go through col
-        for (size_t row_in_col = 0; row_in_col < height_ind; row_in_col++)
+        // partial writes: skip the completely written segments and the written part of the next one
+        for (; remaining > 0 && (size_t)written >= segment->iov_len; segment++, remaining--)
+            written -= (ssize_t)segment->iov_len;
+        if (remaining > 0)
         {
-            buf_ptr_ind += sprintf(buf_ptr_ind, "%" PRIu64 ",", cur_col_ind->indices[row_in_col]);
+            segment->iov_base = (char *)segment->iov_base + written;
+            segment->iov_len -= (size_t)written;
         }
-        size_t nr_stars_ind = ellpack_col_len - height_ind;
-        // include stars
-        while (nr_stars_ind > 0)
+    }
+    out->used = 0;
+    out->pending = 0;
+    out->nr_segments = 0;
+}
+
+/** Flushes and releases the buffer, the file descriptor stays open. @returns 1 if a write failed, else 0 */
+static int close_text_output(text_output *out)
+{
+    if (out->buffer != NULL)
+        flush_text_output(out);
+    free(out->buffer);
+    out->buffer = NULL;
+    return out->failed;
+}
+
+/**
+ * @returns where `bytes` bytes of text can be written; flushes if the buffer is too full or if there is no room
+ *          for two more segments (the text in front of a padding run and the run)
+ */
+static inline char *reserve_text_output(text_output *out, size_t bytes)
+{
+    if (expect_0(STREAM_BUFFER_SIZE - out->used < bytes || out->nr_segments >= OUTPUT_SEGMENTS - 1))
+        flush_text_output(out);
+    return out->buffer + out->used;
+}
+
+/** Appends `n` values, separated by commas; `*first`: no comma in front of the first one */
+static void write_value_tokens(text_output *out, const float *values, size_t n, bool *first)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        char *p = reserve_text_output(out, FORMAT_TOKEN_SIZE + 1);
+        *p = ',';
+        p += !*first;
+        out->used = (size_t)(p - out->buffer) + format_float(p, values[i]);
+        *first = false;
+    }
+}
+
+/** Appends `n` row indices, separated by commas; `*first`: no comma in front of the first one */
+static void write_index_tokens(text_output *out, const uint64_t *indices, size_t n, bool *first)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        char *p = reserve_text_output(out, FORMAT_TOKEN_SIZE + 1);
+        *p = ',';
+        p += !*first;
+        out->used = (size_t)(p - out->buffer) + format_index(p, indices[i]);
+        *first = false;
+    }
+}
+
+/** Appends `n` stars, separated by commas; `*first`: no comma in front of the first one */
+static void write_padding_tokens(text_output *out, uint64_t n, bool *first)
+{
+    if (n == 0)
+        return;
+    if (*first)
+    {
+        *reserve_text_output(out, 1) = '*';
+        out->used++;
+        n--;
+        *first = false;
+    }
+    const char *padding = out->buffer + STREAM_BUFFER_SIZE;
+    uint64_t bytes = 2 * n;
+    if (bytes >= PADDING_REFERENCE_SIZE)
+    {
+        // long runs (columns much shorter than the longest one) are not copied, writev reads them from the block
+        while (bytes > 0)
         {
-            buf_ptr_ind += sprintf(buf_ptr_ind, "*,");
-            nr_stars_ind--;
+            size_t length = bytes < PADDING_BLOCK_SIZE ? (size_t)bytes : PADDING_BLOCK_SIZE;
+            reserve_text_output(out, 0);
+            if (out->used > out->pending)
+                out->segments[out->nr_segments++] = (struct iovec){.iov_base = out->buffer + out->pending, .iov_len = out->used - out->pending};
+            out->segments[out->nr_segments++] = (struct iovec){.iov_base = (void *)padding, .iov_len = length};
+            out->pending = out->used;
+            bytes -= length;
         }
-        int buf_size_ind = buf_ptr_ind - col_buffer_ind;
-        if (buf_size_ind > 0)
-            fprintf(result->output, "%*s", buf_size_ind, col_buffer_ind);
+        return;
+    }
+    char *p = reserve_text_output(out, (size_t)bytes);
+    memcpy(p, padding, (size_t)bytes);
+    out->used += (size_t)bytes;
+}
 
-        free(col_buffer_ind);
+/**
+ * @param filename where the result will be printed into -> file is closed before return
+ * @param matrix the matrix to be printed out
+ * @param rows of result
+ * @param cols of result
+ * @param error_occurred_in_write -> to check if valid result or an error occured after the funciton is done
+ * @return result has to be freed at the end of main -> free(result)
+ */
+result_file *write_ellpack_matrix(const char *filename, result_mat *matrix, uint64_t rows, uint64_t cols, bool *error_occurred_in_write)
+{
+    *error_occurred_in_write = false;
+    text_output out = {.buffer = NULL};
+    result_file *result = malloc(sizeof(result_file));
+    if (!result)
+    {
+        fprintf(stderr, "could not allocate space for the result!\n");
+        *error_occurred_in_write = true;
+        goto clean_up;
     }
-    // print last indices without comma
-    char *col_buffer_ind = malloc(ellpack_col_len * 25 + 2);
-    if (!col_buffer_ind)
+    result->filename = filename;
+    result->output = fopen(filename, "w");
+    if (!result->output || !matrix)
     {
-        fprintf(stderr, "allocating memory for a Buffer to print the result indices to file failed!\n");
+        fprintf(stderr, "invalid result filename or result matrix!\n");
         *error_occurred_in_write = true;
         goto clean_up;
     }
-    result_col *cur_col_ind = &matrix->cols[nr_of_cols - 1];
-    char *buf_ptr_ind = col_buffer_ind;
-    unsigned int height_ind = cur_col_ind->used_height;
-    if (height_ind)
+    // the text is written with writev on the descriptor, the stdio buffer of result->output stays unused
+    if (open_text_output(&out, fileno(result->output)))
     {
-        // go through col
-        for (size_t row_in_col = 0; row_in_col < height_ind - 1; row_in_col++)
-        {
-            buf_ptr_ind += sprintf(buf_ptr_ind, "%" PRIu64 ",", cur_col_ind->indices[row_in_col]);
-        }
-        buf_ptr_ind += sprintf(buf_ptr_ind, "%" PRIu64, cur_col_ind->indices[height_ind - 1]);
+        fprintf(stderr, "allocating memory for a Buffer to print the result values to file failed!\n");
+        *error_occurred_in_write = true;
+        goto clean_up;
+    }
+    unsigned int ellpack_col_len = get_longest_col(matrix);
+    unsigned int nr_of_cols = matrix->cols_len;
+    // first line
+    out.used = (size_t)snprintf(out.buffer, STREAM_BUFFER_SIZE, "%" PRIu64 ",%" PRIu64 ",%u\n", rows, cols, ellpack_col_len);
+    if (!nr_of_cols)
+    {
+        fprintf(stderr, "matrix has no cols!\n"); // nothing more to do
+        *error_occurred_in_write = true;
+        goto clean_up;
     }
-    size_t nr_stars_ind = ellpack_col_len - height_ind;
-    // include stars
-    if (nr_stars_ind > 0 && height > 0)
+    // second line: the values of all cols, each padded with stars to the longest col, no comma in the end
+    bool first = true;
+    for (unsigned int col_nr = 0; col_nr < nr_of_cols; col_nr++)
     {
-        buf_ptr_ind += sprintf(buf_ptr_ind, ",");
+        const result_col *cur_col = &matrix->cols[col_nr];
+        write_value_tokens(&out, cur_col->values, cur_col->used_height, &first);
+        write_padding_tokens(&out, ellpack_col_len - cur_col->used_height, &first);
     }
-    while (nr_stars_ind > 0)
+    *reserve_text_output(&out, 1) = '\n';
+    out.used++;
+    // third line: same for the indices, without a newline in the end
+    first = true;
+    for (unsigned int col_nr = 0; col_nr < nr_of_cols; col_nr++)
     {
-        buf_ptr_ind += sprintf(buf_ptr_ind, nr_stars_ind == 1 ? "*" : "*,");
-        nr_stars_ind--;
+        const result_col *cur_col = &matrix->cols[col_nr];
+        write_index_tokens(&out, cur_col->indices, cur_col->used_height, &first);
+        write_padding_tokens(&out, ellpack_col_len - cur_col->used_height, &first);
     }
-    int buf_size_ind = buf_ptr_ind - col_buffer_ind;
-    if (buf_size_ind > 0)
-        fprintf(result->output, "%*s", buf_size_ind, col_buffer_ind);
-
-    free(col_buffer_ind);
 
 clean_up:
+    if (close_text_output(&out))
+    {
+        fprintf(stderr, "writing the result to `%s` failed!\n", filename);
+        *error_occurred_in_write = true;
+    }
     if (result != NULL && result->output != NULL)
     {
         fclose(result->output);
     }
     return result;
-}
\ No newline at end of file
+}
+
+/** Header of a binary file with the sections placed behind each other */
+static ellpack_binary_header get_binary_header(uint64_t rows, uint64_t cols, uint64_t nr_ellpack_elts, uint64_t non_zeros, bool sorted)
+{
+    ellpack_binary_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ELLPACK_BINARY_MAGIC, sizeof(header.magic));
+    header.version = ELLPACK_BINARY_VERSION;
+    header.index_width = rows <= UINT32_MAX ? sizeof(uint32_t) : sizeof(uint64_t);
+    header.nr_rows = rows;
+    header.nr_cols = cols;
+    header.nr_ellpack_elts = nr_ellpack_elts;
+    header.nr_of_non_zeros = non_zeros;
+    header.sorted = sorted;
+    header.counts_offset = next_section_offset(0, sizeof(header));
+    header.indices_offset = next_section_offset(header.counts_offset, cols * sizeof(uint64_t));
+    header.values_offset = next_section_offset(header.indices_offset, non_zeros * header.index_width);
+    return header;
+}
+
+/**
+ * Appends `bytes` bytes to a binary file, after zero padding from `*position` to `offset`.
+ * @returns 0 on success, 1 on IO error
+ */
+static int write_binary_data(FILE *output, uint64_t *position, uint64_t offset, const void *data, size_t bytes)
+{
+    static const char zeros[ELLPACK_BINARY_ALIGNMENT] = {0};
+    if (offset < *position || offset - *position > sizeof(zeros) ||
+        fwrite(zeros, 1, offset - *position, output) != offset - *position || (bytes > 0 && fwrite(data, 1, bytes, output) != bytes))
+        return 1;
+    *position = offset + bytes;
+    return 0;
+}
+
+int write_ellpack_binary(const char *filename, const ELLPACKMatrix *a)
+{
+    ellpack_binary_header header = get_binary_header(a->nr_rows, a->nr_cols, a->nr_ellpack_elts, a->total_non_zero_nr, a->sorted);
+    const void *indices = header.index_width == sizeof(uint32_t) ? (const void *)a->indices32 : (const void *)a->indices;
+    if (a->values == NULL || indices == NULL)
+    {
+        fprintf(stderr, "only matrices with fp32 values can be written to `%s`!\n", filename);
+        return 1;
+    }
+    FILE *output = fopen(filename, "wb");
+    if (!output)
+    {
+        fprintf(stderr, "could not open `%s` for writing!\n", filename);
+        return 1;
+    }
+    setvbuf(output, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    uint64_t position = 0;
+    int status = write_binary_data(output, &position, 0, &header, sizeof(header)) ||
+                 write_binary_data(output, &position, header.counts_offset, a->nr_of_non_zeros_per_col, a->nr_cols * sizeof(uint64_t)) ||
+                 write_binary_data(output, &position, header.indices_offset, indices, a->total_non_zero_nr * header.index_width) ||
+                 write_binary_data(output, &position, header.values_offset, a->values, a->total_non_zero_nr * sizeof(float));
+    if (fclose(output) != 0)
+        status = 1;
+    if (status)
+        fprintf(stderr, "writing `%s` failed!\n", filename);
+    return status;
+}
+
+/** Number of counts or row indices that are converted at once by write_result_binary (and read at once by write_spill_line) */
+#define BINARY_CHUNK 4096
+
+int write_result_binary(const char *filename, const result_mat *matrix, uint64_t rows)
+{
+    // the header comes first, so the non-zeros and the order of the columns are determined up front
+    uint64_t non_zeros = 0;
+    uint64_t longest_col = 0;
+    bool sorted = true;
+    for (unsigned int col = 0; col < matrix->cols_len; col++)
+    {
+        const result_col *cur_col = &matrix->cols[col];
+        non_zeros += cur_col->used_height;
+        longest_col = cur_col->used_height > longest_col ? cur_col->used_height : longest_col;
+        for (unsigned int h = 1; sorted && h < cur_col->used_height; h++)
+            sorted = cur_col->indices[h] > cur_col->indices[h - 1];
+    }
+    ellpack_binary_header header = get_binary_header(rows, matrix->cols_len, longest_col, non_zeros, sorted);
+    bool compact_indices = header.index_width == sizeof(uint32_t);
+
+    uint64_t *chunk = malloc(BINARY_CHUNK * sizeof(uint64_t));
+    FILE *output = fopen(filename, "wb");
+    if (!output || !chunk)
+    {
+        fprintf(stderr, "invalid result filename or result matrix!\n");
+        free(chunk);
+        if (output)
+            fclose(output);
+        return 1;
+    }
+    setvbuf(output, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    uint64_t position = 0;
+    int status = write_binary_data(output, &position, 0, &header, sizeof(header)) ||
+                 write_binary_data(output, &position, header.counts_offset, NULL, 0);
+    for (unsigned int col = 0; status == 0 && col < matrix->cols_len; col += BINARY_CHUNK)
+    {
+        unsigned int n = matrix->cols_len - col < BINARY_CHUNK ? matrix->cols_len - col : BINARY_CHUNK;
+        for (unsigned int i = 0; i < n; i++)
+            chunk[i] = matrix->cols[col + i].used_height;
+        status = write_binary_data(output, &position, position, chunk, n * sizeof(uint64_t));
+    }
+    // row indices are narrowed to 32 bits if the rows fit
+    status = status || write_binary_data(output, &position, header.indices_offset, NULL, 0);
+    for (unsigned int col = 0; status == 0 && col < matrix->cols_len; col++)
+    {
+        const result_col *cur_col = &matrix->cols[col];
+        for (unsigned int h = 0; status == 0 && h < cur_col->used_height; h += BINARY_CHUNK)
+        {
+            unsigned int n = cur_col->used_height - h < BINARY_CHUNK ? cur_col->used_height - h : BINARY_CHUNK;
+            const void *data = cur_col->indices + h;
+            if (compact_indices)
+            {
+                uint32_t *narrow = (uint32_t *)chunk;
+                for (unsigned int i = 0; i < n; i++)
+                    narrow[i] = (uint32_t)cur_col->indices[h + i];
+                data = narrow;
+            }
+            status = write_binary_data(output, &position, position, data, n * header.index_width);
+        }
+    }
+    status = status || write_binary_data(output, &position, header.values_offset, NULL, 0);
+    for (unsigned int col = 0; status == 0 && col < matrix->cols_len; col++)
+    {
+        const result_col *cur_col = &matrix->cols[col];
+        status = write_binary_data(output, &position, position, cur_col->values, cur_col->used_height * sizeof(float));
+    }
+    free(chunk);
+    if (fclose(output) != 0)
+        status = 1;
+    if (status)
+        fprintf(stderr, "writing the result to `%s` failed!\n", filename);
+    return status;
+}
+
+#define STREAM_TOKEN_SIZE 64
+
+/**
+ * Reads the next comma separated token of the current line, spaces are skipped.
+ * @param end_of_line is set if the token was the last one of the line (or of the file)
+ * @returns the length of the token, or -1 if it was too long
+ */
+static int read_stream_token(FILE *file, char *token, bool *end_of_line)
+{
+    int len = 0;
+    *end_of_line = false;
+    while (true)
+    {
+        int c = getc_unlocked(file);
+        if (c == ',')
+            break;
+        if (c == '\n' || c == EOF)
+        {
+            *end_of_line = true;
+            break;
+        }
+        if (c == ' ' || c == '\r')
+            continue;
+        if (len == STREAM_TOKEN_SIZE - 1)
+            return -1;
+        token[len++] = (char)c;
+    }
+    token[len] = '\0';
+    return len;
+}
+
+int open_ellpack_column_stream(ellpack_column_stream *stream, const char *filename)
+{
+    memset(stream, 0, sizeof(ellpack_column_stream));
+    stream->filename = filename;
+    stream->values_file = fopen(filename, "r");
+    stream->indices_file = fopen(filename, "r");
+    if (stream->values_file == NULL || stream->indices_file == NULL)
+    {
+        fprintf(stderr, "opening %s failed\n", filename);
+        return 1;
+    }
+    setvbuf(stream->values_file, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    setvbuf(stream->indices_file, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+
+    char first_line[100];
+    if (fgets(first_line, 98, stream->values_file) == NULL)
+    {
+        fprintf(stderr, "reading the first line of %s failed\n", filename);
+        return 1;
+    }
+    if (strncmp(first_line, ELLPACK_BINARY_MAGIC, strlen(ELLPACK_BINARY_MAGIC)) == 0)
+    {
+        fprintf(stderr, "`%s` is a binary ELLPACK file, which can not be read in column blocks!\n", filename);
+        return 1;
+    }
+    if (strchr(first_line, '-') != NULL)
+    {
+        fprintf(stderr, "%s contained negative dimension in the first line!\n", filename);
+        return 1;
+    }
+    uint64_t nr_overflow = 0;
+    int fields = sscanf(first_line, "%" SCNu64 ",%" SCNu64 ",%" SCNu64 ",%" SCNu64, &stream->nr_rows, &stream->nr_cols, &stream->nr_ellpack_elts, &nr_overflow);
+    if (fields < 3)
+    {
+        fprintf(stderr, "first line of matrix `%s` had the wrong format!\n", filename);
+        return 1;
+    }
+    if (fields == 4)
+    { // the overflow entries of a column are only known after the whole ELLPACK part was read
+        fprintf(stderr, "`%s` is a HYB file, which can not be read in column blocks!\n", filename);
+        return 1;
+    }
+    if (stream->nr_ellpack_elts != 0 && stream->nr_cols > UINT64_MAX / stream->nr_ellpack_elts)
+    {
+        fprintf(stderr, "`%s` has too many elements!\n", filename);
+        return 1;
+    }
+
+    // the indices cursor skips the values line once, with big reads instead of one getc per character
+    off_t values_start = ftello(stream->values_file);
+    if (values_start < 0 || fseeko(stream->indices_file, values_start, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "seeking in %s failed\n", filename);
+        return 1;
+    }
+    char skip_buffer[BUFFER_SIZE * 64];
+    bool found_newline = false;
+    while (!found_newline)
+    {
+        size_t read = fread(skip_buffer, 1, sizeof(skip_buffer), stream->indices_file);
+        if (read == 0)
+            break;
+        char *newline = memchr(skip_buffer, '\n', read);
+        if (newline != NULL)
+        {
+            found_newline = true;
+            // step back to the first character behind the newline
+            if (fseeko(stream->indices_file, (off_t)(newline + 1 - skip_buffer) - (off_t)read, SEEK_CUR) != 0)
+            {
+                fprintf(stderr, "seeking in %s failed\n", filename);
+                return 1;
+            }
+        }
+    }
+    if (!found_newline)
+    {
+        fprintf(stderr, "`%s` has no line with indices!\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+int read_ellpack_column_block(ellpack_column_stream *stream, uint64_t max_cols, ELLPACKMatrix *block)
+{
+    *block = get_empty_ellpackmatrix();
+    uint64_t nr_cols = stream->nr_cols - stream->next_col < max_cols ? stream->nr_cols - stream->next_col : max_cols;
+    uint64_t ell = stream->nr_ellpack_elts;
+    uint64_t capacity = nr_cols * ell;
+    bool compact_indices = stream->nr_rows <= UINT32_MAX;
+    block->nr_rows = stream->nr_rows;
+    block->nr_cols = nr_cols;
+    block->nr_ellpack_elts = ell;
+    block->sorted = true;
+    block->values = huge_page_alloc((capacity > 0 ? capacity : 1) * sizeof(float));
+    block->nr_of_non_zeros_per_col = malloc((nr_cols > 0 ? nr_cols : 1) * sizeof(uint64_t));
+    if (compact_indices)
+        block->indices32 = huge_page_alloc((capacity > 0 ? capacity : 1) * sizeof(uint32_t));
+    else
+        block->indices = huge_page_alloc((capacity > 0 ? capacity : 1) * sizeof(uint64_t));
+    if (block->values == NULL || block->nr_of_non_zeros_per_col == NULL || (block->indices32 == NULL && block->indices == NULL))
+    {
+        fprintf(stderr, "allocating memory for a column block of `%s` failed\n", stream->filename);
+        goto clean_error;
+    }
+
+    char value_token[STREAM_TOKEN_SIZE];
+    char index_token[STREAM_TOKEN_SIZE];
+    uint64_t last_element = stream->nr_cols * ell; // the last element of a line is followed by the newline
+    uint64_t element = stream->next_col * ell;
+    uint64_t non_zeros = 0;
+    for (uint64_t col = 0; col < nr_cols; col++)
+    {
+        uint64_t col_non_zeros = 0;
+        uint64_t last_index = 0;
+        for (uint64_t elt = 0; elt < ell; elt++)
+        {
+            element++;
+            bool value_end = false, index_end = false;
+            int value_len = read_stream_token(stream->values_file, value_token, &value_end);
+            int index_len = read_stream_token(stream->indices_file, index_token, &index_end);
+            if (expect_0(value_len < 0 || index_len < 0))
+            {
+                fprintf(stderr, "`%s` contains an element that is too long!\n", stream->filename);
+                goto clean_error;
+            }
+            if (expect_0(value_end != (element == last_element) || index_end != (element == last_element)))
+            {
+                fprintf(stderr, " `%s` had the wrong number of values or indices\n", stream->filename);
+                goto clean_error;
+            }
+            bool value_star = strcmp(value_token, "*") == 0;
+            bool index_star = strcmp(index_token, "*") == 0;
+            if (expect_0(value_star != index_star))
+            {
+                fprintf(stderr, value_star ? "found an index value, but value was a star!\n" : "found a index star, but no corresponding value star!\n");
+                goto clean_error;
+            }
+            if (value_star)
+                continue;
+
+            const char *value_pos = value_token;
+            float value;
+            if (expect_0(!parse_float(&value_pos, value_token + value_len, &value) || value_pos != value_token + value_len))
+            {
+                if (value_pos == value_token && errno == ERANGE) // a failed parse does not move value_pos
+                    fprintf(stderr, "(a value in %s cannot be represented as a float): ", stream->filename);
+                fprintf(stderr, "error when trying to convert float from string in %s!\n", stream->filename);
+                goto clean_error;
+            }
+            if (expect_0(isnan(value) || isinf(value)))
+                printf("warning: found %f in %s\n", value, stream->filename);
+            if (expect_0(index_token[0] == '-'))
+            {
+                fprintf(stderr, "negative indices are not valid!\n");
+                goto clean_error;
+            }
+            const char *index_pos = index_token;
+            uint64_t index;
+            if (expect_0(!parse_index(&index_pos, index_token + index_len, &index) || index_pos != index_token + index_len))
+            {
+                fprintf(stderr, "error when trying to convert uint64_t from string!\n");
+                goto clean_error;
+            }
+            if (expect_0(index >= stream->nr_rows))
+            {
+                fprintf(stderr, "invalid index found in  %s (i > number of cols )!\n", stream->filename);
+                goto clean_error;
+            }
+            // equal indices are found by sort_ellpack_columns
+            if (col_non_zeros > 0 && index <= last_index)
+                block->sorted = false;
+            last_index = index;
+
+            block->values[non_zeros] = value;
+            if (compact_indices)
+                block->indices32[non_zeros] = (uint32_t)index;
+            else
+                block->indices[non_zeros] = index;
+            non_zeros++;
+            col_non_zeros++;
+        }
+        block->nr_of_non_zeros_per_col[col] = col_non_zeros;
+    }
+    block->total_non_zero_nr = non_zeros;
+    stream->next_col += nr_cols;
+
+    if (!block->sorted)
+    {
+        if (!stream->reported_unsorted)
+        {
+            fprintf(stderr, "indices of `%s` are not sorted, the columns will be sorted after loading\n", stream->filename);
+            stream->reported_unsorted = true;
+        }
+        if (sort_ellpack_columns(block))
+        {
+            fprintf(stderr, "an index appeared twice in a column of `%s`!\n", stream->filename);
+            goto clean_error;
+        }
+    }
+    return 0;
+
+clean_error:
+    clean_matrix_data(block);
+    return 1;
+}
+
+void close_ellpack_column_stream(ellpack_column_stream *stream)
+{
+    if (stream->values_file != NULL)
+        fclose(stream->values_file);
+    if (stream->indices_file != NULL)
+        fclose(stream->indices_file);
+    stream->values_file = NULL;
+    stream->indices_file = NULL;
+}
+
+/**
+ * Creates an unlinked temporary file in the directory of output_file.
+ * @returns the opened file or NULL on failure
+ */
+static FILE *open_spill_file(const char *output_file)
+{
+    const char *slash = strrchr(output_file, '/');
+    size_t dir_len = slash != NULL ? (size_t)(slash - output_file) + 1 : 0;
+    const char *suffix = ".matmul-spill-XXXXXX";
+    char *path = malloc(dir_len + strlen(suffix) + 1);
+    if (path == NULL)
+        return NULL;
+    memcpy(path, output_file, dir_len);
+    strcpy(path + dir_len, suffix);
+    int fd = mkstemp(path);
+    FILE *file = NULL;
+    if (fd >= 0)
+    {
+        unlink(path); // the data stays accessible until the file is closed
+        file = fdopen(fd, "w+b");
+        if (file == NULL)
+            close(fd);
+    }
+    free(path);
+    return file;
+}
+
+int open_result_spill(result_spill *spill, const char *output_file)
+{
+    memset(spill, 0, sizeof(result_spill));
+    spill->heights = open_spill_file(output_file);
+    spill->values = open_spill_file(output_file);
+    spill->indices = open_spill_file(output_file);
+    if (spill->heights == NULL || spill->values == NULL || spill->indices == NULL)
+    {
+        fprintf(stderr, "could not create the temporary files next to `%s`!\n", output_file);
+        return 1;
+    }
+    setvbuf(spill->values, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    setvbuf(spill->indices, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    return 0;
+}
+
+int append_result_spill(result_spill *spill, const result_mat *block)
+{
+    for (unsigned int i = 0; i < block->cols_len; i++)
+    {
+        const result_col *col = &block->cols[i];
+        unsigned int height = col->used_height;
+        if (expect_0(fwrite(&height, sizeof(height), 1, spill->heights) != 1 ||
+                     fwrite(col->values, sizeof(float), height, spill->values) != height ||
+                     fwrite(col->indices, sizeof(uint64_t), height, spill->indices) != height))
+        {
+            fprintf(stderr, "writing the temporary result columns failed!\n");
+            return 1;
+        }
+        if (height > spill->longest_col)
+            spill->longest_col = height;
+    }
+    spill->nr_cols += block->cols_len;
+    return 0;
+}
+
+/**
+ * Writes one line of the output (all values or all indices of the spill), the elements are separated by commas
+ * and every column is padded with stars to `spill->longest_col`, like in write_ellpack_matrix.
+ * @param data values or indices file of the spill
+ * @param values true if data holds values, false for indices
+ * @returns 0 on success, 1 on IO error
+ */
+static int write_spill_line(text_output *out, result_spill *spill, FILE *data, bool values)
+{
+    if (fseeko(spill->heights, 0, SEEK_SET) != 0 || fseeko(data, 0, SEEK_SET) != 0)
+        return 1;
+    uint64_t *chunk = malloc(BINARY_CHUNK * sizeof(uint64_t));
+    if (chunk == NULL)
+        return 1;
+    size_t element_size = values ? sizeof(float) : sizeof(uint64_t);
+    bool first = true;
+    int status = 0;
+    for (uint64_t col = 0; status == 0 && col < spill->nr_cols; col++)
+    {
+        unsigned int height;
+        if (fread(&height, sizeof(height), 1, spill->heights) != 1)
+        {
+            status = 1;
+            break;
+        }
+        for (unsigned int done = 0; status == 0 && done < height; done += BINARY_CHUNK)
+        {
+            size_t n = height - done < BINARY_CHUNK ? height - done : BINARY_CHUNK;
+            if (fread(chunk, element_size, n, data) != n)
+                status = 1;
+            else if (values)
+                write_value_tokens(out, (const float *)chunk, n, &first);
+            else
+                write_index_tokens(out, chunk, n, &first);
+        }
+        write_padding_tokens(out, spill->longest_col - height, &first);
+    }
+    free(chunk);
+    return status || out->failed;
+}
+
+int write_result_spill(const char *filename, result_spill *spill, uint64_t rows)
+{
+    FILE *output = fopen(filename, "w");
+    if (!output)
+    {
+        fprintf(stderr, "invalid result filename or result matrix!\n");
+        return 1;
+    }
+    text_output out;
+    if (open_text_output(&out, fileno(output)))
+    {
+        fprintf(stderr, "allocating memory for a Buffer to print the result values to file failed!\n");
+        close_text_output(&out);
+        fclose(output);
+        return 1;
+    }
+    int status = 0;
+    out.used = (size_t)snprintf(out.buffer, STREAM_BUFFER_SIZE, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", rows, spill->nr_cols, spill->longest_col);
+    if (!spill->nr_cols)
+    {
+        fprintf(stderr, "matrix has no cols!\n"); // nothing more to do
+        status = 1;
+    }
+    else
+    {
+        status = write_spill_line(&out, spill, spill->values, true);
+        if (status == 0)
+        {
+            *reserve_text_output(&out, 1) = '\n';
+            out.used++;
+            status = write_spill_line(&out, spill, spill->indices, false);
+        }
+    }
+    if (close_text_output(&out) || (status && spill->nr_cols))
+    {
+        fprintf(stderr, "writing the result to `%s` failed!\n", filename);
+        status = 1;
+    }
+    if (fclose(output) != 0)
+        status = 1;
+    return status;
+}
+
+void close_result_spill(result_spill *spill)
+{
+    if (spill->heights != NULL)
+        fclose(spill->heights);
+    if (spill->values != NULL)
+        fclose(spill->values);
+    if (spill->indices != NULL)
+        fclose(spill->indices);
+    spill->heights = NULL;
+    spill->values = NULL;
+    spill->indices = NULL;
+}
@@ -8,8 +8,44 @@
 #include "../include/ellpack.h"
 #include "matrix_utils.h"
 
+/** @brief First bytes of a binary ELLPACK file. */
+#define ELLPACK_BINARY_MAGIC "ELLPACKB"
+/** @brief Version of the binary layout written by this build. */
+#define ELLPACK_BINARY_VERSION 1
+/** @brief Alignment of the sections of a binary ELLPACK file (one cache line). */
+#define ELLPACK_BINARY_ALIGNMENT 64
+
+/**
+ * @struct ellpack_binary_header
+ * @brief Start of a binary ELLPACK file, the arrays of `ELLPACKMatrix` follow as they are in memory.
+ *
+ * The sections start at multiples of `ELLPACK_BINARY_ALIGNMENT`, so a mapped file can be used without
+ * copying. Numbers are stored in the byte order of the writing machine; on a machine with the other
+ * byte order, `version` does not match.
+ */
+typedef struct {
+    char magic[8];            ///< `ELLPACK_BINARY_MAGIC` (not terminated)
+    uint32_t version;         ///< `ELLPACK_BINARY_VERSION`
+    uint32_t index_width;     ///< Bytes per row index: 4 if `nr_rows` fits into 32 bits (`indices32`), else 8
+    uint64_t nr_rows;
+    uint64_t nr_cols;
+    uint64_t nr_ellpack_elts; ///< Longest column
+    uint64_t nr_of_non_zeros;
+    uint32_t sorted;          ///< 1 if the indices of every column are ascending
+    uint32_t reserved;        ///< 0
+    uint64_t counts_offset;   ///< `uint64_t` non-zero count of every column
+    uint64_t indices_offset;  ///< Row indices of all columns, column after column
+    uint64_t values_offset;   ///< `float` values of all columns, column after column
+} ellpack_binary_header;
+
 /**
  * @brief Read an ELLPACK matrix from a file.
+ *
+ * HYB files are read as well: their first line has a fourth field `<#overflow>`, the ELLPACK part
+ * is padded to a typical column length only, and lines 4-6 hold the values, row indices and column
+ * indices of the entries that did not fit (COO). The overflow is merged into the columns.
+ * Binary files (see `ellpack_binary_header`) are mapped instead of parsed, the arrays point into the mapping;
+ * only the counts and the row indices are checked.
  * @param a Output matrix (buffers allocated inside on success).
  * @param filename Path to the input file.
  * @return 0 on success, non-zero on parse/IO error.
@@ -18,6 +54,7 @@ int read_ellpack_matrix(ELLPACKMatrix *a, const char *filename);
 
 /**
  * @brief Write a result matrix to a file in ELLPACK-like layout.
+ *        Values are written as the shortest decimal that is read back as the same float (`format_float`).
  * @param filename Output file path.
  * @param matrix Result matrix to serialize.
  * @param rows Number of rows in the original result grid.
@@ -27,4 +64,107 @@ int read_ellpack_matrix(ELLPACKMatrix *a, const char *filename);
  */
 result_file *write_ellpack_matrix(const char *filename, result_mat *matrix, uint64_t rows, uint64_t cols, bool *error_occurred_in_write);
 
+/**
+ * @brief Write a matrix to a binary ELLPACK file (see `ellpack_binary_header`).
+ * @param filename Output file path.
+ * @param a Matrix with fp32 values.
+ * @return 0 on success, non-zero on IO error.
+ */
+int write_ellpack_binary(const char *filename, const ELLPACKMatrix *a);
+
+/**
+ * @brief Write a result matrix to a binary ELLPACK file, column by column without converting it first.
+ * @param filename Output file path.
+ * @param matrix Result matrix to serialize.
+ * @param rows Number of rows of the result.
+ * @return 0 on success, non-zero on IO error.
+ */
+int write_result_binary(const char *filename, const result_mat *matrix, uint64_t rows);
+
+/**
+ * @struct ellpack_column_stream
+ * @brief Reads an ELLPACK file column block by column block, without loading the whole matrix.
+ *
+ * The file is opened twice: one cursor walks the values line, the other one the indices line,
+ * so the values and indices of the next columns are always read next to each other.
+ */
+typedef struct {
+    const char *filename;
+    FILE *values_file;        ///< Positioned in the values line at the first unread column
+    FILE *indices_file;       ///< Positioned in the indices line at the first unread column
+    uint64_t nr_rows;
+    uint64_t nr_cols;
+    uint64_t nr_ellpack_elts;
+    uint64_t next_col;        ///< First column that has not been read yet
+    bool reported_unsorted;   ///< The warning about unsorted indices is only printed once
+} ellpack_column_stream;
+
+/**
+ * @brief Open an ELLPACK file for streaming: read the first line and position both cursors.
+ *        HYB files are rejected, the overflow of a column is only known at the end of the file,
+ *        and so are binary files (they are mapped by `read_ellpack_matrix` anyway).
+ * @param stream Output stream, has to be closed with `close_ellpack_column_stream` (also on failure).
+ * @param filename Path to the input file.
+ * @return 0 on success, non-zero on IO/format error.
+ */
+int open_ellpack_column_stream(ellpack_column_stream *stream, const char *filename);
+
+/**
+ * @brief Read the next (up to) `max_cols` columns as a matrix with the same number of rows.
+ *        The columns are validated like in `read_ellpack_matrix` and sorted if necessary.
+ * @param stream Open stream; `next_col` is advanced.
+ * @param max_cols Maximum number of columns of the block (at least 1).
+ * @param block Output matrix (buffers allocated inside), has to be freed with `clean_matrix_data`.
+ * @return 0 on success, non-zero on parse/IO error.
+ */
+int read_ellpack_column_block(ellpack_column_stream *stream, uint64_t max_cols, ELLPACKMatrix *block);
+
+/**
+ * @brief Close both cursors of a stream.
+ */
+void close_ellpack_column_stream(ellpack_column_stream *stream);
+
+/**
+ * @struct result_spill
+ * @brief Finished result columns that were moved out of memory (see `append_result_spill`).
+ *
+ * Heights, values and row indices are appended in binary to three unlinked temporary files,
+ * which are created next to the output file and disappear when they are closed.
+ */
+typedef struct {
+    FILE *heights;        ///< `unsigned int` height of every column
+    FILE *values;         ///< `float` values of all columns
+    FILE *indices;        ///< `uint64_t` row indices of all columns
+    uint64_t nr_cols;     ///< Number of columns appended so far
+    uint64_t longest_col; ///< Height of the longest column appended so far
+} result_spill;
+
+/**
+ * @brief Create the temporary files of a spill.
+ * @param spill Output, has to be closed with `close_result_spill` (also on failure).
+ * @param output_file Path of the final output; the temporary files are created in the same directory.
+ * @return 0 on success, non-zero on IO error.
+ */
+int open_result_spill(result_spill *spill, const char *output_file);
+
+/**
+ * @brief Append all columns of a result block to the spill, in order.
+ * @return 0 on success, non-zero on IO error.
+ */
+int append_result_spill(result_spill *spill, const result_mat *block);
+
+/**
+ * @brief Write the spilled columns to a file in the same layout as `write_ellpack_matrix`.
+ * @param filename Output file path.
+ * @param spill Spill with all columns of the result.
+ * @param rows Number of rows of the result.
+ * @return 0 on success, non-zero on IO error.
+ */
+int write_result_spill(const char *filename, result_spill *spill, uint64_t rows);
+
+/**
+ * @brief Close (and thereby delete) the temporary files of a spill.
+ */
+void close_result_spill(result_spill *spill);
+
 #endif // IO_H
\ No newline at end of file
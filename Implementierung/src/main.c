@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdlib.h>
+#include <string.h>
 #include "../include/ellpack.h"
 #include "io.h"
 #include "matrix_utils.h"
@@ -8,12 +9,13 @@
 #include <stdbool.h>
 #include <limits.h>
 #include "matmul.h"
+#include "dot_product.h"
 #include "benchmark.h"
 #include "matmul_caller.h"
 
 
-#define OPTSTRING "V:B::a:b:o:htp"
-#define NUMBER_OF_VS 3 // ranging from 0 to <NUMBER_OF_VS>
+#define OPTSTRING "V:B::T:PH:vM:F:a:b:o:htp"
+#define NUMBER_OF_VS 9 // ranging from 0 to <NUMBER_OF_VS>
 
 void print_help();
 
@@ -33,10 +35,12 @@ int main(int argc, char **argv)
 {
     int V = 0;              // which implementation to use -> is used to determine the function
     int B = 0;              // how many benchmark iterations to run (if 0, benchmarking is disabled)
+    int T = 0;              // tile width of V7 (if 0, it is derived from the L2 cache size)
     char *a = NULL;         // file path to matrix a
     char *b = NULL;         // file path to matrix b
     char *o = NULL;         // file path to result
     bool show_help = false; // if this is set, all other options should be ignored
+    matmul_options options = { .packed_b = false, .value_format = VALUES_FP32, .verbose = false, .memory_budget = 0, .binary_output = false, .tile_size = 0 }; // storage of the operands
     bool run_tests = false;
     bool run_benchmarks = false;
 
@@ -44,6 +48,7 @@ int main(int argc, char **argv)
     int option_idx = 0;
     struct option long_opts[] = {
         {.name = "help", .has_arg = no_argument, .flag = 0, .val = 'h'},
+        {.name = "verbose", .has_arg = no_argument, .flag = 0, .val = 'v'},
         {0, 0, 0, 0}};
 
     while ((opt = getopt_long(argc, argv, OPTSTRING, long_opts, &option_idx)) != -1)
@@ -58,7 +63,7 @@ int main(int argc, char **argv)
             }
             if (V >= NUMBER_OF_VS)
             {
-                fprintf(stderr, "V is greater than the number of implementations, maximum can be %d\n", NUMBER_OF_VS);
+                fprintf(stderr, "V is greater than the number of implementations, maximum can be %d\n", NUMBER_OF_VS - 1);
                 return EXIT_FAILURE;
             }
             break;
@@ -75,6 +80,48 @@ int main(int argc, char **argv)
                 return EXIT_FAILURE;
             }
             break;
+        case 'T':
+            if (!parse_int(optarg, &T) || T < 0)
+            {
+                fprintf(stderr, "T must be a non-negative integer\n");
+                return EXIT_FAILURE;
+            }
+            options.tile_size = (uint64_t) T;
+            break;
+        case 'P':
+            options.packed_b = true;
+            break;
+        case 'H':
+            if (strcmp(optarg, "bf16") == 0) options.value_format = VALUES_BF16;
+            else if (strcmp(optarg, "fp16") == 0) options.value_format = VALUES_FP16;
+            else
+            {
+                fprintf(stderr, "H must be bf16 or fp16\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'v':
+            options.verbose = true;
+            break;
+        case 'M':
+        {
+            int budget_mib = 0;
+            if (!parse_int(optarg, &budget_mib) || budget_mib <= 0)
+            {
+                fprintf(stderr, "M must be a positive number of MiB\n");
+                return EXIT_FAILURE;
+            }
+            options.memory_budget = (uint64_t) budget_mib << 20;
+            break;
+        }
+        case 'F':
+            if (strcmp(optarg, "binary") == 0) options.binary_output = true;
+            else if (strcmp(optarg, "text") != 0)
+            {
+                fprintf(stderr, "F must be text or binary\n");
+                return EXIT_FAILURE;
+            }
+            break;
         case 'a':
             a = optarg;
             break;
@@ -124,6 +171,21 @@ int main(int argc, char **argv)
     case 3: 
         matmul = (matmul_func) matr_mult_ellpack_unsorted;
         break;
+    case 4:
+        matmul = (matmul_func) matr_mult_ellpack_main_parallel;
+        break;
+    case 5:
+        matmul = (matmul_func) matr_mult_ellpack_gustavson;
+        break;
+    case 6:
+        matmul = (matmul_func) matr_mult_ellpack_main_panel;
+        break;
+    case 7:
+        matmul = (matmul_func) matr_mult_ellpack_main_tiled;
+        break;
+    case 8:
+        matmul = (matmul_func) matr_mult_ellpack_sell;
+        break;
     default:
         fprintf(stderr, "V is not defined for this value.\n");
         return EXIT_FAILURE;
@@ -144,13 +206,46 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    const char *kernel_name = NULL;
+    if (V == 0 || V == 1 || V == 4 || V == 7)
+        kernel_name = select_simd_row_kernel();
+    else if (V == 6)
+        kernel_name = select_simd_panel_kernel();
+    else if (V == 8)
+        kernel_name = select_simd_sell_kernel();
+    if (kernel_name != NULL)
+    {
+        printf("Using %s dot product kernel\n", kernel_name);
+    }
+
     if(o == NULL) {
         printf("o was not set, using default value of `gen/matrix.txt`\n");
         o = "gen/matrix.txt";
     }
     /* main program, all options can be assumed as set & valid */
 
-    return call_matmul(a, b, o, B, matmul);
+    if (optind == argc)
+    {
+        return call_matmul(a, b, o, B, matmul, &options);
+    }
+
+    // further operands: a * b * c * ...
+    int nr_operands = 2 + (argc - optind);
+    const char **operands = malloc(nr_operands * sizeof(const char *));
+    if (operands == NULL)
+    {
+        fprintf(stderr, "Could not allocate the operand list\n");
+        return EXIT_FAILURE;
+    }
+    operands[0] = a;
+    operands[1] = b;
+    for (int i = optind; i < argc; i++)
+    {
+        operands[2 + (i - optind)] = argv[i];
+    }
+    int status = call_matmul_chain(operands, nr_operands, o, B, matmul, &options);
+    free(operands);
+    return status;
 }
 
 
@@ -159,12 +254,24 @@ void print_help()
     printf("Help Message\n");
     printf("-V <number> — The implementation to be used. If set to 0 or if the option is omitted, the main implementation is chosen\n");
     printf("\t0: main implementation, chooses V1 if matrix is sorted\n");
-    printf("\t1: main implementation with simd dot product\n");
+    printf("\t1: main implementation with simd dot product (AVX-512, AVX2 or SSE3, chosen at startup)\n");
     printf("\t2: main implementation without simd (is useful for small or very sparse matrices)\n");
     printf("\t3: unsorted indices implementation (much much slower)\n");
+    printf("\t4: main implementation with simd dot product, rows of A are split across all cores\n");
+    printf("\t5: Gustavson implementation with a sparse accumulator (best for very sparse matrices, also works for unsorted indices)\n");
+    printf("\t6: main implementation on panels of 8 rows of A, every loaded element of B is used for all 8 rows\n");
+    printf("\t7: main implementation with simd dot product, the columns of A are split into tiles that fit into the L2 cache (for very wide A)\n");
+    printf("\t8: SELL-C-sigma implementation, B is stored in sorted slices of 8 columns and each SIMD pass computes 8 columns (for short columns of B)\n");
     printf("-B<number> — If set, the runtime of the specified implementation is measured and output. The optional argument of this option specifies the number of repetitions of the function call, e.g. -B or -B5 (not set -> one repetition)\n");
-    printf("-a <filename> — Input file containing matrix A\n");
-    printf("-b <filename> — Input file containing matrix B\n");
+    printf("-T <number> — Tile width of V7 in columns of A. If set to 0 or if the option is omitted, it is derived from the L2 cache size\n");
+    printf("-P — Store B as packed (index, value) records, used by the dot product kernels of V0, V1, V2, V4 and V7. Together with -B, the benchmark is run for both layouts\n");
+    printf("-H bf16|fp16 — Store the values of A and B as 16-bit bfloat16 or IEEE half after loading (halves the value bandwidth, products are still accumulated in fp32)\n");
+    printf("-v|--verbose — After every multiplication, report how many large buffers (matrix arrays, row caches) were advised for 2 MB pages and how much memory is actually backed by them; also report when -V 4 falls back to one thread\n");
+    printf("-M <MiB> — Out-of-core mode with the given memory budget: only A is kept in memory, B is read in column blocks and the result columns go through temporary files next to the output (two operands, no -B, text output, B has to be plain ELLPACK)\n");
+    printf("-F text|binary — Format of the output file. binary writes the arrays of the result as they are in memory (see ellpack_binary_header in io.h), such a file is mapped instead of parsed when it is used as an input again (text if omitted)\n");
+    printf("<filename>... — Further operands after the options form the chain A * B * C ..., which is multiplied in the order with the lowest estimated cost (printed), the intermediate products stay in memory\n");
+    printf("-a <filename> — Input file containing matrix A (ELLPACK, HYB: ELLPACK part plus COO overflow, see scripts/ellpack_to_hyb.py, or binary ELLPACK, see bin/ellpack_convert)\n");
+    printf("-b <filename> — Input file containing matrix B (ELLPACK, HYB or binary ELLPACK; with -M only ELLPACK)\n");
     printf("-o <filename> — Output file. By default, is set to gen/matrix.txt\n");
     printf("-h|--help — A description of all program options and usage examples are output, and the program then exits\n");
     printf("The following two options are automated test/benchmarks that can be run from the CLI, but are not part of the required specification. For them to work, files need to be generated with a script. Before using them, execute make all-generate to set up the needed files.\n");
@@ -1,23 +1,32 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 #include <getopt.h>
 #include <stdbool.h>
 #include <limits.h>
 #include "matmul.h"
+#include "dot_product.h"
 #include "matmul_caller.h"
 
-#define OPTSTRING "V:B::a:b:o:h"
-#define NUMBER_OF_VS 3
+#define OPTSTRING "V:B::T:PH:vM:F:a:b:o:h"
+#define NUMBER_OF_VS 9
 
 static void print_help()
 {
     printf("Help (Release)\n");
-    printf("-V <number> — Implementation: 0=auto, 1=SIMD, 2=no SIMD, 3=unsorted\n");
+    printf("-V <number> — Implementation: 0=auto, 1=SIMD (widest of AVX-512/AVX2/SSE3), 2=no SIMD, 3=unsorted, 4=parallel SIMD, 5=Gustavson, 6=row panels (8 rows of A per pass over B), 7=tiled SIMD (for very wide A), 8=SELL-C-sigma (for short columns of B)\n");
     printf("-B<number> — Benchmark repetitions (e.g., -B or -B5)\n");
-    printf("-a <filename> — Input matrix A (ELLPACK)\n");
-    printf("-b <filename> — Input matrix B (ELLPACK)\n");
+    printf("-T <number> — Tile width of V7 in columns of A (0 or omitted: from L2 cache size)\n");
+    printf("-P — Store B as packed (index, value) records; with -B, both layouts are benchmarked\n");
+    printf("-H bf16|fp16 — Store the values of A and B in 16 bits (fp32 accumulation)\n");
+    printf("-v|--verbose — Report how much of the matrix memory is backed by 2 MB pages, and when -V 4 falls back to one thread\n");
+    printf("-M <MiB> — Out-of-core mode: only A is kept in memory, B is read in column blocks (two operands, no -B, text output, plain-ELLPACK B)\n");
+    printf("-F text|binary — Format of the output file (binary: mapped without parsing when it is used as an input again)\n");
+    printf("<filename>... — Further operands, the result is A * B * C ... (multiplied in the cheapest estimated order, intermediate products stay in memory)\n");
+    printf("-a <filename> — Input matrix A (ELLPACK, HYB or binary ELLPACK)\n");
+    printf("-b <filename> — Input matrix B (ELLPACK, HYB or binary ELLPACK; only ELLPACK with -M)\n");
     printf("-o <filename> — Output file (default: gen/matrix.txt)\n");
     printf("-h — Show help\n");
 }
@@ -38,15 +47,18 @@ int main(int argc, char **argv)
 {
     int V = 0;
     int B = 0;
+    int T = 0;
     char *a = NULL;
     char *b = NULL;
     char *o = NULL;
     bool show_help = false;
+    matmul_options options = { .packed_b = false, .value_format = VALUES_FP32, .verbose = false, .memory_budget = 0, .binary_output = false, .tile_size = 0 };
 
     int opt;
     int option_idx = 0;
     struct option long_opts[] = {
         {.name = "help", .has_arg = no_argument, .flag = 0, .val = 'h'},
+        {.name = "verbose", .has_arg = no_argument, .flag = 0, .val = 'v'},
         {0, 0, 0, 0}};
 
     while ((opt = getopt_long(argc, argv, OPTSTRING, long_opts, &option_idx)) != -1)
@@ -61,7 +73,7 @@ int main(int argc, char **argv)
             }
             if (V >= NUMBER_OF_VS)
             {
-                fprintf(stderr, "V is greater than the number of implementations, maximum can be %d\n", NUMBER_OF_VS);
+                fprintf(stderr, "V is greater than the number of implementations, maximum can be %d\n", NUMBER_OF_VS - 1);
                 return EXIT_FAILURE;
             }
             break;
@@ -78,6 +90,48 @@ int main(int argc, char **argv)
                 return EXIT_FAILURE;
             }
             break;
+        case 'T':
+            if (!parse_int(optarg, &T) || T < 0)
+            {
+                fprintf(stderr, "T must be a non-negative integer\n");
+                return EXIT_FAILURE;
+            }
+            options.tile_size = (uint64_t) T;
+            break;
+        case 'P':
+            options.packed_b = true;
+            break;
+        case 'H':
+            if (strcmp(optarg, "bf16") == 0) options.value_format = VALUES_BF16;
+            else if (strcmp(optarg, "fp16") == 0) options.value_format = VALUES_FP16;
+            else
+            {
+                fprintf(stderr, "H must be bf16 or fp16\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'v':
+            options.verbose = true;
+            break;
+        case 'M':
+        {
+            int budget_mib = 0;
+            if (!parse_int(optarg, &budget_mib) || budget_mib <= 0)
+            {
+                fprintf(stderr, "M must be a positive number of MiB\n");
+                return EXIT_FAILURE;
+            }
+            options.memory_budget = (uint64_t) budget_mib << 20;
+            break;
+        }
+        case 'F':
+            if (strcmp(optarg, "binary") == 0) options.binary_output = true;
+            else if (strcmp(optarg, "text") != 0)
+            {
+                fprintf(stderr, "F must be text or binary\n");
+                return EXIT_FAILURE;
+            }
+            break;
         case 'a':
             a = optarg;
             break;
@@ -119,6 +173,21 @@ int main(int argc, char **argv)
     case 3:
         matmul = (matmul_func) matr_mult_ellpack_unsorted;
         break;
+    case 4:
+        matmul = (matmul_func) matr_mult_ellpack_main_parallel;
+        break;
+    case 5:
+        matmul = (matmul_func) matr_mult_ellpack_gustavson;
+        break;
+    case 6:
+        matmul = (matmul_func) matr_mult_ellpack_main_panel;
+        break;
+    case 7:
+        matmul = (matmul_func) matr_mult_ellpack_main_tiled;
+        break;
+    case 8:
+        matmul = (matmul_func) matr_mult_ellpack_sell;
+        break;
     default:
         fprintf(stderr, "V is not defined for this value.\n");
         return EXIT_FAILURE;
@@ -130,11 +199,44 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    const char *kernel_name = NULL;
+    if (V == 0 || V == 1 || V == 4 || V == 7)
+        kernel_name = select_simd_row_kernel();
+    else if (V == 6)
+        kernel_name = select_simd_panel_kernel();
+    else if (V == 8)
+        kernel_name = select_simd_sell_kernel();
+    if (kernel_name != NULL)
+    {
+        printf("Using %s dot product kernel\n", kernel_name);
+    }
+
     if (o == NULL)
     {
         printf("o was not set, using default value of `gen/matrix.txt`\n");
         o = "gen/matrix.txt";
     }
 
-    return call_matmul(a, b, o, B, matmul);
+    if (optind == argc)
+    {
+        return call_matmul(a, b, o, B, matmul, &options);
+    }
+
+    // further operands: a * b * c * ...
+    int nr_operands = 2 + (argc - optind);
+    const char **operands = malloc(nr_operands * sizeof(const char *));
+    if (operands == NULL)
+    {
+        fprintf(stderr, "Could not allocate the operand list\n");
+        return EXIT_FAILURE;
+    }
+    operands[0] = a;
+    operands[1] = b;
+    for (int i = optind; i < argc; i++)
+    {
+        operands[2 + (i - optind)] = argv[i];
+    }
+    int status = call_matmul_chain(operands, nr_operands, o, B, matmul, &options);
+    free(operands);
+    return status;
 }
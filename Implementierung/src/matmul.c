@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include "../include/ellpack.h"
 #include <stdbool.h>
 #include <stdio.h>
@@ -7,20 +8,26 @@
 #include <inttypes.h>
 #include "matrix_utils.h"
 #include <math.h>
-#include <emmintrin.h>
-#include <smmintrin.h>
+#include "dot_product.h"
+#include "huge_pages.h"
+#include <pthread.h>
+#include <unistd.h>
 #define EPSILON 1e-7f
+#define MAX_THREADS 256 // upper bound for the worker threads of the parallel implementation
+#define PARALLEL_SCRATCH_BYTES (64ull << 20) // scratch of all threads of the parallel implementation for one block of columns of b
+// scratch per thread and column of b: count and slice begin, last counted row, row result and candidate filter of the kernel
+#define PARALLEL_SCRATCH_PER_COL (2 * sizeof(unsigned int) + sizeof(uint64_t) + sizeof(float) + sizeof(bool) + sizeof(uint32_t))
 
-void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns);
+void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
 // actual function
-void matr_mult_ellpack_main(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const bool simd);
+void matr_mult_ellpack_main(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context, const bool simd);
 // wrapper without simd
-void matr_mult_ellpack_main_no_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns){
-    matr_mult_ellpack_main(matr_a, matr_b, result_columns, false);
+void matr_mult_ellpack_main_no_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context){
+    matr_mult_ellpack_main(matr_a, matr_b, result_columns, context, false);
 }
 // wrapper with simd
-void matr_mult_ellpack_main_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns){
-    matr_mult_ellpack_main(matr_a, matr_b, result_columns, true);
+void matr_mult_ellpack_main_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context){
+    matr_mult_ellpack_main(matr_a, matr_b, result_columns, context, true);
 }
 
 /**
@@ -28,289 +35,1013 @@ void matr_mult_ellpack_main_simd(const const_ELLPACKMatrix *matr_a, const const_
  * @param a Pointer to an ELLPACKMatrix with the first matrix data
  * @param b Pointer to an ELLPACKMatrix with the second matrix data
  * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
  */
-void matr_mult_ellpack(const void *a, const void *b, void *result)
+void matr_mult_ellpack(const void *a, const void *b, void *result, const matmul_context *context)
 {
     bool sorted = (((const_ELLPACKMatrix*) a)->sorted) && (((const_ELLPACKMatrix*) b)->sorted);
     if(sorted) {
-        matr_mult_ellpack_main_simd((const_ELLPACKMatrix*) a,(const_ELLPACKMatrix*)  b, (result_mat*) result);
+        matr_mult_ellpack_main_simd((const_ELLPACKMatrix*) a,(const_ELLPACKMatrix*)  b, (result_mat*) result, context);
     } else {
         printf("Warning: Unsorted indices detected, using slower unsorted algorithm\n");
-        matr_mult_ellpack_unsorted((const_ELLPACKMatrix*) a,(const_ELLPACKMatrix*)  b, (result_mat*) result);
+        matr_mult_ellpack_unsorted((const_ELLPACKMatrix*) a,(const_ELLPACKMatrix*)  b, (result_mat*) result, context);
     }
 }
-/** Helper for the next_row function that finds the lowest row index in the matrix
+/**
+ * Helper that writes row row_idx of a matrix into the (zero-initialized) row cache, using the row index of the matrix.
+ * Only the non-zero positions are touched, so clear_row_cache has to be called before the next row is parsed.
+ * @param row_cache: pointer to an array of size cols where the row will be written to
+ * @param rows: the row index (CSR transpose) of the matrix we are parsing from
+ * @param row_idx: the row we are parsing
+ */
+static inline void fill_row_cache(float *row_cache, const ellpack_row_index *rows, uint64_t row_idx)
+{
+    for (uint64_t k = rows->row_starts[row_idx]; k < rows->row_starts[row_idx + 1]; k++)
+    {
+        row_cache[rows->cols[k]] = rows->values[k];
+    }
+}
+
+/** Helper that resets the positions written by fill_row_cache to 0 */
+static inline void clear_row_cache(float *row_cache, const ellpack_row_index *rows, uint64_t row_idx)
+{
+    for (uint64_t k = rows->row_starts[row_idx]; k < rows->row_starts[row_idx + 1]; k++)
+    {
+        row_cache[rows->cols[k]] = 0.0f;
+    }
+}
+
+/**
+ * Appends a value to column j of the result. Writes to the position col_cursors[j] of the column (the slice of a thread of
+ * matr_mult_ellpack_main_parallel) if col_cursors is given. Without it, columns sized by the symbolic phase are appended to
+ * without a capacity check; all other results go through push_to_matrix.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE (only push_to_matrix can fail)
+ */
+static inline int store_result(result_mat *result_columns, unsigned int *col_cursors, float value, uint64_t i, uint32_t j)
+{
+    result_col *col = &result_columns->cols[j];
+    if (col_cursors != NULL)
+    {
+        unsigned int position = col_cursors[j]++;
+        col->values[position] = value;
+        col->indices[position] = i;
+        return EXIT_SUCCESS;
+    }
+    if (result_columns->exact)
+    {
+        col->values[col->used_height] = value;
+        col->indices[col->used_height++] = i;
+        return EXIT_SUCCESS;
+    }
+    return push_to_matrix(result_columns, value, i, j);
+}
+
+/** Everything the row-wise implementations share (read only while the rows are multiplied) */
+typedef struct {
+    const const_ELLPACKMatrix *matr_a;
+    const const_ELLPACKMatrix *matr_b;
+    ellpack_row_index a_rows; ///< rows of a, used to fill the row cache
+    ellpack_row_index b_rows; ///< rows of b: for every shared index k, the columns of b with a non-zero in row k
+    uint64_t *b_col_starts;   ///< offset of each column of b in the values/indices arrays
+    row_kernel_func row_kernel;
+    const matmul_context *context;
+    bool borrowed_a_rows;     ///< a_rows belongs to context->left and is not freed with the plan
+} row_product_plan;
+
+static uint64_t *get_col_starts(const const_ELLPACKMatrix *mat);
+static bool has_finite_values(const const_ELLPACKMatrix *mat);
+
+/* Left operand that is shared by several multiplications (out-of-core mode) */
+
+left_operand get_empty_left_operand()
+{
+    left_operand left = {
+        .rows = get_empty_row_index(),
+        .col_starts = NULL,
+        .finite_values = false
+    };
+    return left;
+}
+
+int build_left_operand(const const_ELLPACKMatrix *matr_a, left_operand *left)
+{
+    *left = get_empty_left_operand();
+    if (build_row_index(matr_a, &left->rows) == EXIT_FAILURE) return EXIT_FAILURE;
+    left->col_starts = get_col_starts(matr_a);
+    if (left->col_starts == NULL)
+    {
+        fprintf(stderr, "Could not allocate column offsets\n");
+        free_left_operand(left);
+        return EXIT_FAILURE;
+    }
+    left->finite_values = has_finite_values(matr_a);
+    return EXIT_SUCCESS;
+}
+
+void free_left_operand(left_operand *left)
+{
+    free_row_index(&left->rows);
+    free(left->col_starts);
+    left->col_starts = NULL;
+}
+
+/** Column offsets of a, taken from left if it is given. Free with release_left_col_starts */
+static uint64_t *get_left_col_starts(const const_ELLPACKMatrix *matr_a, const left_operand *left)
+{
+    return left != NULL ? left->col_starts : get_col_starts(matr_a);
+}
+
+static void release_left_col_starts(uint64_t *col_starts, const left_operand *left)
+{
+    if (left == NULL) free(col_starts);
+}
+
+static bool has_finite_left_values(const const_ELLPACKMatrix *matr_a, const left_operand *left)
+{
+    return left != NULL ? left->finite_values : has_finite_values(matr_a);
+}
+
+static void free_row_product_plan(row_product_plan *plan)
+{
+    if (!plan->borrowed_a_rows) free_row_index(&plan->a_rows);
+    plan->a_rows = get_empty_row_index();
+    free_row_index(&plan->b_rows);
+    free(plan->b_col_starts);
+    plan->b_col_starts = NULL;
+}
+
+/**
+ * Builds the row indices of a and b for the row-wise implementations (the one of a is borrowed from context->left if it is given).
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. The plan has to be freed with free_row_product_plan in both cases
+ */
+static int init_row_product_plan(row_product_plan *plan, const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, row_kernel_func row_kernel, const matmul_context *context)
+{
+    plan->matr_a = matr_a;
+    plan->matr_b = matr_b;
+    plan->a_rows = get_empty_row_index();
+    plan->b_rows = get_empty_row_index();
+    plan->row_kernel = row_kernel;
+    plan->context = context;
+    plan->borrowed_a_rows = false;
+    plan->b_col_starts = get_col_starts(matr_b);
+    if (plan->b_col_starts == NULL)
+    {
+        fprintf(stderr, "Could not allocate column offsets\n");
+        return EXIT_FAILURE;
+    }
+    if (context->left != NULL)
+    {
+        plan->a_rows = context->left->rows;
+        plan->borrowed_a_rows = true;
+    }
+    else if (build_row_index(matr_a, &plan->a_rows) == EXIT_FAILURE) return EXIT_FAILURE;
+    return build_row_index(matr_b, &plan->b_rows);
+}
+
+/**
+ * Collects the columns of b that share at least one index with the rows [row_first, row_last) of a; all other dot products are 0.
+ * @param candidate_mark: array of size cols_b that is all false, will be all false again after the call
+ * @param candidates: array of size cols_b the candidate columns are written to
+ * @returns the number of candidate columns, or UINT64_MAX if checking the structure costs more than computing all dot products
  */
-uint64_t find_lowest_row_idx(const const_ELLPACKMatrix* mat, const uint64_t* start_indices, bool* found) {
-    *found = false;
-    const uint64_t* indices = mat->indices;
-    const uint64_t* col_sizes = mat->nr_of_non_zeros_per_col;
-    uint64_t result = 0;
-    // i is index in the indices array (in the entire matrix)
-    for (uint64_t col_idx = 0, i = 0; col_idx < mat->nr_cols; col_idx++)
-    {
-        uint64_t col_size = col_sizes[col_idx]; // how many elements the current column has
-        uint64_t column_offset = start_indices[col_idx]; // the offset of the first unparsed element in the column
-        if(column_offset < col_size) {
-            uint64_t row_idx = indices[i + column_offset];
-            if(*found == false || row_idx < result){
-                result = row_idx; //found a new lowest row index
-                *found = true;
+static uint64_t find_candidate_cols(const row_product_plan *plan, uint64_t row_first, uint64_t row_last, bool *candidate_mark, uint32_t *candidates)
+{
+    const ellpack_row_index *a_rows = &plan->a_rows;
+    const ellpack_row_index *b_rows = &plan->b_rows;
+    // the structural work is the sum of the lengths of the rows of b we have to visit
+    uint64_t structural_work = 0;
+    for (uint64_t k = a_rows->row_starts[row_first]; k < a_rows->row_starts[row_last]; k++)
+    {
+        uint32_t shared_idx = a_rows->cols[k];
+        structural_work += b_rows->row_starts[shared_idx + 1] - b_rows->row_starts[shared_idx];
+    }
+    if (structural_work * 2 > plan->matr_b->total_non_zero_nr)
+    {
+        return UINT64_MAX; // dense enough that a sweep over all columns is cheaper
+    }
+
+    uint64_t nr_candidates = 0;
+    for (uint64_t k = a_rows->row_starts[row_first]; k < a_rows->row_starts[row_last]; k++)
+    {
+        uint32_t shared_idx = a_rows->cols[k];
+        for (uint64_t b_idx = b_rows->row_starts[shared_idx]; b_idx < b_rows->row_starts[shared_idx + 1]; b_idx++)
+        {
+            uint32_t j = b_rows->cols[b_idx];
+            if (!candidate_mark[j])
+            {
+                candidate_mark[j] = true;
+                candidates[nr_candidates++] = j;
             }
         }
-        i += col_size; // move to the next column
     }
+    for (uint64_t t = 0; t < nr_candidates; t++)
+    {
+        candidate_mark[candidates[t]] = false;
+    }
+    return nr_candidates;
+}
+
+/**
+ * Multiplies the rows [row_begin, row_end) of a with b. Each call has its own row cache,
+ * so multiple calls on disjoint row ranges can run at the same time.
+ * Columns of b that share no index with the current row are skipped (structural filter).
+ * @param plan Shared data of the multiplication (matrices have to be validated already)
+ * @param result_columns result_mat the rows are pushed to (in ascending row order per column)
+ * @param col_cursors NULL, or the next position of every column of the result this call writes to (see store_result)
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. On failure, result_columns is not freed
+ */
+static int multiply_row_range(const row_product_plan *plan, result_mat *result_columns, unsigned int *col_cursors, uint64_t row_begin, uint64_t row_end)
+{
+    int status = EXIT_FAILURE;
+    const const_ELLPACKMatrix *matr_b = plan->matr_b;
+    const ellpack_row_index *a_rows = &plan->a_rows;
+    const uint32_t matr_b_cols = matr_b->nr_cols;
+
+    /* init work: all variables with data that has to be freed */
+    /** row cache: since reading a row from a column-major matrix is expensive, the current row is stored densely.
+     * It starts zeroed and only the non-zero positions of a row are written and reset again. */
+    float *row_cache = huge_page_calloc(plan->matr_a->nr_cols, sizeof(float));
+    // the dot products of the current row with the (candidate) columns of b
+    float *row_result = malloc(matr_b_cols * sizeof(float));
+    // structural filter: the columns of b that can have a non-zero product with the current row
+    bool *candidate_mark = calloc(matr_b_cols, sizeof(bool));
+    uint32_t *candidates = malloc(matr_b_cols * sizeof(uint32_t));
+    if (row_cache == NULL || row_result == NULL || candidate_mark == NULL || candidates == NULL)
+    {
+        fprintf(stderr, "Could not allocate row cache\n");
+        goto cleanup;
+    }
+    /* init end */
 
-    return result;
+    // in the following code, i is index in a (row loop), j is index in b (column loop)
+    // for each row in a
+    for (uint64_t i = row_begin; i < row_end; i++)
+    {
+        if (a_rows->row_starts[i] == a_rows->row_starts[i + 1]) continue; //skip the row if it is empty
+        uint64_t nr_candidates = find_candidate_cols(plan, i, i + 1, candidate_mark, candidates);
+        const uint32_t *cols = candidates;
+        if (nr_candidates == UINT64_MAX)
+        { // all columns
+            cols = NULL;
+            nr_candidates = matr_b_cols;
+        }
+        fill_row_cache(row_cache, a_rows, i);
+        plan->row_kernel(row_cache, matr_b, plan->b_col_starts, plan->b_col_starts + 1, cols, nr_candidates, row_result);
+
+        for (uint64_t t = 0; t < nr_candidates; t++)
+        {
+            // j is uint32_t because this is checked in the matrix validator
+            uint32_t j = cols != NULL ? cols[t] : t;
+            float result_value = row_result[t];
+            if (!(fabs(result_value) < EPSILON)) //for result_value == 0, we do not need to store it due to ellpack
+            {
+                // push the result to the result matrix -> error is extremely unlikely here
+                if (__builtin_expect(store_result(result_columns, col_cursors, result_value, i, j) == EXIT_FAILURE, 0))
+                {
+                    goto cleanup;
+                }
+            }
+        }
+        clear_row_cache(row_cache, a_rows, i);
+    }
+    status = EXIT_SUCCESS;
+
+cleanup:
+    free(candidates);
+    free(candidate_mark);
+    free(row_result);
+    free(row_cache);
+    return status;
+}
+
+/* Cache-blocked tiling of the shared dimension */
+
+/**
+ * Number of shared indices (columns of a / rows of b) per tile: the part of the row cache
+ * that is gathered from while one tile is multiplied should take at most half of the L2 cache.
+ */
+static uint64_t get_tile_size(const matmul_context *context)
+{
+    if (context->tile_size > 0) return context->tile_size;
+    long l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2_size <= 0) l2_size = 256 * 1024; // not reported by every system
+    return (uint64_t) l2_size / 2 / sizeof(float);
+}
+
+/** Splits every column of b into one contiguous part per tile (b is sorted, so a tile is a range of the column) */
+typedef struct {
+    uint64_t size;          ///< shared indices per tile
+    uint64_t nr_tiles;
+    uint64_t *tile_starts;  ///< tile_starts[t * cols_b + j]: first position of column j with an index >= t * size, t = 0..nr_tiles
+} shared_dim_tiling;
+
+/**
+ * Builds the tile offsets of b in O(nnz(b) + nr_tiles * cols_b).
+ * @returns EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int build_tiling(const row_product_plan *plan, shared_dim_tiling *tiling)
+{
+    const const_ELLPACKMatrix *matr_b = plan->matr_b;
+    const uint64_t cols_b = matr_b->nr_cols;
+    tiling->size = get_tile_size(plan->context);
+    tiling->nr_tiles = (matr_b->nr_rows + tiling->size - 1) / tiling->size;
+    tiling->tile_starts = malloc((tiling->nr_tiles + 1) * cols_b * sizeof(uint64_t));
+    if (tiling->tile_starts == NULL)
+    {
+        fprintf(stderr, "Could not allocate tile offsets\n");
+        return EXIT_FAILURE;
+    }
+    for (uint64_t j = 0; j < cols_b; j++)
+    {
+        uint64_t position = plan->b_col_starts[j];
+        const uint64_t col_end = plan->b_col_starts[j + 1];
+        for (uint64_t t = 0; t <= tiling->nr_tiles; t++)
+        {
+            while (position < col_end && ellpack_index(matr_b, position) < t * tiling->size) position++;
+            tiling->tile_starts[t * cols_b + j] = position;
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
 /**
- * Helper that parses the next row of a matrix into the array pointer passed (state is kept in start_indices)
- * @param result_ptr: pointer to an array of size cols where the row will be written to
- * @param mat: the matrix we are parsing from (is not modified)
- * @param start_indices: an array of size cols where the start index of each column is stored (for each column, the indices less than this index (exclusive) have already been parsed to a previous row)
- * @param found: a pointer to a boolean that will be set to true if a row was found
- * @returns the found row index
+ * Tiled variant of multiply_row_range: for each row, the dot products are computed tile by tile and summed up,
+ * so the gathers into the row cache stay within one cache-sized part of it.
+ * @param plan Shared data of the multiplication (matrices have to be validated already)
+ * @param tiling Tile offsets of b built with build_tiling
+ * @param result_columns result_mat the rows are pushed to (in ascending row order per column)
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. On failure, result_columns is not freed
  */
-uint64_t next_row(float *result_ptr, const const_ELLPACKMatrix* mat, uint64_t* start_indices, bool* found)
+static int multiply_tiled_range(const row_product_plan *plan, const shared_dim_tiling *tiling, result_mat *result_columns, uint64_t row_begin, uint64_t row_end)
 {
-    /* optimizations not done:
-    - simd doesn't make too much sense here since with the start_indices, we don't need to scan a lot of neighboring elements in each column
-    - row major *result_ptr would only be useful in case the matrix is very wide, which is inefficient in column major ellpack anyways
-        -> this "dense" format is better for most cases since it offers easy access to the columns of the row
-    */
+    int status = EXIT_FAILURE;
+    const const_ELLPACKMatrix *matr_b = plan->matr_b;
+    const ellpack_row_index *a_rows = &plan->a_rows;
+    const uint32_t matr_b_cols = matr_b->nr_cols;
 
-    // an array with data on how many elements each column has -> see format description for more details
-    const uint64_t *src_col_sizes = mat->nr_of_non_zeros_per_col;
-    // how many columns we have -> is the size of the src_col_sizes array and the result_ptr array
-    uint64_t cols = mat->nr_cols;
-    // ellpack indices from src matrix
-    const uint64_t *src_indices = mat->indices;
-    // ellpack values from src matrix
-    const float *src_values = mat->values;
+    /* init work: all variables with data that has to be freed */
+    float *row_cache = huge_page_calloc(plan->matr_a->nr_cols, sizeof(float));
+    // sums of the partial dot products of all tiles
+    float *row_result = malloc(matr_b_cols * sizeof(float));
+    // partial dot products of the current tile
+    float *tile_result = malloc(matr_b_cols * sizeof(float));
+    bool *candidate_mark = calloc(matr_b_cols, sizeof(bool));
+    uint32_t *candidates = malloc(matr_b_cols * sizeof(uint32_t));
+    if (row_cache == NULL || row_result == NULL || tile_result == NULL || candidate_mark == NULL || candidates == NULL)
+    {
+        fprintf(stderr, "Could not allocate row cache\n");
+        goto cleanup;
+    }
+    /* init end */
 
+    for (uint64_t i = row_begin; i < row_end; i++)
+    {
+        if (a_rows->row_starts[i] == a_rows->row_starts[i + 1]) continue; //skip the row if it is empty
+        uint64_t nr_candidates = find_candidate_cols(plan, i, i + 1, candidate_mark, candidates);
+        const uint32_t *cols = candidates;
+        if (nr_candidates == UINT64_MAX)
+        { // all columns
+            cols = NULL;
+            nr_candidates = matr_b_cols;
+        }
+        memset(row_result, 0, nr_candidates * sizeof(float));
 
-    uint64_t row_idx = find_lowest_row_idx(mat, start_indices, found); //found is set to true if we found a row
+        // the row index stores each row in ascending column order, so the entries of one tile are consecutive
+        uint64_t k = a_rows->row_starts[i];
+        while (k < a_rows->row_starts[i + 1])
+        {
+            uint64_t tile = a_rows->cols[k] / tiling->size;
+            uint64_t tile_begin = k;
+            for (; k < a_rows->row_starts[i + 1] && a_rows->cols[k] / tiling->size == tile; k++)
+            {
+                row_cache[a_rows->cols[k]] = a_rows->values[k];
+            }
+            const uint64_t *tile_starts = tiling->tile_starts + tile * matr_b_cols;
+            plan->row_kernel(row_cache, matr_b, tile_starts, tile_starts + matr_b_cols, cols, nr_candidates, tile_result);
+            for (uint64_t t = 0; t < nr_candidates; t++)
+            {
+                row_result[t] += tile_result[t];
+            }
+            for (uint64_t cleared = tile_begin; cleared < k; cleared++)
+            {
+                row_cache[a_rows->cols[cleared]] = 0;
+            }
+        }
 
-    if(!*found) {
-        return 0; //invalid because of the found check
+        for (uint64_t t = 0; t < nr_candidates; t++)
+        {
+            uint32_t j = cols != NULL ? cols[t] : t;
+            float result_value = row_result[t];
+            if (!(fabs(result_value) < EPSILON))
+            {
+                if (__builtin_expect(store_result(result_columns, NULL, result_value, i, j) == EXIT_FAILURE, 0))
+                {
+                    goto cleanup;
+                }
+            }
+        }
     }
+    status = EXIT_SUCCESS;
 
-    // i is index in the src values/indices arrays (in the entire matrix)
-    for (uint32_t col_idx = 0, i = 0; col_idx < cols; col_idx++) //this is 32 because it is checked in matrix validator
+cleanup:
+    free(candidates);
+    free(candidate_mark);
+    free(tile_result);
+    free(row_result);
+    free(row_cache);
+    return status;
+}
+
+/**
+ * SELL-C-sigma variant of multiply_row_range: the dot products are computed chunk by chunk, SELL_CHUNK columns of b per SIMD pass.
+ * Chunks without a candidate column are skipped. The overflow of the columns that are longer than the chunks is added
+ * with the row kernel of the plan.
+ * @param plan Shared data of the multiplication (matrices have to be validated already)
+ * @param sell SELL copy of b
+ * @param sell_kernel Kernel computing the dot products of a row with chunks of sell
+ * @param result_columns result_mat the rows are pushed to (in ascending row order per column)
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. On failure, result_columns is not freed
+ */
+static int multiply_sell_range(const row_product_plan *plan, const sell_matrix *sell, sell_kernel_func sell_kernel, result_mat *result_columns, uint64_t row_begin, uint64_t row_end)
+{
+    int status = EXIT_FAILURE;
+    const ellpack_row_index *a_rows = &plan->a_rows;
+    const uint32_t matr_b_cols = plan->matr_b->nr_cols;
+
+    /* init work: all variables with data that has to be freed */
+    float *row_cache = huge_page_calloc(plan->matr_a->nr_cols, sizeof(float));
+    float *slot_result = malloc((sell->nr_chunks * SELL_CHUNK > 0 ? sell->nr_chunks * SELL_CHUNK : 1) * sizeof(float));
+    bool *candidate_mark = calloc(matr_b_cols, sizeof(bool));
+    uint32_t *candidates = malloc(matr_b_cols * sizeof(uint32_t));
+    bool *chunk_mark = calloc(sell->nr_chunks > 0 ? sell->nr_chunks : 1, sizeof(bool));
+    uint32_t *chunks = malloc((sell->nr_chunks > 0 ? sell->nr_chunks : 1) * sizeof(uint32_t));
+    uint32_t *overflow_candidates = malloc((sell->nr_overflow_cols > 0 ? sell->nr_overflow_cols : 1) * sizeof(uint32_t));
+    float *overflow_result = malloc((sell->nr_overflow_cols > 0 ? sell->nr_overflow_cols : 1) * sizeof(float));
+    if (row_cache == NULL || slot_result == NULL || candidate_mark == NULL || candidates == NULL || chunk_mark == NULL || chunks == NULL ||
+        overflow_candidates == NULL || overflow_result == NULL)
     {
-        uint64_t col_size = src_col_sizes[col_idx]; // how many elements the current column has
-        uint64_t col_offset = start_indices[col_idx];
+        fprintf(stderr, "Could not allocate row cache\n");
+        goto cleanup;
+    }
+    /* init end */
 
-        float col_result = 0;
-        int matrix_index = i + col_offset;
-        if(col_size > 0 && col_offset < col_size && src_indices[matrix_index] == row_idx){
-            col_result = src_values[matrix_index];
-            start_indices[col_idx]++; // store that we found a value in this column
+    for (uint64_t i = row_begin; i < row_end; i++)
+    {
+        if (a_rows->row_starts[i] == a_rows->row_starts[i + 1]) continue; //skip the row if it is empty
+        uint64_t nr_candidates = find_candidate_cols(plan, i, i + 1, candidate_mark, candidates);
+        const uint32_t *cols = candidates;
+        const uint32_t *chunk_list = NULL;
+        uint64_t nr_chunks = sell->nr_chunks;
+        if (nr_candidates == UINT64_MAX)
+        { // all columns
+            cols = NULL;
+            nr_candidates = matr_b_cols;
+        }
+        else
+        { // the chunks that hold at least one candidate
+            nr_chunks = 0;
+            for (uint64_t t = 0; t < nr_candidates; t++)
+            {
+                uint32_t chunk = sell->slot_of_col[candidates[t]] / SELL_CHUNK;
+                if (!chunk_mark[chunk])
+                {
+                    chunk_mark[chunk] = true;
+                    chunks[nr_chunks++] = chunk;
+                }
+            }
+            for (uint64_t t = 0; t < nr_chunks; t++)
+            {
+                chunk_mark[chunks[t]] = false;
+            }
+            chunk_list = chunks;
+        }
+
+        fill_row_cache(row_cache, a_rows, i);
+        sell_kernel(row_cache, sell, chunk_list, nr_chunks, slot_result);
+        if (sell->nr_overflow_cols > 0)
+        { // only the overflow of candidate columns is needed, their chunks have been computed
+            const uint32_t *overflow_cols = sell->overflow_cols;
+            uint64_t nr_overflow = sell->nr_overflow_cols;
+            if (cols != NULL)
+            {
+                nr_overflow = 0;
+                for (uint64_t t = 0; t < nr_candidates; t++)
+                {
+                    if (sell->overflow_end[cols[t]] > sell->overflow_begin[cols[t]]) overflow_candidates[nr_overflow++] = cols[t];
+                }
+                overflow_cols = overflow_candidates;
+            }
+            plan->row_kernel(row_cache, plan->matr_b, sell->overflow_begin, sell->overflow_end, overflow_cols, nr_overflow, overflow_result);
+            for (uint64_t t = 0; t < nr_overflow; t++)
+            {
+                slot_result[sell->slot_of_col[overflow_cols[t]]] += overflow_result[t];
+            }
+        }
+
+        for (uint64_t t = 0; t < nr_candidates; t++)
+        {
+            uint32_t j = cols != NULL ? cols[t] : t;
+            float result_value = slot_result[sell->slot_of_col[j]];
+            if (!(fabs(result_value) < EPSILON))
+            {
+                if (__builtin_expect(store_result(result_columns, NULL, result_value, i, j) == EXIT_FAILURE, 0))
+                {
+                    goto cleanup;
+                }
+            }
         }
-        result_ptr[col_idx] = col_result; // this is always executed and fills the array with 0s if necessary
-
-        i += col_size;
-    }
-    return row_idx;
-}
-
-static inline float dot_product(const float *row_cache, const uint64_t *col_indices, const float *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
-    float result_value = 0;
-    // for each element in the column
-    for (uint64_t b_col_offset = 0; b_col_offset < col_num_elts; b_col_offset++) {
-        uint64_t ellpack_idx_in_b = col_start_idx + b_col_offset;
-        float row_value = row_cache[col_indices[ellpack_idx_in_b]];
-        result_value += row_value * col_values[ellpack_idx_in_b];
-    }
-    return result_value;
-}
-
-static inline float dot_product_simd(const float *row_cache, const uint64_t *col_indices, const float *col_values, const uint64_t col_start_idx, const uint64_t col_num_elts) {
-     __m128 result_vector = _mm_setzero_ps();
-     uint64_t b_col_offset = 0;
-     // for each element in the column
-     for (; b_col_offset + 4 <= col_num_elts; b_col_offset += 4) {
-
-         //step 1: load the corresponding row values into a vector
-         uint64_t idx0 = col_start_idx + b_col_offset;
-         uint64_t idx1 = col_start_idx + b_col_offset + 1;
-         uint64_t idx2 = col_start_idx + b_col_offset + 2;
-         uint64_t idx3 = col_start_idx + b_col_offset + 3;
-
-         __m128 row_vector = _mm_set_ps(
-             row_cache[col_indices[idx3]],
-             row_cache[col_indices[idx2]],
-             row_cache[col_indices[idx1]],
-             row_cache[col_indices[idx0]]
-         );
-         //step 2: load the column values into a vector
-         __m128 value_vector = _mm_loadu_ps(&col_values[idx0]);
-         //step 3: multiply the vectors and add the result to the result vector
-         __m128 product_vector = _mm_mul_ps(row_vector, value_vector);
-         //step 4: add the product to the result vector
-         result_vector = _mm_add_ps(result_vector, product_vector);
-     }
-     // aggregate the result vector to a single float
-     result_vector = _mm_hadd_ps(result_vector, result_vector);
-     result_vector = _mm_hadd_ps(result_vector, result_vector);
-     float result_value = _mm_cvtss_f32(result_vector);
-
-     // process remaining elements
-     for (; b_col_offset < col_num_elts; b_col_offset++) {
-         uint64_t ellpack_idx_in_b = col_start_idx + b_col_offset;
-         float row_value = row_cache[col_indices[ellpack_idx_in_b]];
-         result_value += row_value * col_values[ellpack_idx_in_b];
-     }
-
-     return result_value;
+        clear_row_cache(row_cache, a_rows, i);
+    }
+    status = EXIT_SUCCESS;
+
+cleanup:
+    free(overflow_result);
+    free(overflow_candidates);
+    free(chunks);
+    free(chunk_mark);
+    free(candidates);
+    free(candidate_mark);
+    free(slot_result);
+    free(row_cache);
+    return status;
 }
 
 /**
- * Main implementation, without simd
- * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
- * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
- * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * Register-blocked variant of multiply_row_range: PANEL_ROWS consecutive rows of a are written into an interleaved panel,
+ * so every element of a column of b that is loaded feeds PANEL_ROWS multiplications instead of one.
+ * @param plan Shared data of the multiplication (matrices have to be validated already)
+ * @param panel_kernel Kernel computing the dot products of the panel with the columns of b
+ * @param result_columns result_mat the rows are pushed to (in ascending row order per column)
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. On failure, result_columns is not freed
  */
-void matr_mult_ellpack_main(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const bool simd)
+static int multiply_panel_range(const row_product_plan *plan, panel_kernel_func panel_kernel, result_mat *result_columns, uint64_t row_begin, uint64_t row_end)
 {
-    //set to null for cleanup
-    float *row_cache = NULL;
-    uint64_t *start_indices = NULL;
+    int status = EXIT_FAILURE;
+    const const_ELLPACKMatrix *matr_b = plan->matr_b;
+    const ellpack_row_index *a_rows = &plan->a_rows;
+    const uint32_t matr_b_cols = matr_b->nr_cols;
+
+    /* init work: all variables with data that has to be freed */
+    // panel[k * PANEL_ROWS + r] holds element k of row (panel_begin + r), zeroed and cleared sparsely like the row cache
+    float *panel = huge_page_calloc(plan->matr_a->nr_cols * PANEL_ROWS, sizeof(float));
+    float *panel_result = malloc((uint64_t) matr_b_cols * PANEL_ROWS * sizeof(float));
+    bool *candidate_mark = calloc(matr_b_cols, sizeof(bool));
+    uint32_t *candidates = malloc(matr_b_cols * sizeof(uint32_t));
+    if (panel == NULL || panel_result == NULL || candidate_mark == NULL || candidates == NULL)
+    {
+        fprintf(stderr, "Could not allocate row panel\n");
+        goto cleanup;
+    }
+    /* init end */
+
+    for (uint64_t panel_begin = row_begin; panel_begin < row_end; panel_begin += PANEL_ROWS)
+    {
+        uint64_t panel_end = panel_begin + PANEL_ROWS < row_end ? panel_begin + PANEL_ROWS : row_end;
+        if (a_rows->row_starts[panel_begin] == a_rows->row_starts[panel_end]) continue; //skip the panel if all rows are empty
+        uint64_t nr_candidates = find_candidate_cols(plan, panel_begin, panel_end, candidate_mark, candidates);
+        const uint32_t *cols = candidates;
+        if (nr_candidates == UINT64_MAX)
+        { // all columns
+            cols = NULL;
+            nr_candidates = matr_b_cols;
+        }
 
+        for (uint64_t i = panel_begin; i < panel_end; i++)
+        {
+            for (uint64_t k = a_rows->row_starts[i]; k < a_rows->row_starts[i + 1]; k++)
+            {
+                panel[(uint64_t) a_rows->cols[k] * PANEL_ROWS + (i - panel_begin)] = a_rows->values[k];
+            }
+        }
+        panel_kernel(panel, matr_b, plan->b_col_starts, cols, nr_candidates, panel_result);
+
+        for (uint64_t t = 0; t < nr_candidates; t++)
+        {
+            uint32_t j = cols != NULL ? cols[t] : t;
+            for (uint64_t i = panel_begin; i < panel_end; i++)
+            {
+                float result_value = panel_result[t * PANEL_ROWS + (i - panel_begin)];
+                if (!(fabs(result_value) < EPSILON))
+                {
+                    if (__builtin_expect(store_result(result_columns, NULL, result_value, i, j) == EXIT_FAILURE, 0))
+                    {
+                        goto cleanup;
+                    }
+                }
+            }
+        }
+
+        for (uint64_t k = a_rows->row_starts[panel_begin]; k < a_rows->row_starts[panel_end]; k++)
+        {
+            // the row of entry k does not matter, the whole line of the panel is cleared
+            memset(&panel[(uint64_t) a_rows->cols[k] * PANEL_ROWS], 0, PANEL_ROWS * sizeof(float));
+        }
+    }
+    status = EXIT_SUCCESS;
+
+cleanup:
+    free(candidates);
+    free(candidate_mark);
+    free(panel_result);
+    free(panel);
+    return status;
+}
+
+/**
+ * Checks the matrices before the sorted multiplication.
+ * @returns 1 if the multiplication can continue, 0 if the result is already valid (empty matrix) and -1 on error
+ */
+static int check_sorted_multiplication(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b)
+{
     //check if one of the matrices is completely empty
     if(matr_a->nr_ellpack_elts == 0 || matr_b->nr_ellpack_elts == 0){
-        return; //the initial state of result_mat is valid
+        return 0; //the initial state of result_mat is valid
     }
-    
+
     //check validity of the matrices
     int continue_status = check_ellpack_multiplication(matr_a, matr_b, true);
-    if(continue_status == 0) goto cleanup_error;
+    if(continue_status == 0) return -1;
     else if(continue_status == 2) { //width of one of the matrices is more than UINT32_MAX
         fprintf(stderr, "Multiplication aborted due to wide columns\n");
-        goto cleanup_error;
+        return -1;
     }
+    return 1;
+}
 
-    const uint32_t matr_b_cols = matr_b->nr_cols;
+/**
+ * Main implementation, without simd
+ * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
+ * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
+ * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
+ */
+void matr_mult_ellpack_main(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context, const bool simd)
+{
+    row_kernel_func row_kernel = simd ? get_simd_row_kernel(matr_b) : row_kernel_scalar;
+    int check_status = check_sorted_multiplication(matr_a, matr_b);
+    if (check_status == 0) return;
 
-    /* init work: all variables with data that has to be freed */
-    /** row cache: since reading a row from a column-major */    
-    row_cache = malloc(matr_a->nr_cols * sizeof(float));
-    if (row_cache == NULL)
+    row_product_plan plan = { .a_rows = get_empty_row_index(), .b_rows = get_empty_row_index(), .b_col_starts = NULL };
+    if (check_status < 0 || init_row_product_plan(&plan, matr_a, matr_b, row_kernel, context) == EXIT_FAILURE ||
+        multiply_row_range(&plan, result_columns, NULL, 0, matr_a->nr_rows) == EXIT_FAILURE)
     {
-        fprintf(stderr, "Could not allocate row cache\n");
-        goto cleanup_error;
+        free_result_mat(result_columns); //sets the cols pointer to NULL, indicating that an error occured and result_mat cannot be written to the file
     }
+    free_row_product_plan(&plan);
+}
+
+/**
+ * Register-blocked implementation: multiplies PANEL_ROWS rows of a at once with every column of b (-V 6)
+ * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
+ * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
+ * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
+ */
+void matr_mult_ellpack_main_panel(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context)
+{
+    int check_status = check_sorted_multiplication(matr_a, matr_b);
+    if (check_status == 0) return;
 
-    //an array to make find_row more efficient
-    start_indices = calloc(matr_a->nr_cols, sizeof(uint64_t));
-    if (start_indices == NULL)
+    row_product_plan plan = { .a_rows = get_empty_row_index(), .b_rows = get_empty_row_index(), .b_col_starts = NULL };
+    if (check_status < 0 || init_row_product_plan(&plan, matr_a, matr_b, row_kernel_scalar, context) == EXIT_FAILURE ||
+        multiply_panel_range(&plan, get_simd_panel_kernel(matr_b), result_columns, 0, matr_a->nr_rows) == EXIT_FAILURE)
     {
-        fprintf(stderr, "Could not allocate start indices\n");
-        goto cleanup_error;
+        free_result_mat(result_columns);
     }
-    /* init end */
-    
-    bool found = false;
-    uint64_t i = next_row(row_cache, matr_a, start_indices, &found);
-    // in the following code, i is index in a (row loop), j is index in b (column loop)
-    // for each row in a
-    while (found)    
+    free_row_product_plan(&plan);
+}
+
+/**
+ * Cache-blocked implementation: the shared dimension is split into tiles that fit into the L2 cache (-V 7)
+ * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
+ * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
+ * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
+ */
+void matr_mult_ellpack_main_tiled(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context)
+{
+    int check_status = check_sorted_multiplication(matr_a, matr_b);
+    if (check_status == 0) return;
+
+    row_product_plan plan = { .a_rows = get_empty_row_index(), .b_rows = get_empty_row_index(), .b_col_starts = NULL };
+    shared_dim_tiling tiling = { .tile_starts = NULL };
+    if (check_status < 0 || init_row_product_plan(&plan, matr_a, matr_b, get_simd_row_kernel(matr_b), context) == EXIT_FAILURE ||
+        build_tiling(&plan, &tiling) == EXIT_FAILURE ||
+        multiply_tiled_range(&plan, &tiling, result_columns, 0, matr_a->nr_rows) == EXIT_FAILURE)
     {
-        uint64_t b_col_start = 0;
+        free_result_mat(result_columns);
+    }
+    free(tiling.tile_starts);
+    free_row_product_plan(&plan);
+}
 
-        // for each column -> is uint32_t because this is checked in the matrix validator
-        for (uint32_t j = 0; j < matr_b_cols; j++)
-        {
-            uint64_t num_col_elts = matr_b->nr_of_non_zeros_per_col[j];
-            float result_value = 
-                simd ? dot_product_simd(row_cache, matr_b->indices, matr_b->values, b_col_start, num_col_elts)
-                : dot_product(row_cache, matr_b->indices, matr_b->values, b_col_start, num_col_elts);
-            b_col_start += num_col_elts;
+/**
+ * SELL-C-sigma implementation: b is converted to SELL_CHUNK-wide slices, so short columns still fill the SIMD lanes (-V 8)
+ * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
+ * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
+ * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
+ */
+void matr_mult_ellpack_sell(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context)
+{
+    int check_status = check_sorted_multiplication(matr_a, matr_b);
+    if (check_status == 0) return;
 
-            if (!(fabs(result_value) < EPSILON)) //for result_value == 0, we do not need to store it due to ellpack
+    row_product_plan plan = { .a_rows = get_empty_row_index(), .b_rows = get_empty_row_index(), .b_col_starts = NULL };
+    sell_matrix sell = get_empty_sell_matrix();
+    if (check_status < 0 || init_row_product_plan(&plan, matr_a, matr_b, get_simd_row_kernel(matr_b), context) == EXIT_FAILURE ||
+        build_sell_matrix(matr_b, &sell) == EXIT_FAILURE ||
+        multiply_sell_range(&plan, &sell, get_simd_sell_kernel(matr_b), result_columns, 0, matr_a->nr_rows) == EXIT_FAILURE)
+    {
+        free_result_mat(result_columns);
+    }
+    free_sell_matrix(&sell);
+    free_row_product_plan(&plan);
+}
+
+/**
+ * Checks whether all values of a matrix are finite. Only then is a dot product without a structural non-zero exactly 0
+ * (0 * inf would be NaN), so the symbolic phase gives a bound the kernels cannot exceed.
+ */
+static bool has_finite_values(const const_ELLPACKMatrix *mat)
+{
+    for (uint64_t k = 0; k < mat->total_non_zero_nr; k++)
+    {
+        if (!isfinite(ellpack_value(mat, k))) return false;
+    }
+    return true;
+}
+
+/** Work package of a single thread in matr_mult_ellpack_main_parallel */
+typedef struct {
+    const row_product_plan *plan;
+    result_mat *result;        ///< shared by all threads, every thread writes to its own slice of each column
+    unsigned int *col_cursors; ///< per column of b: first the number of results of the rows, then the next free position of the slice
+    uint64_t row_begin;
+    uint64_t row_end;
+    int status;
+} row_range_task;
+
+/**
+ * Symbolic phase of one row range: counts the structural non-zeros of the rows [row_begin, row_end) in every column of b.
+ */
+static void *row_range_count_worker(void *arg)
+{
+    row_range_task *task = arg;
+    const ellpack_row_index *a_rows = &task->plan->a_rows;
+    const ellpack_row_index *b_rows = &task->plan->b_rows;
+    // row + 1 that was counted last in every column (0: none)
+    uint64_t *last_row = calloc(task->plan->matr_b->nr_cols, sizeof(uint64_t));
+    if (last_row == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for the symbolic phase\n");
+        task->status = EXIT_FAILURE;
+        return NULL;
+    }
+    for (uint64_t i = task->row_begin; i < task->row_end; i++)
+    {
+        for (uint64_t k = a_rows->row_starts[i]; k < a_rows->row_starts[i + 1]; k++)
+        {
+            uint32_t shared_idx = a_rows->cols[k];
+            for (uint64_t b_idx = b_rows->row_starts[shared_idx]; b_idx < b_rows->row_starts[shared_idx + 1]; b_idx++)
             {
-                // push the result to the result matrix -> error is extremely unlikely here
-                bool push_status = __builtin_expect(push_to_matrix(result_columns, result_value, i, j) == EXIT_FAILURE, 0);
-                if(push_status == EXIT_FAILURE){
-                    goto cleanup_error;
-                }
+                uint32_t j = b_rows->cols[b_idx];
+                task->col_cursors[j] += last_row[j] != i + 1;
+                last_row[j] = i + 1;
             }
         }
-        i = next_row(row_cache, matr_a, start_indices, &found);
     }
+    free(last_row);
+    task->status = EXIT_SUCCESS;
+    return NULL;
+}
 
-    goto cleanup;
-cleanup_error:
-    free_result_mat(result_columns); //sets the cols pointer to NULL, indicating that an error occured and result_mat cannot be written to the file
-cleanup:
-    free(start_indices);
-    free(row_cache);
+static void *row_range_worker(void *arg)
+{
+    row_range_task *task = arg;
+    task->status = multiply_row_range(task->plan, task->result, task->col_cursors, task->row_begin, task->row_end);
+    return NULL;
 }
 
-/* Unsorted implementation 
-Some of the code here is duplicated from the sorted implementation, but the code is not easily reusable due to the different structure of the matrices and assumptions
-*/
+/**
+ * Runs worker on every task, one thread per task.
+ * @returns true if all tasks succeeded
+ */
+static bool run_row_range_tasks(void *(*worker)(void *), row_range_task *tasks, uint64_t nr_tasks)
+{
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS];
+    for (uint64_t t = 0; t < nr_tasks; t++)
+    {
+        tasks[t].status = EXIT_FAILURE;
+        started[t] = pthread_create(&threads[t], NULL, worker, &tasks[t]) == 0;
+        if (!started[t]) worker(&tasks[t]); // runs on the calling thread instead
+    }
+    bool success = true;
+    for (uint64_t t = 0; t < nr_tasks; t++)
+    {
+        if (started[t]) pthread_join(threads[t], NULL);
+        success = success && tasks[t].status == EXIT_SUCCESS;
+    }
+    return success;
+}
 
 /**
- * Helper that parses the ith row of a matrix and also works with unsorted indices. Is very inefficient but also works for unsorted indices.
- * @param row_idx: the row we are parsing
- * @param result_ptr: pointer to an array of size cols where the row will be written to
- * @param mat: the matrix we are parsing from (is not modified)
- * @param start_indices: an array of size cols where the start index of each column is stored (for each column, the indices below this index have already been parsed to a previous row)
- * @returns 0 (false) if no elements were found in this row (entire row multiplication can be skipped) for this row
+ * Splits the rows of a into nr_tasks contiguous ranges with about the same number of non-zeros (one per task).
  */
-bool get_row(float *result_ptr, uint64_t row_idx, const const_ELLPACKMatrix* mat)
+static void split_row_ranges(const ellpack_row_index *a_rows, uint64_t nr_rows, row_range_task *tasks, uint64_t nr_tasks)
 {
-    // an array with data on how many elements each column has -> see format description for more details
-    const uint64_t *src_col_sizes = mat->nr_of_non_zeros_per_col;
-    // how many columns we have -> is the size of the src_col_sizes array and the result_ptr array
-    uint64_t cols = mat->nr_cols;
-    // ellpack indices from src matrix
-    const uint64_t *src_indices = mat->indices;
-    // ellpack values from src matrix
-    const float *src_values = mat->values;
+    const uint64_t total_non_zeros = a_rows->row_starts[nr_rows];
+    for (uint64_t t = 0, row = 0; t < nr_tasks; t++)
+    {
+        // the range ends at the first row where the prefix sum of non-zeros reaches the share of this task
+        uint64_t row_end = nr_rows;
+        if (t != nr_tasks - 1)
+        {
+            uint64_t target = total_non_zeros / nr_tasks * (t + 1);
+            uint64_t low = row;
+            uint64_t high = nr_rows;
+            while (low < high)
+            {
+                uint64_t mid = low + (high - low) / 2;
+                if (a_rows->row_starts[mid] < target) low = mid + 1;
+                else high = mid;
+            }
+            row_end = low;
+        }
+        tasks[t].row_begin = row;
+        tasks[t].row_end = row_end;
+        row = row_end;
+    }
+}
 
-    int i = 0; // i is index in the src values/indices arrays (in the entire matrix)
-    bool found_value = false;
-    for (uint64_t col_idx = 0; col_idx < cols; col_idx++)
+/**
+ * Multiplies a with one block of columns of b, the row ranges of the tasks in parallel: every task counts the results of
+ * its rows per column, each column of the block gets one exactly sized slice per task (in range order), the tasks write
+ * straight into their slices, and the gaps that values which cancel out to 0 leave at the end of a slice are closed.
+ * @param block_b columns of b (a view), block_result the same columns of the result (a view into result_columns)
+ * @param first_col column of result_columns that corresponds to the first column of the block
+ * @param slices scratch of 2 * nr_tasks * block_b->nr_cols entries
+ * @returns EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int multiply_col_block_parallel(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *block_b, result_mat *result_columns, result_mat *block_result, uint64_t first_col,
+                                       const matmul_context *context, row_range_task *tasks, uint64_t nr_tasks, unsigned int *slices)
+{
+    const uint64_t block_cols = block_b->nr_cols;
+    // the row indices and the kernel are shared by all threads (selected before the threads start)
+    row_product_plan plan;
+    bool error_occured = init_row_product_plan(&plan, matr_a, block_b, get_simd_row_kernel(block_b), context) == EXIT_FAILURE;
+    // counts and cursors of all tasks, followed by the first position of every slice (to close the gaps)
+    unsigned int *slice_begins = slices + nr_tasks * block_cols;
+    memset(slices, 0, nr_tasks * block_cols * sizeof(unsigned int));
+    for (uint64_t t = 0; t < nr_tasks; t++)
     {
-        uint64_t col_size = src_col_sizes[col_idx]; // how many elements the current column has
+        tasks[t].plan = &plan;
+        tasks[t].result = block_result;
+        tasks[t].col_cursors = slices + t * block_cols;
+    }
 
-        float col_result = 0.0f;
+    error_occured = error_occured || !run_row_range_tasks(row_range_count_worker, tasks, nr_tasks);
 
-        // for an empty column (only 0s), this will just be skipped
-        uint64_t j = 0;
-        for (; j < col_size; j++)
+    // every column gets room for all counts, the slices follow each other
+    for (uint64_t j = 0; !error_occured && j < block_cols; j++)
+    {
+        uint64_t col_total = 0;
+        for (uint64_t t = 0; t < nr_tasks; t++) col_total += tasks[t].col_cursors[j];
+        if (reserve_result_col(result_columns, first_col + j, col_total) == EXIT_FAILURE)
+        {
+            error_occured = true;
+            break;
+        }
+        unsigned int position = result_columns->cols[first_col + j].used_height;
+        for (uint64_t t = 0; t < nr_tasks; t++)
+        {
+            unsigned int count = tasks[t].col_cursors[j];
+            tasks[t].col_cursors[j] = position;
+            slice_begins[t * block_cols + j] = position;
+            position += count;
+        }
+    }
+
+    error_occured = error_occured || !run_row_range_tasks(row_range_worker, tasks, nr_tasks);
+
+    // the cursors end behind the last value of every slice; move the slices together if values were dropped
+    for (uint64_t j = 0; !error_occured && j < block_cols; j++)
+    {
+        result_col *col = &result_columns->cols[first_col + j];
+        unsigned int used = col->used_height;
+        for (uint64_t t = 0; t < nr_tasks; t++)
         {
-            int matrix_index = i + j;
-            // compare if we are in the correct row, if we are then we have found the result
-            if (src_indices[matrix_index] == row_idx)
+            unsigned int begin = slice_begins[t * block_cols + j];
+            unsigned int length = tasks[t].col_cursors[j] - begin;
+            if (begin != used && length > 0)
             {
-                found_value = true;
-                col_result = src_values[matrix_index];
-                break;
+                memmove(col->values + used, col->values + begin, length * sizeof(float));
+                memmove(col->indices + used, col->indices + begin, length * sizeof(uint64_t));
             }
+            used += length;
         }
-        result_ptr[col_idx] = col_result; // this is always executed and fills the array with 0s if necessary
+        col->used_height = used;
+    }
+
+    free_row_product_plan(&plan);
+    return error_occured ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Parallel version of the main implementation with simd. The rows of a are split into contiguous ranges
+ * with about the same number of non-zeros, one per thread. b is processed in blocks of columns, so that the scratch of the
+ * threads (which grows with threads * columns) stays below PARALLEL_SCRATCH_BYTES; for each block, a symbolic pass of every
+ * thread sizes its slice of every column exactly before the values are written (see multiply_col_block_parallel).
+ * The result only needs columns of height 0 (malloc_init_result_mat_for), the columns are sized here.
+ * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
+ * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
+ * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
+ */
+void matr_mult_ellpack_main_parallel(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context)
+{
+    int check_status = check_sorted_multiplication(matr_a, matr_b);
+    if (check_status == 0) return;
+    if (check_status < 0)
+    {
+        free_result_mat(result_columns);
+        return;
+    }
+
+    // with non-finite values, products outside the structure are NaN and would not fit into the slices
+    if (!has_finite_left_values(matr_a, context->left) || !has_finite_values(matr_b))
+    {
+        if (context->verbose) printf("Non-finite values in the operands, using the serial SIMD implementation\n");
+        matr_mult_ellpack_main_simd(matr_a, matr_b, result_columns, context);
+        return;
+    }
+
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t nr_threads = online_cpus > 0 ? (uint64_t) online_cpus : 1;
+    if (nr_threads > MAX_THREADS) nr_threads = MAX_THREADS;
+    if (nr_threads > matr_a->nr_rows) nr_threads = matr_a->nr_rows;
+    uint64_t block_cols = PARALLEL_SCRATCH_BYTES / (nr_threads * PARALLEL_SCRATCH_PER_COL);
+    if (block_cols > matr_b->nr_cols) block_cols = matr_b->nr_cols > 0 ? matr_b->nr_cols : 1;
+
+    // the row index of a is built once for all blocks (unless the caller already did)
+    left_operand own_left = get_empty_left_operand();
+    matmul_context block_context = *context;
+    bool error_occured = false;
+    if (context->left == NULL)
+    {
+        error_occured = build_left_operand(matr_a, &own_left) == EXIT_FAILURE;
+        block_context.left = &own_left;
+    }
+    unsigned int *slices = error_occured ? NULL : malloc(2 * nr_threads * block_cols * sizeof(unsigned int));
+    if (!error_occured && slices == NULL)
+    {
+        fprintf(stderr, "Could not allocate the column slices of the threads\n");
+        error_occured = true;
+    }
+
+    row_range_task tasks[MAX_THREADS];
+    if (!error_occured) split_row_ranges(&block_context.left->rows, matr_a->nr_rows, tasks, nr_threads);
+
+    for (uint64_t first_col = 0, offset = 0; !error_occured && first_col < matr_b->nr_cols; first_col += block_cols)
+    {
+        uint64_t nr_cols = matr_b->nr_cols - first_col < block_cols ? matr_b->nr_cols - first_col : block_cols;
+        uint64_t nr_non_zeros = 0;
+        for (uint64_t j = first_col; j < first_col + nr_cols; j++) nr_non_zeros += matr_b->nr_of_non_zeros_per_col[j];
+        ELLPACKMatrix block_b = column_range_view((const ELLPACKMatrix *) matr_b, first_col, nr_cols, offset, nr_non_zeros);
+        result_mat block_result = *result_columns;
+        block_result.cols = result_columns->cols + first_col;
+        block_result.cols_len = nr_cols;
+        error_occured = multiply_col_block_parallel(matr_a, (const const_ELLPACKMatrix *) &block_b, result_columns, &block_result, first_col,
+                                                    &block_context, tasks, nr_threads, slices) == EXIT_FAILURE;
+        offset += nr_non_zeros;
+    }
 
-        i += col_size;
+    free(slices);
+    free_left_operand(&own_left);
+    if (error_occured)
+    {
+        free_result_mat(result_columns); //sets the cols pointer to NULL, indicating that an error occured and result_mat cannot be written to the file
     }
-    return found_value;
 }
 
+/* Unsorted implementation
+The row index does not depend on the order of the indices within the columns, so the unsorted implementation only differs
+in the validation and uses the scalar dot product.
+*/
+
 /**
  * Implementation for unsorted ellpack matrices
  * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
  * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
  * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
  */
-void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns)
+void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context)
 {
-    //set to null for cleanup
-    float *row_cache = NULL;
-    uint64_t *start_indices = NULL;
-    
+    //set to empty for cleanup
+    row_product_plan plan = { .a_rows = get_empty_row_index(), .b_rows = get_empty_row_index(), .b_col_starts = NULL };
+
     //check validity of the matrices
     printf("Checking matrices\n");
     int continue_status = check_ellpack_multiplication(matr_a, matr_b, false);
@@ -326,55 +1057,246 @@ void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_E
         }
     }
 
-    const uint32_t matr_b_cols = matr_b->nr_cols;
+    if (init_row_product_plan(&plan, matr_a, matr_b, row_kernel_scalar, context) == EXIT_FAILURE) goto cleanup_error;
+    if (multiply_row_range(&plan, result_columns, NULL, 0, matr_a->nr_rows) == EXIT_FAILURE) goto cleanup_error;
 
-    /* init work: all variables with data that has to be freed */
-    /** row cache: since reading a row from a column-major */    
-    row_cache = malloc(matr_a->nr_cols * sizeof(float));
-    if (row_cache == NULL)
+    goto cleanup;
+cleanup_error:
+    free_result_mat(result_columns); //sets the cols pointer to NULL, indicating that an error occured and result_mat cannot be written to the file
+cleanup:
+    free_row_product_plan(&plan);
+}
+
+/* Gustavson implementation
+Instead of a dot product for every (row of a, column of b) pair, each column j of b is computed as a linear combination
+of the columns of a: result[:, j] = sum over k of b[k, j] * a[:, k]. Since a is stored column-major, these columns can be
+read directly. The work is proportional to the number of multiplications that actually happen, not to rows_a * cols_b.
+*/
+
+/** qsort comparator for row indices */
+static int compare_row_idx(const void *lhs, const void *rhs)
+{
+    uint64_t a = *(const uint64_t *) lhs;
+    uint64_t b = *(const uint64_t *) rhs;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Helper that computes the offset of each column in the values/indices arrays of a matrix.
+ * @returns an array of size cols + 1 that has to be freed, NULL on allocation failure
+ */
+static uint64_t *get_col_starts(const const_ELLPACKMatrix *mat)
+{
+    uint64_t *col_starts = malloc((mat->nr_cols + 1) * sizeof(uint64_t));
+    if (col_starts == NULL)
     {
-        fprintf(stderr, "Could not allocate row cache\n");
+        return NULL;
+    }
+    col_starts[0] = 0;
+    for (uint64_t k = 0; k < mat->nr_cols; k++)
+    {
+        col_starts[k + 1] = col_starts[k] + mat->nr_of_non_zeros_per_col[k];
+    }
+    return col_starts;
+}
+
+/**
+ * Symbolic phase: computes the number of structural non-zeros of every column of a * b (same traversal as the
+ * Gustavson implementation, but without values). This is an exact upper bound for every implementation,
+ * since values that cancel out to 0 are not stored.
+ * @param left data built from a with build_left_operand, or NULL
+ * @param col_heights an array of size b->nr_cols the heights are written to
+ * @returns EXIT_SUCCESS or EXIT_FAILURE (allocation failure)
+ */
+int compute_result_col_heights(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, const left_operand *left, uint64_t *col_heights)
+{
+    uint64_t *a_col_starts = get_left_col_starts(matr_a, left);
+    uint32_t *row_marker = calloc(matr_a->nr_rows, sizeof(uint32_t));
+    int status = EXIT_FAILURE;
+    if (a_col_starts == NULL || row_marker == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for the symbolic phase\n");
+        goto cleanup;
+    }
+
+    uint64_t b_col_start = 0;
+    for (uint32_t j = 0; j < matr_b->nr_cols; j++)
+    {
+        const uint32_t marker = j + 1; // 0 is the initial state of row_marker
+        uint64_t nr_touched = 0;
+        uint64_t num_col_elts = matr_b->nr_of_non_zeros_per_col[j];
+        for (uint64_t b_idx = b_col_start; b_idx < b_col_start + num_col_elts; b_idx++)
+        {
+            uint64_t k = ellpack_index(matr_b, b_idx);
+            for (uint64_t a_idx = a_col_starts[k]; a_idx < a_col_starts[k + 1]; a_idx++)
+            {
+                uint64_t i = ellpack_index(matr_a, a_idx);
+                nr_touched += row_marker[i] != marker;
+                row_marker[i] = marker;
+            }
+        }
+        b_col_start += num_col_elts;
+        col_heights[j] = nr_touched;
+    }
+    status = EXIT_SUCCESS;
+
+cleanup:
+    free(row_marker);
+    release_left_col_starts(a_col_starts, left);
+    return status;
+}
+
+/**
+ * Initializes a result_mat for a * b with exactly sized columns (computed by compute_result_col_heights), so that
+ * the numeric phase never has to reallocate. If all values are finite, the result is marked `exact` and the kernels
+ * append to it without checking the capacity. Falls back to malloc_init_result_mat_from_ellpack if the matrices are
+ * empty or cannot be multiplied (the implementations report these cases).
+ * @param left data built from a with build_left_operand, or NULL
+ */
+result_mat malloc_init_result_mat_symbolic(const ELLPACKMatrix *a, const ELLPACKMatrix *b, const left_operand *left)
+{
+    const const_ELLPACKMatrix *matr_a = (const const_ELLPACKMatrix *) a;
+    const const_ELLPACKMatrix *matr_b = (const const_ELLPACKMatrix *) b;
+    if (matr_a->nr_ellpack_elts == 0 || matr_b->nr_ellpack_elts == 0 ||
+        matr_a->nr_cols != matr_b->nr_rows || matr_a->nr_cols > UINT32_MAX || matr_b->nr_cols > UINT32_MAX)
+    {
+        return malloc_init_result_mat_from_ellpack(a, b);
+    }
+
+    result_mat matrix = { .cols = NULL, .cols_len = 0 };
+    uint64_t *col_heights = malloc(matr_b->nr_cols * sizeof(uint64_t));
+    if (col_heights == NULL || compute_result_col_heights(matr_a, matr_b, left, col_heights) == EXIT_FAILURE)
+    {
+        fprintf(stderr, "Could not compute the result column heights\n");
+    }
+    else
+    {
+        matrix = malloc_init_result_mat_exact(matr_b->nr_cols, col_heights, matr_a->nr_rows);
+        // the heights only bound the kernels if every dot product without a structural non-zero is exactly 0
+        matrix.exact = matrix.cols != NULL && has_finite_left_values(matr_a, left) && has_finite_values(matr_b);
+    }
+    free(col_heights);
+    return matrix;
+}
+
+/**
+ * Initializes the result_mat for a * b that matmul expects: the parallel implementation counts the results of its threads
+ * itself and sizes the columns from these counts, so it starts with columns of height 0; all others get the exactly sized
+ * columns of malloc_init_result_mat_symbolic.
+ */
+result_mat malloc_init_result_mat_for(matmul_func matmul, const ELLPACKMatrix *a, const ELLPACKMatrix *b, const left_operand *left)
+{
+    if (matmul == (matmul_func) matr_mult_ellpack_main_parallel)
+    {
+        return malloc_init_result_mat(b->nr_cols, 0, a->nr_rows);
+    }
+    return malloc_init_result_mat_symbolic(a, b, left);
+}
+
+/**
+ * Implementation based on Gustavson's algorithm with a sparse accumulator. Also works for unsorted indices.
+ * @param matr_a Pointer to an ELLPACKMatrix with the first matrix data
+ * @param matr_b Pointer to an ELLPACKMatrix with the second matrix data
+ * @param result Pointer to a result_mat struct allocated with malloc_init_result_mat. On error, will be "freed" and the cols pointer will be NULL
+ * @param context Settings of the multiplication (see matmul_context)
+ */
+void matr_mult_ellpack_gustavson(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context)
+{
+    //set to null for cleanup
+    uint64_t *a_col_starts = NULL;
+    float *accumulator = NULL;
+    uint32_t *row_marker = NULL;
+    uint64_t *touched_rows = NULL;
+
+    //check if one of the matrices is completely empty
+    if(matr_a->nr_ellpack_elts == 0 || matr_b->nr_ellpack_elts == 0){
+        return; //the initial state of result_mat is valid
+    }
+
+    //check validity of the matrices
+    int continue_status = check_ellpack_multiplication(matr_a, matr_b, false);
+    if(continue_status == 0) goto cleanup_error;
+    else if(continue_status == 2) { //width of one of the matrices is more than UINT32_MAX
+        fprintf(stderr, "Multiplication aborted due to wide columns\n");
         goto cleanup_error;
     }
 
-    //an array to make find_row more efficient
-    start_indices = calloc(matr_a->nr_cols, sizeof(uint64_t));
-    if (start_indices == NULL)
+    const uint32_t matr_b_cols = matr_b->nr_cols;
+    const uint64_t matr_a_rows = matr_a->nr_rows;
+
+    /* init work: all variables with data that has to be freed */
+    // offset of each column of a in the values/indices arrays
+    a_col_starts = get_left_col_starts(matr_a, context->left);
+    // sparse accumulator: dense values + marker which column last wrote a row + list of the rows written in this column
+    accumulator = huge_page_alloc(matr_a_rows * sizeof(float));
+    row_marker = huge_page_calloc(matr_a_rows, sizeof(uint32_t));
+    touched_rows = malloc(matr_a_rows * sizeof(uint64_t));
+    if (a_col_starts == NULL || accumulator == NULL || row_marker == NULL || touched_rows == NULL)
     {
-        fprintf(stderr, "Could not allocate start indices\n");
+        fprintf(stderr, "Could not allocate the sparse accumulator\n");
         goto cleanup_error;
     }
     /* init end */
-    
-    // in the following code, i is index in a (row loop), j is index in b (column loop)
-    // for each row in a
-    for(uint64_t i = 0; i < matr_a->nr_rows; i++)
+
+    // in the following code, j is index in b (column loop), k is the shared index, i is index in a (row loop)
+    uint64_t b_col_start = 0;
+    for (uint32_t j = 0; j < matr_b_cols; j++)
     {
-        uint64_t b_col_start = 0;
-        bool found = get_row(row_cache, i, matr_a);
-        if(!found) continue; //skip the row if it is empty
+        const uint32_t marker = j + 1; // 0 is the initial state of row_marker
+        uint64_t nr_touched = 0;
+        uint64_t num_col_elts = matr_b->nr_of_non_zeros_per_col[j];
 
-        // for each column -> is uint32_t because this is checked in the matrix validator
-        for (uint32_t j = 0; j < matr_b_cols; j++)
+        // scale and accumulate column k of a for every non-zero b[k, j]
+        for (uint64_t b_idx = b_col_start; b_idx < b_col_start + num_col_elts; b_idx++)
         {
-            float result_value = 0;
-            uint64_t num_col_elts = matr_b->nr_of_non_zeros_per_col[j];
-            // for each filled ellpack element
-            for (uint64_t col_elt = 0; col_elt < num_col_elts; col_elt++)
+            uint64_t k = ellpack_index(matr_b, b_idx);
+            float b_value = ellpack_value(matr_b, b_idx);
+            for (uint64_t a_idx = a_col_starts[k]; a_idx < a_col_starts[k + 1]; a_idx++)
             {
-                uint64_t ellpack_idx_in_b = b_col_start + col_elt;
-                float row_value = row_cache[matr_b->indices[ellpack_idx_in_b]];
-                result_value += row_value * matr_b->values[ellpack_idx_in_b];
+                uint64_t i = ellpack_index(matr_a, a_idx);
+                float product = ellpack_value(matr_a, a_idx) * b_value;
+                if (row_marker[i] != marker)
+                { // first contribution to this row in column j
+                    row_marker[i] = marker;
+                    accumulator[i] = product;
+                    touched_rows[nr_touched++] = i;
+                }
+                else
+                {
+                    accumulator[i] += product;
+                }
             }
-            b_col_start += num_col_elts;
+        }
+        b_col_start += num_col_elts;
 
+        // the result columns are expected in ascending row order
+        if (nr_touched * 16 < matr_a_rows)
+        {
+            qsort(touched_rows, nr_touched, sizeof(uint64_t), compare_row_idx);
+        }
+        else
+        { // many rows touched -> scanning the marker is cheaper than sorting
+            nr_touched = 0;
+            for (uint64_t i = 0; i < matr_a_rows; i++)
+            {
+                if (row_marker[i] == marker) touched_rows[nr_touched++] = i;
+            }
+        }
+
+        // make space for the whole column once (never reallocates if the result was sized by the symbolic phase)
+        if (__builtin_expect(reserve_result_col(result_columns, j, nr_touched) == EXIT_FAILURE, 0))
+        {
+            goto cleanup_error;
+        }
+        result_col *col = &result_columns->cols[j];
+        for (uint64_t t = 0; t < nr_touched; t++)
+        {
+            uint64_t i = touched_rows[t];
+            float result_value = accumulator[i];
             if (!(fabs(result_value) < EPSILON)) //for result_value == 0, we do not need to store it due to ellpack
             {
-                // push the result to the result matrix -> error is extremely unlikely here
-                bool push_status = __builtin_expect(push_to_matrix(result_columns, result_value, i, j) == EXIT_FAILURE, 0);
-                if(push_status == EXIT_FAILURE){
-                    goto cleanup_error;
-                }
+                col->values[col->used_height] = result_value;
+                col->indices[col->used_height++] = i;
             }
         }
     }
@@ -383,7 +1305,8 @@ void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_E
 cleanup_error:
     free_result_mat(result_columns); //sets the cols pointer to NULL, indicating that an error occured and result_mat cannot be written to the file
 cleanup:
-    free(start_indices);
-    free(row_cache);
+    free(touched_rows);
+    free(row_marker);
+    free(accumulator);
+    release_left_col_starts(a_col_starts, context->left);
 }
-
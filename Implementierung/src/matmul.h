@@ -14,31 +14,136 @@
  * @param a Pointer to `const_ELLPACKMatrix` left operand.
  * @param b Pointer to `const_ELLPACKMatrix` right operand.
  * @param result Pointer to `result_mat` output accumulator.
+ * @param context Settings of the multiplication.
  */
-void matr_mult_ellpack(const void *a, const void *b, void *result);
+void matr_mult_ellpack(const void *a, const void *b, void *result, const matmul_context *context);
 
 /**
  * @brief Multiply two ELLPACK matrices assuming unsorted column indices.
  * @param matr_a Left operand.
  * @param matr_b Right operand.
  * @param result_columns Accumulator for result columns (pre-initialized).
+ * @param context Settings of the multiplication.
  */
-void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns);
+void matr_mult_ellpack_unsorted(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
 
 /**
  * @brief Main multiplication routine without SIMD acceleration.
  * @param matr_a Left operand.
  * @param matr_b Right operand.
  * @param result_columns Accumulator for result columns (pre-initialized).
+ * @param context Settings of the multiplication.
  */
-void matr_mult_ellpack_main_no_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns);
+void matr_mult_ellpack_main_no_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
 
 /**
  * @brief Main multiplication routine with SIMD acceleration.
  * @param matr_a Left operand.
  * @param matr_b Right operand.
  * @param result_columns Accumulator for result columns (pre-initialized).
+ * @param context Settings of the multiplication.
  */
-void matr_mult_ellpack_main_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns);
+void matr_mult_ellpack_main_simd(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
+
+/**
+ * @brief Multithreaded variant of the SIMD routine that splits the rows of A across worker threads.
+ *        Columns of B are processed in blocks, so the scratch of the threads stays bounded.
+ * @param matr_a Left operand.
+ * @param matr_b Right operand.
+ * @param result_columns Accumulator for result columns (from `malloc_init_result_mat_for`, any heights are accepted).
+ * @param context Settings of the multiplication.
+ */
+void matr_mult_ellpack_main_parallel(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
+
+/**
+ * @brief Register-blocked variant of the SIMD routine: PANEL_ROWS rows of A are multiplied per pass over a column of B,
+ *        so every loaded element of B feeds several multiply-adds.
+ * @param matr_a Left operand.
+ * @param matr_b Right operand.
+ * @param result_columns Accumulator for result columns (pre-initialized).
+ * @param context Settings of the multiplication.
+ */
+void matr_mult_ellpack_main_panel(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
+
+/**
+ * @brief Cache-blocked variant of the SIMD routine for wide A: the shared dimension is split into tiles
+ *        (`context->tile_size`), so the gathers into the row cache of A stay in the L2 cache.
+ *        Partial dot products are summed over the tiles.
+ * @param matr_a Left operand.
+ * @param matr_b Right operand.
+ * @param result_columns Accumulator for result columns (pre-initialized).
+ * @param context Settings of the multiplication.
+ */
+void matr_mult_ellpack_main_tiled(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
+
+/**
+ * @brief SELL-C-sigma variant: B is converted to chunks of `SELL_CHUNK` columns sorted by length
+ *        (see `sell_matrix`), and each SIMD pass computes all columns of a chunk. Suited for short columns.
+ * @param matr_a Left operand.
+ * @param matr_b Right operand (at most UINT32_MAX rows).
+ * @param result_columns Accumulator for result columns (pre-initialized).
+ * @param context Settings of the multiplication.
+ */
+void matr_mult_ellpack_sell(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
+
+/**
+ * @brief Get a `left_operand` without data, which can be freed with `free_left_operand`.
+ */
+left_operand get_empty_left_operand();
+
+/**
+ * @brief Build the row index, column offsets and finiteness of A once, for several multiplications with the same A
+ *        (pass it as `matmul_context::left`).
+ * @param matr_a Left operand, has to stay unchanged while `left` is used.
+ * @param left Output, has to be freed with `free_left_operand`.
+ * @return 0 on success, non-zero on allocation failure.
+ */
+int build_left_operand(const const_ELLPACKMatrix *matr_a, left_operand *left);
+
+/**
+ * @brief Free the data of a `left_operand`.
+ */
+void free_left_operand(left_operand *left);
+
+/**
+ * @brief Gustavson-style multiplication with a sparse accumulator (column of B times columns of A).
+ *        Work scales with the number of multiplications; also works for unsorted column indices.
+ * @param matr_a Left operand.
+ * @param matr_b Right operand.
+ * @param result_columns Accumulator for result columns (pre-initialized).
+ * @param context Settings of the multiplication.
+ */
+void matr_mult_ellpack_gustavson(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, result_mat *result_columns, const matmul_context *context);
+
+/**
+ * @brief Symbolic phase: number of structural non-zeros of every column of A * B.
+ * @param matr_a Left operand (validated, compatible with B).
+ * @param matr_b Right operand.
+ * @param left Data built from A with `build_left_operand`, or NULL to derive it here.
+ * @param col_heights Output array of size `matr_b->nr_cols`.
+ * @return 0 on success, non-zero on allocation failure.
+ */
+int compute_result_col_heights(const const_ELLPACKMatrix *matr_a, const const_ELLPACKMatrix *matr_b, const left_operand *left, uint64_t *col_heights);
+
+/**
+ * @brief Initialize a `result_mat` for A * B whose columns are sized exactly by the symbolic phase.
+ * @param a Left operand.
+ * @param b Right operand.
+ * @param left Data built from A with `build_left_operand`, or NULL to derive it here.
+ * @return Allocated result matrix; `cols` is NULL on allocation failure.
+ */
+result_mat malloc_init_result_mat_symbolic(const ELLPACKMatrix *a, const ELLPACKMatrix *b, const left_operand *left);
+
+/**
+ * @brief Initialize the `result_mat` for A * B that an implementation expects: columns of height 0 for
+ *        `matr_mult_ellpack_main_parallel` (which sizes them from the counts of its threads), otherwise
+ *        `malloc_init_result_mat_symbolic`, so that the structure of the product is only computed once.
+ * @param matmul Implementation the result is passed to.
+ * @param a Left operand.
+ * @param b Right operand.
+ * @param left Data built from A with `build_left_operand`, or NULL.
+ * @return Allocated result matrix; `cols` is NULL on allocation failure.
+ */
+result_mat malloc_init_result_mat_for(matmul_func matmul, const ELLPACKMatrix *a, const ELLPACKMatrix *b, const left_operand *left);
 
 #endif // MATMUL_H
@@ -1,53 +1,307 @@
 #include "../include/ellpack.h"
 #include <stdlib.h>
+#include <inttypes.h>
 #include "matrix_utils.h"
 #include "io.h"
 #include "benchmark.h"
+#include "matmul.h"
+#include "matmul_caller.h"
+#include "chain_planner.h"
+#include "huge_pages.h"
 
 
-int call_matmul(const char* filename_a, const char* filename_b, const char* output_file, int benchmark_iterations, matmul_func matmul) {
-    ELLPACKMatrix mat_a = get_empty_ellpackmatrix();
-    if (read_ellpack_matrix(&mat_a, filename_a))
+/**
+ * Multiplies left * right into a new result_mat. If requested, right is packed first (and both layouts are benchmarked).
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. On failure, result->cols is NULL
+ */
+static int multiply_operands(ELLPACKMatrix *left, ELLPACKMatrix *right, int benchmark_iterations, matmul_func matmul, const matmul_options *options, result_mat *result)
+{
+    result->cols = NULL;
+    const matmul_context context = { .tile_size = options->tile_size, .left = NULL, .verbose = options->verbose };
+    if (options->packed_b)
     {
-        clean_matrix_data(&mat_a);
+        if (benchmark_iterations > 0)
+        { // benchmark the separate index/value arrays on the same data first, so both layouts can be compared
+            result_mat separate_result = malloc_init_result_mat_for(matmul, left, right, NULL);
+            if (separate_result.cols == NULL)
+            {
+                fprintf(stderr, "Could not allocate memory for initial result matrix\n");
+                return EXIT_FAILURE;
+            }
+            printf("Layout of B: separate index and value arrays\n");
+            run_benchmark(benchmark_iterations, left, right, &separate_result, matmul, &context);
+            free_result_mat(&separate_result);
+            printf("Layout of B: packed (index, value) records\n");
+        }
+        if (pack_ellpack_entries(right)) return EXIT_FAILURE;
+    }
+
+    *result = malloc_init_result_mat_for(matmul, left, right, NULL);
+    if (result->cols == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for initial result matrix\n");
         return EXIT_FAILURE;
     }
 
-    //init for cleanup, so that we can always use the cleanup label
+    // MATMUL
+    if(benchmark_iterations > 0) {
+        run_benchmark(benchmark_iterations, left, right, result, matmul, &context);
+    }
+    else {
+        matmul(left, right, result, &context);
+    }
+    // the operands are still alive here, so the report shows whether they got huge pages
+    if (options->verbose) print_huge_page_report(stdout);
+    return result->cols == NULL ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int multiply_subchain(ELLPACKMatrix *operands, const chain_plan *plan, int first, int last, int benchmark_iterations, matmul_func matmul, const matmul_options *options, result_mat *result, uint64_t *result_rows);
+
+/**
+ * Moves the product of the operands first..last into `product`: a single operand is taken over as is,
+ * a longer sub-chain is multiplied and converted in memory.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. `product` has to be freed with clean_matrix_data in both cases
+ */
+static int take_subchain(ELLPACKMatrix *operands, const chain_plan *plan, int first, int last, int benchmark_iterations, matmul_func matmul, const matmul_options *options, ELLPACKMatrix *product)
+{
+    if (first == last)
+    {
+        *product = operands[first];
+        operands[first] = get_empty_ellpackmatrix();
+        return EXIT_SUCCESS;
+    }
     result_mat result_matrix = {
         .cols = NULL,
         .cols_len = 0
     };
+    uint64_t result_rows = 0;
+    int status = multiply_subchain(operands, plan, first, last, benchmark_iterations, matmul, options, &result_matrix, &result_rows);
+    if (status == EXIT_SUCCESS && result_mat_to_ellpack(&result_matrix, result_rows, product)) status = EXIT_FAILURE;
+    free_result_mat(&result_matrix);
+    if (status == EXIT_SUCCESS && !product->sorted && sort_ellpack_columns(product)) status = EXIT_FAILURE;
+    if (status == EXIT_SUCCESS && convert_ellpack_values(product, options->value_format)) status = EXIT_FAILURE;
+    return status;
+}
 
-    ELLPACKMatrix mat_b = get_empty_ellpackmatrix();;
-    if (read_ellpack_matrix(&mat_b, filename_b)) goto cleanup_error;
+/**
+ * Multiplies the operands first..last (first < last) in the order of the plan. The operands that are used are freed.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE. `result` has to be freed with free_result_mat in both cases
+ */
+static int multiply_subchain(ELLPACKMatrix *operands, const chain_plan *plan, int first, int last, int benchmark_iterations, matmul_func matmul, const matmul_options *options, result_mat *result, uint64_t *result_rows)
+{
+    int split = chain_split(plan, first, last);
+    ELLPACKMatrix left = get_empty_ellpackmatrix();
+    ELLPACKMatrix right = get_empty_ellpackmatrix();
+    int status = take_subchain(operands, plan, first, split, benchmark_iterations, matmul, options, &left);
+    if (status == EXIT_SUCCESS) status = take_subchain(operands, plan, split + 1, last, benchmark_iterations, matmul, options, &right);
+    if (status == EXIT_SUCCESS) status = multiply_operands(&left, &right, benchmark_iterations, matmul, options, result);
+    //result_width can be read from result->cols -> save it
+    *result_rows = left.nr_rows;
+    clean_matrix_data(&left);
+    clean_matrix_data(&right);
+    return status;
+}
 
-    result_matrix = malloc_init_result_mat_from_ellpack(&mat_a, &mat_b);
-    if (result_matrix.cols == NULL)
+/** Bytes per stored element of a column block of B: value, 64-bit index, its entry in the row index and a packed record */
+#define OUT_OF_CORE_BYTES_PER_B_ELEMENT 24
+/** Bytes per column of a block of B: counts, offsets and the candidate lists of the kernels */
+#define OUT_OF_CORE_BYTES_PER_B_COL 32
+/** Bytes per element of a result column: 64-bit row index and value */
+#define OUT_OF_CORE_BYTES_PER_RESULT_ELEMENT 12
+/** Bytes per result column besides its elements: column header, symbolic height and row result of the kernels */
+#define OUT_OF_CORE_BYTES_PER_RESULT_COL (sizeof(result_col) + 24)
+
+/**
+ * Memory a loaded left operand needs during the multiplication, including its row index and column offsets (build_left_operand).
+ */
+static uint64_t left_operand_bytes(const ELLPACKMatrix *a)
+{
+    uint64_t element_bytes = (a->values16 != NULL ? sizeof(uint16_t) : sizeof(float)) +
+                             (a->indices32 != NULL ? sizeof(uint32_t) : sizeof(uint64_t)) +
+                             sizeof(uint32_t) + sizeof(float); // row index
+    return a->total_non_zero_nr * element_bytes + (a->nr_rows + 1) * sizeof(uint64_t) + a->nr_cols * (sizeof(uint64_t) + sizeof(float));
+}
+
+/**
+ * Upper bound of the height of a result column: the union of the columns of a that the column of b selects.
+ */
+static uint64_t result_col_bound(const ELLPACKMatrix *a, const ELLPACKMatrix *b, uint64_t col_start, uint64_t col_len)
+{
+    uint64_t bound = 0;
+    for (uint64_t k = col_start; k < col_start + col_len && bound < a->nr_rows; k++)
     {
-        fprintf(stderr, "Could not allocate memory for initial result matrix\n");
+        bound += a->nr_of_non_zeros_per_col[ellpack_index((const const_ELLPACKMatrix *) b, k)];
+    }
+    return bound < a->nr_rows ? bound : a->nr_rows;
+}
+
+/**
+ * Out-of-core multiplication: only A is loaded completely. B is read in column blocks, every block is cut into
+ * ranges of columns whose result fits into the rest of the budget, and the finished result columns are moved to
+ * temporary files. The output is written from these files at the end. The row index of A is built once for all ranges.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int call_matmul_out_of_core(const char* filename_a, const char* filename_b, const char* output_file, matmul_func matmul, const matmul_options* options)
+{
+    //init for cleanup, so that we can always use the cleanup label
+    ELLPACKMatrix a = get_empty_ellpackmatrix();
+    left_operand left = get_empty_left_operand();
+    ELLPACKMatrix block = get_empty_ellpackmatrix();
+    ellpack_column_stream b_stream = { .values_file = NULL, .indices_file = NULL };
+    result_spill spill = { .heights = NULL, .values = NULL, .indices = NULL };
+    result_mat result_matrix = {
+        .cols = NULL,
+        .cols_len = 0
+    };
+
+    if (read_ellpack_matrix(&a, filename_a)) goto cleanup_error;
+    if (convert_ellpack_values(&a, options->value_format)) goto cleanup_error;
+    uint64_t a_bytes = left_operand_bytes(&a);
+    if (a_bytes >= options->memory_budget)
+    {
+        fprintf(stderr, "A needs %.1f MiB, which does not fit into the memory budget of %.1f MiB\n", a_bytes / (1024.0 * 1024.0), options->memory_budget / (1024.0 * 1024.0));
+        goto cleanup_error;
+    }
+    if (open_ellpack_column_stream(&b_stream, filename_b)) goto cleanup_error;
+    if (a.nr_cols != b_stream.nr_rows)
+    {
+        fprintf(stderr, "Incompatible matrices provided :( a has %" PRIu64 " columns, b has %" PRIu64 " rows\n", a.nr_cols, b_stream.nr_rows);
         goto cleanup_error;
     }
+    if (output_file != NULL && open_result_spill(&spill, output_file)) goto cleanup_error;
+    // the row index of A is built here once instead of by every multiplication of a column range
+    if (build_left_operand((const const_ELLPACKMatrix *) &a, &left)) goto cleanup_error;
+    const matmul_context context = { .tile_size = options->tile_size, .left = &left, .verbose = options->verbose };
 
-    // MATMUL
-    if(benchmark_iterations > 0) {
-        run_benchmark(benchmark_iterations, &mat_a, &mat_b, &result_matrix, matmul);
+    // half of the rest of the budget is used for a block of B, the other half for the result of one range
+    uint64_t block_budget = (options->memory_budget - a_bytes) / 2;
+    uint64_t result_budget = options->memory_budget - a_bytes - block_budget;
+    uint64_t bytes_per_b_col = b_stream.nr_ellpack_elts * OUT_OF_CORE_BYTES_PER_B_ELEMENT + OUT_OF_CORE_BYTES_PER_B_COL;
+    uint64_t block_cols = block_budget / bytes_per_b_col > 0 ? block_budget / bytes_per_b_col : 1;
+    printf("Out-of-core mode: A uses %.1f MiB, B is read in blocks of up to %" PRIu64 " columns\n", a_bytes / (1024.0 * 1024.0), block_cols);
+
+    uint64_t nr_blocks = 0, nr_ranges = 0;
+    while (b_stream.next_col < b_stream.nr_cols)
+    {
+        uint64_t block_first_col = b_stream.next_col;
+        if (read_ellpack_column_block(&b_stream, block_cols, &block)) goto cleanup_error;
+        if (convert_ellpack_values(&block, options->value_format)) goto cleanup_error;
+        if (options->packed_b && pack_ellpack_entries(&block)) goto cleanup_error;
+        nr_blocks++;
+
+        uint64_t range_first = 0, range_offset = 0;
+        while (range_first < block.nr_cols)
+        {
+            // add columns to the range while the upper bound of their result fits (at least one column)
+            uint64_t range_end = range_first, range_non_zeros = 0, range_bytes = 0;
+            while (range_end < block.nr_cols)
+            {
+                uint64_t col_len = block.nr_of_non_zeros_per_col[range_end];
+                uint64_t col_bytes = result_col_bound(&a, &block, range_offset + range_non_zeros, col_len) * OUT_OF_CORE_BYTES_PER_RESULT_ELEMENT + OUT_OF_CORE_BYTES_PER_RESULT_COL;
+                if (range_end > range_first && range_bytes + col_bytes > result_budget) break;
+                range_bytes += col_bytes;
+                range_non_zeros += col_len;
+                range_end++;
+            }
+
+            ELLPACKMatrix range = column_range_view(&block, range_first, range_end - range_first, range_offset, range_non_zeros);
+            result_matrix = malloc_init_result_mat_for(matmul, &a, &range, &left);
+            if (result_matrix.cols == NULL)
+            {
+                fprintf(stderr, "Could not allocate memory for initial result matrix\n");
+                goto cleanup_error;
+            }
+            matmul(&a, &range, &result_matrix, &context);
+            if (result_matrix.cols == NULL) goto cleanup_error;
+            if (output_file != NULL && append_result_spill(&spill, &result_matrix)) goto cleanup_error;
+            free_result_mat(&result_matrix);
+            nr_ranges++;
+
+            range_first = range_end;
+            range_offset += range_non_zeros;
+        }
+        if (options->verbose)
+        {
+            printf("Block %" PRIu64 ": columns %" PRIu64 " to %" PRIu64 " of B\n", nr_blocks, block_first_col, b_stream.next_col - 1);
+            print_huge_page_report(stdout);
+        }
+        clean_matrix_data(&block);
     }
-    else {
-        matmul(&mat_a, &mat_b, &result_matrix);
+    printf("Out-of-core mode: %" PRIu64 " blocks of B, %" PRIu64 " multiplications\n", nr_blocks, nr_ranges);
+
+    // after matmul
+    if (output_file != NULL && write_result_spill(output_file, &spill, a.nr_rows)) goto cleanup_error;
+
+    bool error_occured = false;
+    goto cleanup;
+cleanup_error:
+    error_occured = true;
+cleanup:
+    free_result_mat(&result_matrix);
+    free_left_operand(&left);
+    clean_matrix_data(&block);
+    clean_matrix_data(&a);
+    close_ellpack_column_stream(&b_stream);
+    close_result_spill(&spill);
+    return error_occured ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int call_matmul_chain(const char* const* filenames, int nr_operands, const char* output_file, int benchmark_iterations, matmul_func matmul, const matmul_options* options) {
+    if (nr_operands < 2)
+    {
+        fprintf(stderr, "At least two operands are needed\n");
+        return EXIT_FAILURE;
+    }
+    if (options->memory_budget > 0)
+    {
+        if (nr_operands != 2 || benchmark_iterations > 0 || options->binary_output)
+        {
+            fprintf(stderr, "The out-of-core mode (-M) only supports two operands, no benchmarking and a text output\n");
+            return EXIT_FAILURE;
+        }
+        return call_matmul_out_of_core(filenames[0], filenames[1], output_file, matmul, options);
+    }
+    //init for cleanup, so that we can always use the cleanup label
+    result_mat result_matrix = {
+        .cols = NULL,
+        .cols_len = 0
+    };
+    chain_plan plan = { .nr_operands = 0, .split = NULL, .estimated_cost = 0 };
+    uint64_t result_rows = 0; //these are actual rows not ellpack rows
+    ELLPACKMatrix *operands = malloc(nr_operands * sizeof(ELLPACKMatrix));
+    if (operands == NULL)
+    {
+        fprintf(stderr, "Could not allocate the operands\n");
+        return EXIT_FAILURE;
+    }
+    for (int op = 0; op < nr_operands; op++)
+    {
+        operands[op] = get_empty_ellpackmatrix();
     }
 
-    if(result_matrix.cols == NULL) goto cleanup_error;
+    // all operands are loaded first, so that an invalid file is reported before any multiplication is done
+    for (int op = 0; op < nr_operands; op++)
+    {
+        if (read_ellpack_matrix(&operands[op], filenames[op])) goto cleanup_error;
+        if (convert_ellpack_values(&operands[op], options->value_format)) goto cleanup_error;
+    }
 
-    //result_width can be read from result_matrix.cols -> save it
-    uint64_t result_rows = mat_a.nr_rows; //these are actual rows not ellpack rows
-    //already free this data, since it is not needed anymore
-    clean_matrix_data(&mat_a);
-    clean_matrix_data(&mat_b);
+    // the order with the fewest estimated operations is used, the intermediate products stay in memory
+    if (plan_matrix_chain((const const_ELLPACKMatrix *) operands, nr_operands, &plan)) goto cleanup_error;
+    if (nr_operands > 2)
+    {
+        printf("Chain order: ");
+        print_chain_order(stdout, &plan, 0, nr_operands - 1);
+        printf(" (estimated cost: %.3g operations)\n", plan.estimated_cost);
+    }
+    if (multiply_subchain(operands, &plan, 0, nr_operands - 1, benchmark_iterations, matmul, options, &result_matrix, &result_rows) == EXIT_FAILURE) goto cleanup_error;
 
     // after matmul
     bool error_occured_in_write = false;
-    if(output_file != NULL) {
+    if(output_file != NULL && options->binary_output) {
+        if (write_result_binary(output_file, &result_matrix, result_rows)) goto cleanup_error;
+    }
+    else if(output_file != NULL) {
         result_file *result = write_ellpack_matrix(output_file, &result_matrix, result_rows, result_matrix.cols_len, &error_occured_in_write);
         free(result);
         if (error_occured_in_write) goto cleanup_error;
@@ -60,7 +314,16 @@ cleanup_error:
 cleanup:
     // ENDE muss egal ob fail oder nicht gefreeed werden
     free_result_mat(&result_matrix);
-    clean_matrix_data(&mat_a);
-    clean_matrix_data(&mat_b);
+    free_chain_plan(&plan);
+    for (int op = 0; op < nr_operands; op++)
+    {
+        clean_matrix_data(&operands[op]);
+    }
+    free(operands);
     return error_occured ? EXIT_FAILURE : EXIT_SUCCESS;
 }
+
+int call_matmul(const char* filename_a, const char* filename_b, const char* output_file, int benchmark_iterations, matmul_func matmul, const matmul_options* options) {
+    const char *filenames[] = {filename_a, filename_b};
+    return call_matmul_chain(filenames, 2, output_file, benchmark_iterations, matmul, options);
+}
@@ -2,15 +2,51 @@
  * @file matmul_caller.h
  * @brief High-level entry that wires I/O, benchmarking, and matmul.
  */
+#ifndef MATMUL_CALLER_H
+#define MATMUL_CALLER_H
+#include <stdbool.h>
 #include "matrix_utils.h"
 
+/**
+ * @struct matmul_options
+ * @brief How the operands are stored after loading, and the settings passed to the implementation.
+ */
+typedef struct {
+    bool packed_b;                     ///< Store B in the packed (index, value) layout; with benchmarking, both layouts are measured
+    ellpack_value_format value_format; ///< Storage format of the values of A and B (fp32, bf16 or fp16)
+    bool verbose;                      ///< Report the huge page usage after every multiplication and fallbacks of the implementation
+    uint64_t memory_budget;            ///< Bytes for the out-of-core mode (0: both operands and the result are kept in memory)
+    bool binary_output;                ///< Write the result as a binary ELLPACK file (`write_result_binary`) instead of text
+    uint64_t tile_size;                ///< Tile width of `matr_mult_ellpack_main_tiled` (0: derived from the L2 cache size)
+} matmul_options;
+
 /**
  * @brief Read two ELLPACK matrices, multiply them, optionally benchmark, and write result.
- * @param filename_a Path to the first input matrix (ELLPACK format).
- * @param filename_b Path to the second input matrix (ELLPACK format).
+ *        With `options->memory_budget`, B is streamed in column blocks and the result columns are moved
+ *        to temporary files before the output is written, so only A has to fit into memory.
+ * @param filename_a Path to the first input matrix (ELLPACK, HYB or binary ELLPACK format).
+ * @param filename_b Path to the second input matrix (ELLPACK, HYB or binary ELLPACK format).
  * @param output_file Output path for the result (optional; NULL to skip writing).
  * @param benchmark_iterations Number of repetitions for benchmarking (0 disables benchmarking).
  * @param matmul Matmul implementation to use.
+ * @param options Storage options of the operands (see `matmul_options`).
+ * @return 0 on success; non-zero on I/O or computation failure.
+ */
+int call_matmul(const char* filename_a, const char* filename_b, const char* output_file, int benchmark_iterations, matmul_func matmul, const matmul_options* options);
+
+/**
+ * @brief Read a chain of ELLPACK matrices and multiply them (A * B * C ...).
+ *        The order of the products is chosen by `plan_matrix_chain` and printed if there are more than two operands.
+ *        Intermediate products are converted in memory (`result_mat_to_ellpack`), only the final product is written.
+ * @param filenames Paths of the operands, in multiplication order.
+ * @param nr_operands Number of operands (at least 2).
+ * @param output_file Output path for the result (optional; NULL to skip writing).
+ * @param benchmark_iterations Number of repetitions per multiplication (0 disables benchmarking).
+ * @param matmul Matmul implementation to use.
+ * @param options Storage options of the operands (see `matmul_options`), applied to the intermediate products as well.
+ *                The out-of-core mode (`memory_budget`) only supports two operands, no benchmarking and a text output.
  * @return 0 on success; non-zero on I/O or computation failure.
  */
-int call_matmul(const char* filename_a, const char* filename_b, const char* output_file, int benchmark_iterations, matmul_func matmul);
\ No newline at end of file
+int call_matmul_chain(const char* const* filenames, int nr_operands, const char* output_file, int benchmark_iterations, matmul_func matmul, const matmul_options* options);
+
+#endif // MATMUL_CALLER_H
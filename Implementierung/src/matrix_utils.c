@@ -1,9 +1,98 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "matrix_utils.h"
 #include <stdbool.h>
 #include <inttypes.h>
 #include "io.h"
+#include "huge_pages.h"
+
+ellpack_row_index get_empty_row_index()
+{
+    ellpack_row_index index = {
+        .nr_rows = 0,
+        .row_starts = NULL,
+        .cols = NULL,
+        .values = NULL
+    };
+    return index;
+}
+
+/**
+ * Builds the CSR transpose of a column-major ellpack matrix with a counting sort over the row indices.
+ * Since the columns are visited in ascending order, the entries of each row are sorted by column.
+ * @returns 0 if successful, else 1. On failure, nothing has to be freed
+ */
+int build_row_index(const const_ELLPACKMatrix *mat, ellpack_row_index *index)
+{
+    *index = get_empty_row_index();
+    index->nr_rows = mat->nr_rows;
+    uint64_t non_zeros = 0;
+    for (uint64_t col = 0; col < mat->nr_cols; col++)
+    {
+        non_zeros += mat->nr_of_non_zeros_per_col[col];
+    }
+
+    index->row_starts = calloc(mat->nr_rows + 1, sizeof(uint64_t));
+    index->cols = malloc((non_zeros > 0 ? non_zeros : 1) * sizeof(uint32_t));
+    index->values = malloc((non_zeros > 0 ? non_zeros : 1) * sizeof(float));
+    if (index->row_starts == NULL || index->cols == NULL || index->values == NULL)
+    {
+        fprintf(stderr, "Could not allocate the row index!\n");
+        free_row_index(index);
+        return EXIT_FAILURE;
+    }
+
+    // count the elements of each row (shifted by one, so that the prefix sum gives the start of each row)
+    for (uint64_t k = 0; k < non_zeros; k++)
+    {
+        index->row_starts[ellpack_index(mat, k) + 1]++;
+    }
+    for (uint64_t row = 0; row < mat->nr_rows; row++)
+    {
+        index->row_starts[row + 1] += index->row_starts[row];
+    }
+
+    // scatter the elements, row_starts[row] is used as the insert position and is shifted back afterwards
+    for (uint64_t col = 0, k = 0; col < mat->nr_cols; col++)
+    {
+        for (uint64_t end = k + mat->nr_of_non_zeros_per_col[col]; k < end; k++)
+        {
+            uint64_t pos = index->row_starts[ellpack_index(mat, k)]++;
+            index->cols[pos] = col;
+            index->values[pos] = ellpack_value(mat, k);
+        }
+    }
+    for (uint64_t row = mat->nr_rows; row > 0; row--)
+    {
+        index->row_starts[row] = index->row_starts[row - 1];
+    }
+    index->row_starts[0] = 0;
+    return EXIT_SUCCESS;
+}
+
+void free_row_index(ellpack_row_index *index)
+{
+    free(index->row_starts);
+    free(index->cols);
+    free(index->values);
+    *index = get_empty_row_index();
+}
+
+/** View of the columns [first_col, first_col + nr_cols) of m, which start at element offset. Nothing is copied. */
+ELLPACKMatrix column_range_view(const ELLPACKMatrix *m, uint64_t first_col, uint64_t nr_cols, uint64_t offset, uint64_t nr_non_zeros)
+{
+    ELLPACKMatrix view = *m;
+    view.nr_cols = nr_cols;
+    view.total_non_zero_nr = nr_non_zeros;
+    view.nr_of_non_zeros_per_col = m->nr_of_non_zeros_per_col + first_col;
+    if (m->values != NULL) view.values = m->values + offset;
+    if (m->values16 != NULL) view.values16 = m->values16 + offset;
+    if (m->indices != NULL) view.indices = m->indices + offset;
+    if (m->indices32 != NULL) view.indices32 = m->indices32 + offset;
+    if (m->entries != NULL) view.entries = m->entries + offset;
+    return view;
+}
 
 /**
  * Initializes a result_mat for performing matrix multiplication on a * b 
@@ -18,17 +107,260 @@ result_mat malloc_init_result_mat_from_ellpack(const ELLPACKMatrix *a, const ELL
     }
     return malloc_init_result_mat(b->nr_cols, initial_size, a->nr_rows);
 }
+sell_matrix get_empty_sell_matrix()
+{
+    sell_matrix sell = {
+        .nr_cols = 0,
+        .nr_chunks = 0,
+        .chunk_starts = NULL,
+        .indices = NULL,
+        .values = NULL,
+        .slot_of_col = NULL,
+        .width = 0,
+        .nr_overflow_cols = 0,
+        .overflow_cols = NULL,
+        .overflow_begin = NULL,
+        .overflow_end = NULL
+    };
+    return sell;
+}
+
+_Static_assert(SELL_SIGMA % SELL_CHUNK == 0, "a sigma window has to consist of whole chunks");
+
+/** (length, column) pair used to sort the columns of a sigma window */
+typedef struct {
+    uint64_t length;
+    uint32_t col;
+} sell_col_length;
+
+static int compare_col_length_desc(const void *lhs, const void *rhs)
+{
+    const sell_col_length *l = lhs;
+    const sell_col_length *r = rhs;
+    if (l->length != r->length) return l->length < r->length ? 1 : -1;
+    return (l->col > r->col) - (l->col < r->col); // keep the original order for equal lengths
+}
+
+static int compare_uint64(const void *lhs, const void *rhs)
+{
+    uint64_t l = *(const uint64_t *)lhs;
+    uint64_t r = *(const uint64_t *)rhs;
+    return (l > r) - (l < r);
+}
+
 /**
- * Initializes a result_mat and mallocs space for nested array. Should not be freed in case of failure.
- * @returns returns the 128-bit result_mat with initialized memory. If any initialization malloc failed, the `cols` will be set to NULL
+ * Sorts a copy of the lengths and takes the one at the position where the longest nr_cols / HYB_TAIL_FRACTION columns begin.
+ * If the copy can not be allocated, the longest column is returned (no overflow).
  */
-result_mat malloc_init_result_mat(unsigned int column_amount, unsigned int initial_col_height, uint64_t max_col_height)
+uint64_t get_hyb_width(const uint64_t *col_lengths, uint64_t nr_cols)
+{
+    if (nr_cols == 0) return 0;
+    uint64_t *sorted_lengths = malloc(nr_cols * sizeof(uint64_t));
+    if (sorted_lengths == NULL)
+    {
+        uint64_t longest = 0;
+        for (uint64_t col = 0; col < nr_cols; col++)
+        {
+            if (col_lengths[col] > longest) longest = col_lengths[col];
+        }
+        return longest;
+    }
+    memcpy(sorted_lengths, col_lengths, nr_cols * sizeof(uint64_t));
+    qsort(sorted_lengths, nr_cols, sizeof(uint64_t), compare_uint64);
+    uint64_t width = sorted_lengths[nr_cols - 1 - nr_cols / HYB_TAIL_FRACTION];
+    free(sorted_lengths);
+    return width;
+}
+
+/**
+ * Builds the SELL-C-sigma copy: sort each sigma window by column length, then pad every chunk to its longest column.
+ * @returns 0 if successful, else 1. On failure, nothing has to be freed
+ */
+int build_sell_matrix(const const_ELLPACKMatrix *mat, sell_matrix *sell)
+{
+    *sell = get_empty_sell_matrix();
+    if (mat->indices32 == NULL)
+    {
+        fprintf(stderr, "The SELL format needs 32-bit indices (at most UINT32_MAX rows)\n");
+        return EXIT_FAILURE;
+    }
+    sell->nr_cols = mat->nr_cols;
+    sell->nr_chunks = (mat->nr_cols + SELL_CHUNK - 1) / SELL_CHUNK;
+
+    uint64_t *col_starts = malloc((mat->nr_cols + 1) * sizeof(uint64_t));
+    // col_of_slot[s]: column stored in slot s (padded to whole chunks, empty slots hold UINT32_MAX)
+    uint32_t *col_of_slot = malloc(sell->nr_chunks * SELL_CHUNK * sizeof(uint32_t));
+    sell_col_length *window = malloc(SELL_SIGMA * sizeof(sell_col_length));
+    sell->chunk_starts = malloc((sell->nr_chunks + 1) * sizeof(uint64_t));
+    sell->slot_of_col = malloc((mat->nr_cols > 0 ? mat->nr_cols : 1) * sizeof(uint32_t));
+    if (col_starts == NULL || col_of_slot == NULL || window == NULL || sell->chunk_starts == NULL || sell->slot_of_col == NULL)
+        goto cleanup_error;
+
+    col_starts[0] = 0;
+    for (uint64_t col = 0; col < mat->nr_cols; col++)
+    {
+        col_starts[col + 1] = col_starts[col] + mat->nr_of_non_zeros_per_col[col];
+    }
+
+    // sort the windows and assign the slots
+    for (uint64_t window_begin = 0; window_begin < mat->nr_cols; window_begin += SELL_SIGMA)
+    {
+        uint64_t window_len = mat->nr_cols - window_begin < SELL_SIGMA ? mat->nr_cols - window_begin : SELL_SIGMA;
+        for (uint64_t w = 0; w < window_len; w++)
+        {
+            uint32_t col = window_begin + w;
+            window[w].length = col_starts[col + 1] - col_starts[col];
+            window[w].col = col;
+        }
+        qsort(window, window_len, sizeof(sell_col_length), compare_col_length_desc);
+        for (uint64_t w = 0; w < window_len; w++)
+        {
+            col_of_slot[window_begin + w] = window[w].col;
+            sell->slot_of_col[window[w].col] = window_begin + w;
+        }
+    }
+    for (uint64_t slot = mat->nr_cols; slot < sell->nr_chunks * SELL_CHUNK; slot++)
+    {
+        col_of_slot[slot] = UINT32_MAX;
+    }
+
+    // the columns beyond the width are multiplied from the original matrix
+    sell->width = get_hyb_width(mat->nr_of_non_zeros_per_col, mat->nr_cols);
+    for (uint64_t col = 0; col < mat->nr_cols; col++)
+    {
+        if (mat->nr_of_non_zeros_per_col[col] > sell->width) sell->nr_overflow_cols++;
+    }
+    if (sell->nr_overflow_cols > 0)
+    {
+        sell->overflow_cols = malloc(sell->nr_overflow_cols * sizeof(uint32_t));
+        sell->overflow_begin = malloc(mat->nr_cols * sizeof(uint64_t));
+        sell->overflow_end = malloc(mat->nr_cols * sizeof(uint64_t));
+        if (sell->overflow_cols == NULL || sell->overflow_begin == NULL || sell->overflow_end == NULL)
+            goto cleanup_error;
+        for (uint64_t col = 0, t = 0; col < mat->nr_cols; col++)
+        {
+            uint64_t head = mat->nr_of_non_zeros_per_col[col] < sell->width ? mat->nr_of_non_zeros_per_col[col] : sell->width;
+            sell->overflow_begin[col] = col_starts[col] + head;
+            sell->overflow_end[col] = col_starts[col + 1];
+            if (head < mat->nr_of_non_zeros_per_col[col]) sell->overflow_cols[t++] = col;
+        }
+    }
+
+    // the first column of a chunk is its longest one (windows are a multiple of the chunk size)
+    sell->chunk_starts[0] = 0;
+    for (uint64_t chunk = 0; chunk < sell->nr_chunks; chunk++)
+    {
+        uint32_t longest = col_of_slot[chunk * SELL_CHUNK];
+        uint64_t height = col_starts[longest + 1] - col_starts[longest];
+        sell->chunk_starts[chunk + 1] = sell->chunk_starts[chunk] + (height < sell->width ? height : sell->width) * SELL_CHUNK;
+    }
+    uint64_t padded_size = sell->chunk_starts[sell->nr_chunks];
+    sell->indices = huge_page_calloc(padded_size > 0 ? padded_size : 1, sizeof(uint32_t));
+    sell->values = huge_page_calloc(padded_size > 0 ? padded_size : 1, sizeof(float));
+    if (sell->indices == NULL || sell->values == NULL)
+        goto cleanup_error;
+
+    for (uint64_t slot = 0; slot < mat->nr_cols; slot++)
+    {
+        uint32_t col = col_of_slot[slot];
+        uint64_t base = sell->chunk_starts[slot / SELL_CHUNK] + slot % SELL_CHUNK;
+        uint64_t head_end = col_starts[col + 1] - col_starts[col] < sell->width ? col_starts[col + 1] : col_starts[col] + sell->width;
+        for (uint64_t k = col_starts[col], p = 0; k < head_end; k++, p++)
+        {
+            sell->indices[base + p * SELL_CHUNK] = mat->indices32[k];
+            sell->values[base + p * SELL_CHUNK] = ellpack_value(mat, k);
+        }
+    }
+
+    free(col_starts);
+    free(col_of_slot);
+    free(window);
+    return EXIT_SUCCESS;
+
+cleanup_error:
+    fprintf(stderr, "Could not allocate the SELL matrix!\n");
+    free(col_starts);
+    free(col_of_slot);
+    free(window);
+    free_sell_matrix(sell);
+    return EXIT_FAILURE;
+}
+
+void free_sell_matrix(sell_matrix *sell)
+{
+    free(sell->chunk_starts);
+    free(sell->indices);
+    free(sell->values);
+    free(sell->slot_of_col);
+    free(sell->overflow_cols);
+    free(sell->overflow_begin);
+    free(sell->overflow_end);
+    *sell = get_empty_sell_matrix();
+}
+
+#define ARENA_MIN_CHUNK_SIZE (1u << 20) // 1 MiB
+#define ARENA_MAX_CHUNK_SIZE (1u << 26) // 64 MiB, bigger requests get a chunk of their own size
+#define ARENA_ALIGNMENT 8
+
+/**
+ * Starts a new chunk of at least min_size bytes. The old chunk stays in the list until the arena is freed.
+ * @returns 0 if successful, else 1
+ */
+static int arena_add_chunk(result_arena *arena, uint64_t min_size)
+{
+    if (min_size > SIZE_MAX - sizeof(result_arena_chunk))
+        return EXIT_FAILURE;
+    // the header is part of the chunk size, so that the regular chunks fill whole (huge) pages
+    uint64_t size = arena->next_chunk_size > min_size + sizeof(result_arena_chunk) ? arena->next_chunk_size - sizeof(result_arena_chunk) : min_size;
+    result_arena_chunk *chunk = huge_page_alloc(sizeof(result_arena_chunk) + size);
+    if (chunk == NULL)
+        return EXIT_FAILURE;
+    chunk->next = arena->head;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->head = chunk;
+    if (arena->next_chunk_size < ARENA_MAX_CHUNK_SIZE)
+        arena->next_chunk_size *= 2;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Bump allocation from the arena, a new chunk is started if the current one is full.
+ * @returns pointer to `bytes` bytes (8-byte aligned) or NULL on failure
+ */
+static void *arena_alloc(result_arena *arena, uint64_t bytes)
+{
+    bytes = (bytes + ARENA_ALIGNMENT - 1) & ~(uint64_t)(ARENA_ALIGNMENT - 1);
+    if ((arena->head == NULL || arena->head->size - arena->head->used < bytes) && arena_add_chunk(arena, bytes) == EXIT_FAILURE)
+        return NULL;
+    void *ptr = arena->head->data + arena->head->used;
+    arena->head->used += bytes;
+    return ptr;
+}
+
+static void free_arena(result_arena *arena)
+{
+    while (arena->head != NULL)
+    {
+        result_arena_chunk *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+/**
+ * Sets up the arena and the column array, and places every column with the given height in the first chunk.
+ * @param col_heights height of every column, or NULL to use uniform_height for all columns
+ * @returns the result_mat with initialized memory. If any initialization malloc failed, the `cols` will be set to NULL
+ */
+static result_mat init_result_mat_in_arena(unsigned int column_amount, const uint64_t *col_heights, uint64_t uniform_height, uint64_t max_col_height)
 {
-    // column_amount = nr of result_cols needed = cols_len
     result_mat matrix = {
         .cols = malloc(sizeof(result_col) * column_amount),
         .cols_len = column_amount,
         .max_col_height = max_col_height > UINT32_MAX ? UINT32_MAX : max_col_height, // limit size to UINT32_MAX since an array of size 2^64 is not feasible
+        .exact = false,
+        .arena = { .head = NULL, .next_chunk_size = ARENA_MIN_CHUNK_SIZE },
     };
 
     if (matrix.cols == NULL)
@@ -37,37 +369,69 @@ result_mat malloc_init_result_mat(unsigned int column_amount, unsigned int initi
         return matrix; // has cols as NULL, indicating failure
     }
 
+    uint64_t total_height = 0;
     bool error_occured = false;
-    // allocate the result rows of the matrix -> each row has to be either allocated or nullptr for cleanup
-    for (unsigned int i = 0; i < column_amount; i++)
+    for (unsigned int i = 0; i < column_amount && !error_occured; i++)
     {
-        matrix.cols[i].used_height = 0;
-        matrix.cols[i].height = initial_col_height;
-        uint64_t *indices = error_occured ? NULL : malloc(sizeof(uint64_t) * initial_col_height);
-        float *values = error_occured ? NULL : malloc(sizeof(float) * initial_col_height);
-
-        // allocate indices array
-        if (indices == NULL || values == NULL)
-        {
-            if (!error_occured)
-                fprintf(stderr, "Could not allocate space for the result indices or values!");
+        uint64_t height = col_heights != NULL ? col_heights[i] : uniform_height;
+        if (col_heights != NULL && height > matrix.max_col_height)
+        { // initial heights are only a hint, exact heights have to fit
+            fprintf(stderr, "Column %u of the result is too big!\n", i);
             error_occured = true;
         }
+        total_height += height;
+    }
 
-        // on failure, will be allocated with NULL and then later be ignored by free()
-        matrix.cols[i].indices = indices;
-        matrix.cols[i].values = values;
+    // one chunk for all columns (padding of the index and value blocks included)
+    uint64_t element_size = sizeof(uint64_t) + sizeof(float);
+    if (!error_occured &&
+        (total_height > (UINT64_MAX - 2 * ARENA_ALIGNMENT * (uint64_t) column_amount) / element_size ||
+         arena_add_chunk(&matrix.arena, total_height * element_size + 2 * ARENA_ALIGNMENT * (uint64_t) column_amount) == EXIT_FAILURE))
+    {
+        fprintf(stderr, "Could not allocate space for the result indices or values!");
+        error_occured = true;
     }
 
     if (error_occured)
     {
-        free_result_mat(&matrix); // has cols as NULL, indicating failure
+        free(matrix.cols);
+        matrix.cols = NULL; // indicating failure
+        return matrix;
     }
 
+    for (unsigned int i = 0; i < column_amount; i++)
+    {
+        uint64_t height = col_heights != NULL ? col_heights[i] : uniform_height;
+        matrix.cols[i].used_height = 0;
+        matrix.cols[i].height = height;
+        // cannot fail, the chunk was sized for all columns
+        matrix.cols[i].indices = arena_alloc(&matrix.arena, height * sizeof(uint64_t));
+        matrix.cols[i].values = arena_alloc(&matrix.arena, height * sizeof(float));
+    }
     return matrix;
-};
+}
+
+/**
+ * Initializes a result_mat and mallocs space for nested array. Should not be freed in case of failure.
+ * All columns start in one chunk of the arena.
+ * @returns returns the result_mat with initialized memory. If any initialization malloc failed, the `cols` will be set to NULL
+ */
+result_mat malloc_init_result_mat(unsigned int column_amount, unsigned int initial_col_height, uint64_t max_col_height)
+{
+    return init_result_mat_in_arena(column_amount, NULL, initial_col_height, max_col_height);
+}
+
+/**
+ * Initializes a result_mat with exactly sized columns. All columns are placed back to back in one chunk of the arena.
+ * @returns the result_mat with initialized memory. If any initialization malloc failed, the `cols` will be set to NULL
+ */
+result_mat malloc_init_result_mat_exact(unsigned int column_amount, const uint64_t *col_heights, uint64_t max_col_height)
+{
+    return init_result_mat_in_arena(column_amount, col_heights, 0, max_col_height);
+}
+
 /* returns 0 if successful, else 1 if failed. If failed, the result_mat still needs to be cleaned/freed */
-int push_to_matrix(result_mat *mat, float value, uint64_t i_row, unsigned int i_col)
+int reserve_result_col(result_mat *mat, unsigned int i_col, uint64_t extra_height)
 {
     // find Col
     if (i_col >= mat->cols_len)
@@ -76,61 +440,132 @@ int push_to_matrix(result_mat *mat, float value, uint64_t i_row, unsigned int i_
         return EXIT_FAILURE;
     }
     result_col *col = &mat->cols[i_col];
+    uint64_t needed_height = (uint64_t)col->used_height + extra_height;
     // enough space? (used_height is starting from 0 as a index, pointing to the nr of elts inside, col->height "is counting the number of values that would fit into")
-    if (col->used_height >= col->height)
-    { // no space -> resize
-        unsigned int new_height = col->height * 2; // double size to achieve amortized O(1) time complexity
-        new_height = new_height > mat->max_col_height ? mat->max_col_height : new_height; // limit size to max_col_height -> saves memory
+    if (needed_height <= col->height)
+        return EXIT_SUCCESS;
 
-        // in case of overflow or resize beyond max size, print to standard error that the matrix is too big and return error response
-        if (new_height <= col->height || col->height == mat->max_col_height)
-        {
-            fprintf(stderr, "Matrix is too big to be resized!\n");
-            return EXIT_FAILURE;
-        }
+    // no space -> resize
+    uint64_t new_height = (uint64_t)col->height * 2; // double size to achieve amortized O(1) time complexity
+    if (new_height < needed_height) new_height = needed_height;
+    new_height = new_height > mat->max_col_height ? mat->max_col_height : new_height; // limit size to max_col_height -> saves memory
 
-        float *new_values = realloc(col->values, new_height * sizeof(float));
-        if (!new_values) {
-            fprintf(stderr, "Failed to reallocate memory for values!");
-            return EXIT_FAILURE;
-        }
+    // in case of resize beyond max size, print to standard error that the matrix is too big and return error response
+    if (new_height < needed_height)
+    {
+        fprintf(stderr, "Matrix is too big to be resized!\n");
+        return EXIT_FAILURE;
+    }
 
-        uint64_t *new_indices = realloc(col->indices, new_height * sizeof(uint64_t));
-        if (!new_indices) {
-            fprintf(stderr, "Failed to reallocate memory for indices!");
-            col->values = new_values; // the old values array was already freed, so we need to keep the new one to be cleaned up later
-            return EXIT_FAILURE;
-        }
-        else
-        {
-            col->values = new_values;
-            col->indices = new_indices;
-            col->height = new_height;
-        }
+    // move the column to a bigger block of the arena, the old block is released together with the arena
+    float *new_values = arena_alloc(&mat->arena, new_height * sizeof(float));
+    uint64_t *new_indices = arena_alloc(&mat->arena, new_height * sizeof(uint64_t));
+    if (!new_values || !new_indices) {
+        fprintf(stderr, "Failed to allocate memory for a result column!");
+        return EXIT_FAILURE;
     }
+    memcpy(new_values, col->values, col->used_height * sizeof(float));
+    memcpy(new_indices, col->indices, col->used_height * sizeof(uint64_t));
+    col->values = new_values;
+    col->indices = new_indices;
+    col->height = new_height;
+    return EXIT_SUCCESS;
+}
+
+/* returns 0 if successful, else 1 if failed. If failed, the result_mat still needs to be cleaned/freed */
+int push_to_matrix(result_mat *mat, float value, uint64_t i_row, unsigned int i_col)
+{
+    if (reserve_result_col(mat, i_col, 1) == EXIT_FAILURE)
+        return EXIT_FAILURE;
     // enough space -> insert & set index further
+    result_col *col = &mat->cols[i_col];
     col->values[col->used_height] = value;
     col->indices[col->used_height++] = i_row;
     return EXIT_SUCCESS;
 };
 
-void free_result_mat(result_mat *matrix)
+/* returns 0 if successful, else 1 if failed. If failed, the result_mat still needs to be cleaned/freed */
+int append_result_col(result_mat *mat, unsigned int i_col, const result_col *src)
 {
-    if (matrix->cols == NULL)
-        return; // freeing an already freed matrix
-    unsigned int col_amount = matrix->cols_len;
+    if (src->used_height == 0)
+        return EXIT_SUCCESS;
+    if (reserve_result_col(mat, i_col, src->used_height) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    result_col *col = &mat->cols[i_col];
+    memcpy(col->values + col->used_height, src->values, src->used_height * sizeof(float));
+    memcpy(col->indices + col->used_height, src->indices, src->used_height * sizeof(uint64_t));
+    col->used_height += src->used_height;
+    return EXIT_SUCCESS;
+}
 
-    for (unsigned int i = 0; i < col_amount; i++)
+void reset_result_mat(result_mat *matrix)
+{
+    // the columns keep their blocks in the arena, only the fill level is cleared
+    for (unsigned int i = 0; i < matrix->cols_len; i++)
     {
-        // free each col
-        free(matrix->cols[i].indices);
-        free(matrix->cols[i].values);
+        matrix->cols[i].used_height = 0;
     }
-    // and whole matrix
+}
+
+void free_result_mat(result_mat *matrix)
+{
+    if (matrix->cols == NULL)
+        return; // freeing an already freed matrix
+    // all columns live in the arena
+    free_arena(&matrix->arena);
     free(matrix->cols);
     matrix->cols = NULL;
 };
 
+int result_mat_to_ellpack(const result_mat *result, uint64_t nr_rows, ELLPACKMatrix *out)
+{
+    *out = get_empty_ellpackmatrix();
+    out->nr_rows = nr_rows;
+    out->nr_cols = result->cols_len;
+    out->sorted = true;
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < result->cols_len; i++)
+    {
+        total += result->cols[i].used_height;
+        if (result->cols[i].used_height > out->nr_ellpack_elts)
+            out->nr_ellpack_elts = result->cols[i].used_height;
+    }
+    out->total_non_zero_nr = total;
+
+    // allocate at least one element, so that NULL always means failure
+    bool compact_indices = nr_rows <= UINT32_MAX;
+    out->values = huge_page_alloc((total > 0 ? total : 1) * sizeof(float));
+    out->nr_of_non_zeros_per_col = malloc((result->cols_len > 0 ? result->cols_len : 1) * sizeof(uint64_t));
+    if (compact_indices)
+        out->indices32 = huge_page_alloc((total > 0 ? total : 1) * sizeof(uint32_t));
+    else
+        out->indices = huge_page_alloc((total > 0 ? total : 1) * sizeof(uint64_t));
+    if (out->values == NULL || out->nr_of_non_zeros_per_col == NULL || (out->indices32 == NULL && out->indices == NULL))
+    {
+        fprintf(stderr, "Could not allocate the ELLPACK matrix for the result!\n");
+        clean_matrix_data(out);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t k = 0;
+    for (unsigned int i = 0; i < result->cols_len; i++)
+    {
+        const result_col *col = &result->cols[i];
+        out->nr_of_non_zeros_per_col[i] = col->used_height;
+        memcpy(&out->values[k], col->values, col->used_height * sizeof(float));
+        for (unsigned int h = 0; h < col->used_height; h++, k++)
+        {
+            if (compact_indices)
+                out->indices32[k] = col->indices[h];
+            else
+                out->indices[k] = col->indices[h];
+            if (h > 0 && col->indices[h] <= col->indices[h - 1])
+                out->sorted = false;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
 unsigned int get_longest_col(result_mat *matrix)
 {
     unsigned int longest = 0;
@@ -22,19 +22,146 @@ typedef struct {
     unsigned int used_height; ///< Number of valid elements
 } result_col;
 
+/**
+ * @struct result_arena_chunk
+ * @brief One block of memory of a `result_arena`; the arena only ever bumps `used`.
+ */
+typedef struct result_arena_chunk {
+    struct result_arena_chunk* next; ///< Previously filled chunk (NULL for the first one)
+    uint64_t size;                   ///< Capacity of `data` in bytes
+    uint64_t used;                   ///< Bytes of `data` handed out so far
+    unsigned char data[];
+} result_arena_chunk;
+
+/**
+ * @struct result_arena
+ * @brief Chunked bump allocator that holds all columns of a `result_mat`.
+ *
+ * Columns are carved out of large chunks instead of being allocated one by one; the whole
+ * arena is released with a single `free_result_mat`.
+ */
+typedef struct {
+    result_arena_chunk* head; ///< Chunk new allocations are taken from
+    uint64_t next_chunk_size; ///< Size of the next chunk (grows geometrically)
+} result_arena;
+
 /**
  * @struct result_mat
  * @brief Result accumulator consisting of dynamic columns.
  *
  * `cols_len` equals the number of output columns. `max_col_height` tracks the
  * maximum height among columns to improve memory efficiency.
+ * All columns live in `arena`; a column that grows moves to a bigger block of the arena.
  */
 typedef struct {
     result_col* cols;
     unsigned int cols_len;
     unsigned int max_col_height;
+    bool exact;         ///< Every column has room for all structural non-zeros of the product (`malloc_init_result_mat_symbolic`), so the kernels append without a capacity check
+    result_arena arena; ///< Storage of all column indices and values
 } result_mat;
 
+/**
+ * @struct ellpack_row_index
+ * @brief Row-major index (CSR transpose) of an ELLPACK matrix.
+ *
+ * The non-zeros of row `i` are `cols[k]`/`values[k]` for `row_starts[i] <= k < row_starts[i + 1]`,
+ * in ascending column order. Built once in O(nnz + rows + cols).
+ */
+typedef struct {
+    uint64_t nr_rows;
+    uint64_t* row_starts; ///< Offset of each row, size `nr_rows + 1`
+    uint32_t* cols;       ///< Column of each non-zero (matrices are at most UINT32_MAX wide)
+    float* values;
+} ellpack_row_index;
+
+/** @brief Number of columns stored side by side in one SELL chunk (one AVX2 register of floats). */
+#define SELL_CHUNK 8
+/** @brief Number of consecutive columns that are sorted by length before they are cut into chunks. */
+#define SELL_SIGMA 256
+/** @brief Only every HYB_TAIL_FRACTION-th column may be longer than the width of the padded part of a HYB layout. */
+#define HYB_TAIL_FRACTION 32
+
+/**
+ * @struct sell_matrix
+ * @brief SELL-C-sigma copy of an ELLPACK matrix (C = `SELL_CHUNK`, sigma = `SELL_SIGMA`).
+ *
+ * Within every window of `SELL_SIGMA` columns, the columns are sorted by length (longest first) and
+ * cut into chunks of `SELL_CHUNK` columns. Each chunk is padded to its longest column only and stored
+ * position-major: element p of the column in slot l is at `chunk_starts[c] + p * SELL_CHUNK + l`.
+ * Padding has index 0 and value 0. Slot `s` belongs to chunk `s / SELL_CHUNK`.
+ *
+ * Like the HYB format, the chunks hold at most `width` elements per column (see `get_hyb_width`), so a few
+ * very long columns do not inflate the padding. The rest of a longer column (its overflow) stays in the
+ * original matrix at `[overflow_begin[j], overflow_end[j])` and is multiplied with the dot product kernels.
+ */
+typedef struct {
+    uint64_t nr_cols;
+    uint64_t nr_chunks;
+    uint64_t* chunk_starts; ///< Offset of each chunk, size `nr_chunks + 1`
+    uint32_t* indices;      ///< Row indices (32-bit only)
+    float* values;
+    uint32_t* slot_of_col;  ///< Slot of every column of the original matrix
+    uint64_t width;             ///< Maximum number of elements of a column in the chunks
+    uint64_t nr_overflow_cols;  ///< Number of columns that are longer than `width`
+    uint32_t* overflow_cols;    ///< Columns that are longer than `width`, ascending (NULL if there are none)
+    uint64_t* overflow_begin;   ///< Position of the first element of every column that is not in the chunks (NULL if there is no overflow)
+    uint64_t* overflow_end;     ///< End of every column in the original matrix (NULL if there is no overflow)
+} sell_matrix;
+
+/**
+ * @brief Create an empty SELL matrix with no allocated buffers.
+ */
+sell_matrix get_empty_sell_matrix();
+
+/**
+ * @brief Width of the padded part of a HYB layout: the smallest column length that only every
+ *        `HYB_TAIL_FRACTION`-th column exceeds. The elements of longer columns beyond it are the overflow.
+ * @param col_lengths Length of every column.
+ * @param nr_cols Number of columns.
+ * @return The width (0 if there are no columns).
+ */
+uint64_t get_hyb_width(const uint64_t *col_lengths, uint64_t nr_cols);
+
+/**
+ * @brief Build the SELL-C-sigma copy of a matrix with 32-bit indices.
+ * @param mat Matrix to convert (at most UINT32_MAX columns).
+ * @param sell Output, has to be freed with `free_sell_matrix`.
+ * @return 0 on success, non-zero on allocation failure or if the matrix uses 64-bit indices.
+ */
+int build_sell_matrix(const const_ELLPACKMatrix *mat, sell_matrix *sell);
+
+/**
+ * @brief Free all buffers of a SELL matrix and reset it to empty state.
+ */
+void free_sell_matrix(sell_matrix *sell);
+
+/**
+ * @brief Create an empty row index with no allocated buffers.
+ */
+ellpack_row_index get_empty_row_index();
+
+/**
+ * @brief Build the row index of a matrix (column indices do not have to be sorted).
+ * @param mat Matrix to index (at most UINT32_MAX columns).
+ * @param index Output index, has to be freed with `free_row_index`.
+ * @return 0 on success, non-zero on allocation failure.
+ */
+int build_row_index(const const_ELLPACKMatrix *mat, ellpack_row_index *index);
+
+/**
+ * @brief Free all buffers of a row index and reset it to empty state.
+ */
+void free_row_index(ellpack_row_index *index);
+
+/**
+ * @brief View of the columns `[first_col, first_col + nr_cols)` of a matrix; nothing is copied.
+ * @param m Matrix the view points into (has to outlive the view, which must not be cleaned).
+ * @param offset Element offset of `first_col` (sum of the lengths of the columns before it).
+ * @param nr_non_zeros Sum of the lengths of the columns of the view.
+ */
+ELLPACKMatrix column_range_view(const ELLPACKMatrix *m, uint64_t first_col, uint64_t nr_cols, uint64_t offset, uint64_t nr_non_zeros);
+
 /**
  * @brief Initialize a `result_mat` sized to the product of two ELLPACK matrices.
  * @param a Left operand.
@@ -51,6 +178,26 @@ result_mat malloc_init_result_mat_from_ellpack(const ELLPACKMatrix *a, const ELL
  */
 result_mat malloc_init_result_mat(unsigned int column_amount, unsigned int initial_col_height, uint64_t max_col_height);
 
+/**
+ * @brief Initialize a `result_mat` whose columns have an exact, known capacity.
+ *
+ * All columns are placed in one chunk of the arena, so no reallocation happens while
+ * the numeric phase fills them.
+ * @param column_amount Number of columns in the result.
+ * @param col_heights Capacity of every column (e.g. from a symbolic pre-pass).
+ * @param max_col_height Upper bound for the height of a column.
+ */
+result_mat malloc_init_result_mat_exact(unsigned int column_amount, const uint64_t *col_heights, uint64_t max_col_height);
+
+/**
+ * @brief Make sure column `i_col` has space for `extra_height` more elements.
+ * @param mat Result matrix.
+ * @param i_col Column index in result.
+ * @param extra_height Number of elements that will be appended.
+ * @return 0 on success, non-zero on failure.
+ */
+int reserve_result_col(result_mat* mat, unsigned int i_col, uint64_t extra_height);
+
 /**
  * @brief Append a value at row `i_row` to column `i_col` in the result.
  * @param mat Result matrix.
@@ -61,20 +208,65 @@ result_mat malloc_init_result_mat(unsigned int column_amount, unsigned int initi
  */
 int push_to_matrix(result_mat* mat, float value, uint64_t i_row, unsigned int i_col);
 
+/**
+ * @brief Append all elements of `src` to column `i_col` of the result.
+ * @param mat Result matrix.
+ * @param i_col Column index in result.
+ * @param src Column whose elements are appended (row indices have to be greater than the ones already in the column).
+ * @return 0 on success, non-zero on failure.
+ */
+int append_result_col(result_mat* mat, unsigned int i_col, const result_col* src);
+
+/**
+ * @brief Empty all columns of a result matrix but keep their capacity, so it can be filled again without allocating.
+ * @param matrix Result matrix (allocated, `cols` not NULL).
+ */
+void reset_result_mat(result_mat* matrix);
+
 /**
  * @brief Free all memory of a result matrix and set fields to safe defaults.
  */
 void free_result_mat(result_mat* matrix);
 
+/**
+ * @brief Convert a result matrix into a contiguous ELLPACK matrix, so it can be the operand of the next multiplication.
+ *        Indices are stored as 32-bit if `nr_rows` fits; `sorted` is set from the actual order of the row indices.
+ * @param result Result matrix (not modified, can be freed afterwards).
+ * @param nr_rows Number of rows of the result.
+ * @param out Output matrix (has to be empty), has to be freed with `clean_matrix_data`.
+ * @return 0 on success, non-zero on allocation failure (nothing has to be freed).
+ */
+int result_mat_to_ellpack(const result_mat *result, uint64_t nr_rows, ELLPACKMatrix *out);
+
 /**
  * @brief Get the height of the longest column in the result matrix.
  */
 unsigned int get_longest_col(result_mat *matrix);
 
+/**
+ * @struct left_operand
+ * @brief What the implementations derive from A, built once by `build_left_operand` if A is multiplied several times.
+ */
+typedef struct {
+    ellpack_row_index rows; ///< Row index of A
+    uint64_t* col_starts;   ///< Offset of each column of A, size `nr_cols + 1`
+    bool finite_values;     ///< All values of A are finite
+} left_operand;
+
+/**
+ * @struct matmul_context
+ * @brief Settings of one multiplication, passed to the implementation with every call.
+ */
+typedef struct {
+    uint64_t tile_size;         ///< Tile width of `matr_mult_ellpack_main_tiled` in shared indices (0: half of the L2 cache size)
+    const left_operand* left;   ///< Data built from A with `build_left_operand`, or NULL to derive it in every call
+    bool verbose;               ///< Report choices the implementation makes on its own (e.g. a fallback to another implementation)
+} matmul_context;
+
 /**
  * @brief Compatibility wrapper signature (see matmul.h for implementations).
  */
-void matr_mult_ellpack(const void *a, const void *b, void *result);
+void matr_mult_ellpack(const void *a, const void *b, void *result, const matmul_context *context);
 
 /**
  * @brief Debug-print a result matrix in ELLPACK-like layout.
@@ -84,6 +276,6 @@ void print_ellpack_matrix(result_mat *a);
 /**
  * @brief Function pointer type for matmul implementations.
  */
-typedef void (*matmul_func)(const ELLPACKMatrix* a, const ELLPACKMatrix* b, result_mat* result);
+typedef void (*matmul_func)(const ELLPACKMatrix* a, const ELLPACKMatrix* b, result_mat* result, const matmul_context* context);
 
 #endif //MATRIX_UTILS_H
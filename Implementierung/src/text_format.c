@@ -0,0 +1,286 @@
+#include <stdbool.h>
+#include "text_format.h"
+
+#define FLOAT_MANTISSA_BITS 23
+#define FLOAT_EXPONENT_BITS 8
+#define FLOAT_BIAS 127
+/** Bits of the entries of float_pow5_inv_split and float_pow5_split */
+#define FLOAT_POW5_INV_BITCOUNT 59
+#define FLOAT_POW5_BITCOUNT 61
+
+const char digit_pairs[200] = {
+    '0', '0', '0', '1', '0', '2', '0', '3', '0', '4', '0', '5', '0', '6', '0', '7', '0', '8', '0', '9',
+    '1', '0', '1', '1', '1', '2', '1', '3', '1', '4', '1', '5', '1', '6', '1', '7', '1', '8', '1', '9',
+    '2', '0', '2', '1', '2', '2', '2', '3', '2', '4', '2', '5', '2', '6', '2', '7', '2', '8', '2', '9',
+    '3', '0', '3', '1', '3', '2', '3', '3', '3', '4', '3', '5', '3', '6', '3', '7', '3', '8', '3', '9',
+    '4', '0', '4', '1', '4', '2', '4', '3', '4', '4', '4', '5', '4', '6', '4', '7', '4', '8', '4', '9',
+    '5', '0', '5', '1', '5', '2', '5', '3', '5', '4', '5', '5', '5', '6', '5', '7', '5', '8', '5', '9',
+    '6', '0', '6', '1', '6', '2', '6', '3', '6', '4', '6', '5', '6', '6', '6', '7', '6', '8', '6', '9',
+    '7', '0', '7', '1', '7', '2', '7', '3', '7', '4', '7', '5', '7', '6', '7', '7', '7', '8', '7', '9',
+    '8', '0', '8', '1', '8', '2', '8', '3', '8', '4', '8', '5', '8', '6', '8', '7', '8', '8', '8', '9',
+    '9', '0', '9', '1', '9', '2', '9', '3', '9', '4', '9', '5', '9', '6', '9', '7', '9', '8', '9', '9'};
+
+/** floor(2^(pow5_bits(q) - 1 + 59) / 5^q) + 1 */
+static const uint64_t float_pow5_inv_split[31] = {
+    576460752303423489ULL, 461168601842738791ULL, 368934881474191033ULL, 295147905179352826ULL,
+    472236648286964522ULL, 377789318629571618ULL, 302231454903657294ULL, 483570327845851670ULL,
+    386856262276681336ULL, 309485009821345069ULL, 495176015714152110ULL, 396140812571321688ULL,
+    316912650057057351ULL, 507060240091291761ULL, 405648192073033409ULL, 324518553658426727ULL,
+    519229685853482763ULL, 415383748682786211ULL, 332306998946228969ULL, 531691198313966350ULL,
+    425352958651173080ULL, 340282366920938464ULL, 544451787073501542ULL, 435561429658801234ULL,
+    348449143727040987ULL, 557518629963265579ULL, 446014903970612463ULL, 356811923176489971ULL,
+    570899077082383953ULL, 456719261665907162ULL, 365375409332725730ULL};
+
+/** The 61 leading bits of 5^i */
+static const uint64_t float_pow5_split[48] = {
+    1152921504606846976ULL, 1441151880758558720ULL, 1801439850948198400ULL, 2251799813685248000ULL,
+    1407374883553280000ULL, 1759218604441600000ULL, 2199023255552000000ULL, 1374389534720000000ULL,
+    1717986918400000000ULL, 2147483648000000000ULL, 1342177280000000000ULL, 1677721600000000000ULL,
+    2097152000000000000ULL, 1310720000000000000ULL, 1638400000000000000ULL, 2048000000000000000ULL,
+    1280000000000000000ULL, 1600000000000000000ULL, 2000000000000000000ULL, 1250000000000000000ULL,
+    1562500000000000000ULL, 1953125000000000000ULL, 1220703125000000000ULL, 1525878906250000000ULL,
+    1907348632812500000ULL, 1192092895507812500ULL, 1490116119384765625ULL, 1862645149230957031ULL,
+    1164153218269348144ULL, 1455191522836685180ULL, 1818989403545856475ULL, 2273736754432320594ULL,
+    1421085471520200371ULL, 1776356839400250464ULL, 2220446049250313080ULL, 1387778780781445675ULL,
+    1734723475976807094ULL, 2168404344971008868ULL, 1355252715606880542ULL, 1694065894508600678ULL,
+    2117582368135750847ULL, 1323488980084844279ULL, 1654361225106055349ULL, 2067951531382569187ULL,
+    1292469707114105741ULL, 1615587133892632177ULL, 2019483917365790221ULL, 1262177448353618888ULL};
+
+/** ceil(log2(5^e)) for e in [0, 3528] (1 for e = 0) */
+static inline int32_t pow5_bits(int32_t e)
+{
+    return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+/** floor(log10(2^e)) for e in [0, 1650] */
+static inline uint32_t log10_pow2(int32_t e)
+{
+    return ((uint32_t)e * 78913) >> 18;
+}
+
+/** floor(log10(5^e)) for e in [0, 2620] */
+static inline uint32_t log10_pow5(int32_t e)
+{
+    return ((uint32_t)e * 732923) >> 20;
+}
+
+static inline bool multiple_of_power_of_5(uint32_t value, uint32_t p)
+{
+    uint32_t count = 0;
+    while (value % 5 == 0 && value != 0)
+    {
+        value /= 5;
+        count++;
+    }
+    return count >= p;
+}
+
+static inline bool multiple_of_power_of_2(uint32_t value, uint32_t p)
+{
+    return (value & ((1u << p) - 1)) == 0;
+}
+
+/** (m * factor) >> shift, with shift > 32 */
+static inline uint32_t mul_shift(uint32_t m, uint64_t factor, int32_t shift)
+{
+    uint64_t low = (uint64_t)m * (uint32_t)factor;
+    uint64_t high = (uint64_t)m * (uint32_t)(factor >> 32);
+    return (uint32_t)(((low >> 32) + high) >> (shift - 32));
+}
+
+static inline uint32_t decimal_length(uint32_t value)
+{
+    uint32_t length = 1;
+    for (uint32_t bound = 10; length < 9 && value >= bound; bound *= 10)
+        length++;
+    return length;
+}
+
+/**
+ * Shortest decimal mantissa * 10^exponent in the rounding interval of a finite, non-zero float
+ * (Ulf Adams, "Ryū: fast float-to-string conversion", PLDI 2018); of several shortest candidates, the
+ * closest to the float is taken.
+ */
+static void shortest_decimal(uint32_t ieee_mantissa, uint32_t ieee_exponent, uint32_t *mantissa, int32_t *exponent)
+{
+    // the float is m2 * 2^e2, two more bits leave room for the boundaries of its rounding interval
+    int32_t e2;
+    uint32_t m2;
+    if (ieee_exponent == 0)
+    {
+        e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    }
+    else
+    {
+        e2 = (int32_t)ieee_exponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = (1u << FLOAT_MANTISSA_BITS) | ieee_mantissa;
+    }
+    // with an even mantissa, the boundaries themselves are read back as this float (round half to even)
+    bool accept_bounds = (m2 & 1) == 0;
+    uint32_t mv = 4 * m2;
+    uint32_t mp = 4 * m2 + 2;
+    // the interval is asymmetric below a power of two
+    uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+    uint32_t mm = 4 * m2 - 1 - mm_shift;
+
+    // the value and both boundaries in base 10
+    uint32_t vr, vp, vm;
+    int32_t e10;
+    bool vm_trailing_zeros = false;
+    bool vr_trailing_zeros = false;
+    uint32_t last_removed_digit = 0;
+    if (e2 >= 0)
+    {
+        uint32_t q = log10_pow2(e2);
+        e10 = (int32_t)q;
+        int32_t k = FLOAT_POW5_INV_BITCOUNT + pow5_bits((int32_t)q) - 1;
+        int32_t i = -e2 + (int32_t)q + k;
+        vr = mul_shift(mv, float_pow5_inv_split[q], i);
+        vp = mul_shift(mp, float_pow5_inv_split[q], i);
+        vm = mul_shift(mm, float_pow5_inv_split[q], i);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10)
+        {
+            // the loop below removes no digit, but the rounding needs the first removed one
+            int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5_bits((int32_t)(q - 1)) - 1;
+            last_removed_digit = mul_shift(mv, float_pow5_inv_split[q - 1], -e2 + (int32_t)q - 1 + l) % 10;
+        }
+        if (q <= 9)
+        {
+            // at most one of mp, mv and mm is a multiple of 5
+            if (mv % 5 == 0)
+                vr_trailing_zeros = multiple_of_power_of_5(mv, q);
+            else if (accept_bounds)
+                vm_trailing_zeros = multiple_of_power_of_5(mm, q);
+            else
+                vp -= multiple_of_power_of_5(mp, q);
+        }
+    }
+    else
+    {
+        uint32_t q = log10_pow5(-e2);
+        e10 = (int32_t)q + e2;
+        int32_t i = -e2 - (int32_t)q;
+        int32_t k = pow5_bits(i) - FLOAT_POW5_BITCOUNT;
+        int32_t j = (int32_t)q - k;
+        vr = mul_shift(mv, float_pow5_split[i], j);
+        vp = mul_shift(mp, float_pow5_split[i], j);
+        vm = mul_shift(mm, float_pow5_split[i], j);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10)
+        {
+            j = (int32_t)q - 1 - (pow5_bits(i + 1) - FLOAT_POW5_BITCOUNT);
+            last_removed_digit = mul_shift(mv, float_pow5_split[i + 1], j) % 10;
+        }
+        if (q <= 1)
+        {
+            // mv has at least two trailing zero bits, mp at least one, mm one if mm_shift is 1
+            vr_trailing_zeros = true;
+            if (accept_bounds)
+                vm_trailing_zeros = mm_shift == 1;
+            else
+                vp--;
+        }
+        else if (q < 31)
+        {
+            vr_trailing_zeros = multiple_of_power_of_2(mv, q - 1);
+        }
+    }
+
+    // remove digits as long as the boundaries differ in front of them
+    int32_t removed = 0;
+    uint32_t output;
+    if (vm_trailing_zeros || vr_trailing_zeros)
+    {
+        // rare: exact boundaries or a value that ends in ...50..0 need exact tie handling
+        while (vp / 10 > vm / 10)
+        {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed_digit == 0;
+            last_removed_digit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_trailing_zeros)
+        {
+            while (vm % 10 == 0)
+            {
+                vr_trailing_zeros &= last_removed_digit == 0;
+                last_removed_digit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vr_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0)
+            last_removed_digit = 4; // exactly halfway: round to even
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed_digit >= 5);
+    }
+    else
+    {
+        while (vp / 10 > vm / 10)
+        {
+            last_removed_digit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || last_removed_digit >= 5);
+    }
+    *mantissa = output;
+    *exponent = e10 + removed;
+}
+
+unsigned format_float(char *out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t ieee_mantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+    uint32_t ieee_exponent = (bits >> FLOAT_MANTISSA_BITS) & ((1u << FLOAT_EXPONENT_BITS) - 1);
+    char *p = out;
+    if (bits >> 31)
+        *p++ = '-';
+    if (ieee_exponent == (1u << FLOAT_EXPONENT_BITS) - 1)
+    {
+        memcpy(p, ieee_mantissa != 0 ? "nan" : "inf", 3);
+        return (unsigned)(p + 3 - out);
+    }
+    uint32_t mantissa = 0;
+    int32_t exponent = 0;
+    if (ieee_exponent != 0 || ieee_mantissa != 0)
+        shortest_decimal(ieee_mantissa, ieee_exponent, &mantissa, &exponent);
+
+    // the digits go to p[1..length], then the first one is moved in front of the decimal point
+    uint32_t length = decimal_length(mantissa);
+    char *digit = p + length;
+    while (mantissa >= 100)
+    {
+        memcpy(digit - 1, digit_pairs + 2 * (mantissa % 100), 2);
+        mantissa /= 100;
+        digit -= 2;
+    }
+    if (mantissa >= 10)
+        memcpy(digit - 1, digit_pairs + 2 * mantissa, 2);
+    else
+        *digit = (char)('0' + mantissa);
+    p[0] = p[1];
+    if (length > 1)
+    {
+        p[1] = '.';
+        p += length + 1;
+    }
+    else
+    {
+        p++;
+    }
+
+    // two exponent digits suffice for floats (at most 38, at least -45)
+    exponent += (int32_t)length - 1;
+    *p++ = 'e';
+    *p++ = exponent < 0 ? '-' : '+';
+    memcpy(p, digit_pairs + 2 * (exponent < 0 ? -exponent : exponent), 2);
+    return (unsigned)(p + 2 - out);
+}
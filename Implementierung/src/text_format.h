@@ -0,0 +1,57 @@
+/**
+ * @file text_format.h
+ * @brief Number formatting for the ELLPACK text writers.
+ *
+ * Both functions write into a caller provided buffer (no terminating NUL) and return the number of
+ * characters, so a writer can put one token after the other into a large output buffer.
+ */
+#ifndef TEXT_FORMAT_H
+#define TEXT_FORMAT_H
+#include <stdint.h>
+#include <string.h>
+
+/** @brief Longest token of `format_float` ("-1.23456789e-45") and `format_index` (20 digits). */
+#define FORMAT_TOKEN_SIZE 20
+
+/** @brief "00" "01" .. "99", two digits are converted per division. */
+extern const char digit_pairs[200];
+
+/**
+ * @brief Shortest decimal that is read back as exactly `value` (Ryu), in the exponent notation of `%e`
+ *        without trailing zeros: 1.0f is "1e+00", 0.1f is "1e-01", 3.1415927f is "3.1415927e+00".
+ *        Infinities and NaNs are written like printf does ("inf", "-nan", ...).
+ * @param out At least `FORMAT_TOKEN_SIZE` bytes.
+ * @return Number of characters written.
+ */
+unsigned format_float(char *out, float value);
+
+/**
+ * @brief Decimal digits of `value`.
+ * @param out At least `FORMAT_TOKEN_SIZE` bytes.
+ * @return Number of characters written.
+ */
+static inline unsigned format_index(char *out, uint64_t value)
+{
+    char digits[FORMAT_TOKEN_SIZE];
+    char *p = digits + FORMAT_TOKEN_SIZE;
+    while (value >= 100)
+    {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * (value % 100), 2);
+        value /= 100;
+    }
+    if (value >= 10)
+    {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * value, 2);
+    }
+    else
+    {
+        *--p = (char)('0' + value);
+    }
+    unsigned length = (unsigned)(digits + FORMAT_TOKEN_SIZE - p);
+    memcpy(out, p, length);
+    return length;
+}
+
+#endif // TEXT_FORMAT_H
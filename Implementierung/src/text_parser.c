@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <errno.h>
+#include "text_parser.h"
+
+/** Longest token the fallback accepts */
+#define FALLBACK_TOKEN_SIZE 128
+
+const float float_powers_of_ten[11] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+const double double_powers_of_ten[23] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+const uint64_t powers_of_ten[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL};
+
+bool parse_float_fallback(const char **pos, const char *end, float *out)
+{
+    // strtof needs a terminated string, the token ends at the next delimiter
+    char token[FALLBACK_TOKEN_SIZE];
+    size_t len = 0;
+    const char *p = *pos;
+    errno = 0;
+    while (p + len < end && p[len] != ',' && p[len] != '\n' && p[len] != ' ' && p[len] != '\r' && p[len] != '\t')
+    {
+        if (len == FALLBACK_TOKEN_SIZE - 1)
+            return false;
+        token[len] = p[len];
+        len++;
+    }
+    token[len] = '\0';
+    char *endptr = NULL;
+    float value = strtof(token, &endptr);
+    if (endptr == token || errno != 0)
+        return false;
+    *out = value;
+    *pos = p + (endptr - token);
+    return true;
+}
+
+/** Sums the byte counters of a SSE2 accumulator */
+static uint64_t sum_counters(__m128i counters)
+{
+    __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+    return (uint64_t)_mm_cvtsi128_si64(sums) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+}
+
+void count_delimiters(const char *begin, const char *end, uint64_t *commas, uint64_t *stars)
+{
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i star = _mm_set1_epi8('*');
+    uint64_t nr_commas = 0;
+    uint64_t nr_stars = 0;
+    const char *p = begin;
+    while (end - p >= 16)
+    {
+        // every byte counter can take 255 matches before it has to be summed up
+        __m128i comma_counters = _mm_setzero_si128();
+        __m128i star_counters = _mm_setzero_si128();
+        for (int block = 0; block < 255 && end - p >= 16; block++, p += 16)
+        {
+            __m128i chars = _mm_loadu_si128((const __m128i *)p);
+            comma_counters = _mm_sub_epi8(comma_counters, _mm_cmpeq_epi8(chars, comma));
+            star_counters = _mm_sub_epi8(star_counters, _mm_cmpeq_epi8(chars, star));
+        }
+        nr_commas += sum_counters(comma_counters);
+        nr_stars += sum_counters(star_counters);
+    }
+    for (; p < end; p++)
+    {
+        nr_commas += *p == ',';
+        nr_stars += *p == '*';
+    }
+    *commas = nr_commas;
+    *stars = nr_stars;
+}
+
+const char *skip_tokens(const char *begin, const char *end, uint64_t nr_commas, uint64_t *stars)
+{
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i star = _mm_set1_epi8('*');
+    const char *p = begin;
+    // whole blocks as long as the searched comma is behind them
+    while (nr_commas > 0 && end - p >= 16)
+    {
+        __m128i chars = _mm_loadu_si128((const __m128i *)p);
+        unsigned comma_mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, comma));
+        uint64_t block_commas = (uint64_t)__builtin_popcount(comma_mask);
+        if (block_commas >= nr_commas)
+            break;
+        nr_commas -= block_commas;
+        *stars += (uint64_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, star)));
+        p += 16;
+    }
+    for (; nr_commas > 0 && p < end; p++)
+    {
+        *stars += *p == '*';
+        nr_commas -= *p == ',';
+    }
+    return nr_commas == 0 ? p : NULL;
+}
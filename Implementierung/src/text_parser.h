@@ -0,0 +1,221 @@
+/**
+ * @file text_parser.h
+ * @brief Number parsing and token scanning for the ELLPACK text readers.
+ *
+ * All functions parse in place between `*pos` and `end` (no terminating NUL is needed) and move `*pos`
+ * behind the parsed token. Digits are located 16 bytes at a time with SSE2 and converted 8 at a time (SWAR).
+ */
+#ifndef TEXT_PARSER_H
+#define TEXT_PARSER_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+/** @brief Powers of ten that are exact in a float (10^0 .. 10^10). */
+extern const float float_powers_of_ten[11];
+/** @brief Powers of ten that are exact in a double (10^0 .. 10^22). */
+extern const double double_powers_of_ten[23];
+/** @brief Powers of ten that fit into 64 bits (10^0 .. 10^19). */
+extern const uint64_t powers_of_ten[20];
+
+/**
+ * @brief Slow path of `parse_float`: strtof on a copy of the token (hex floats, inf/nan, long mantissas,
+ *        large exponents). Values out of the float range are rejected with `errno` set to ERANGE
+ *        (on every other failure `errno` is 0).
+ */
+bool parse_float_fallback(const char **pos, const char *end, float *out);
+
+/**
+ * @brief Counts the commas and stars in `[begin, end)`, 16 bytes per SSE2 compare.
+ */
+void count_delimiters(const char *begin, const char *end, uint64_t *commas, uint64_t *stars);
+
+/**
+ * @brief Position behind the `nr_commas`-th comma in `[begin, end)` (`begin` if `nr_commas` is 0).
+ * @param stars Incremented by the number of stars in front of the returned position.
+ * @return NULL if there are fewer commas.
+ */
+const char *skip_tokens(const char *begin, const char *end, uint64_t nr_commas, uint64_t *stars);
+
+/**
+ * @brief Number of decimal digits at the start of the 16 bytes at `p` (16 if all are digits).
+ */
+static inline unsigned leading_digits(const char *p)
+{
+    __m128i chars = _mm_loadu_si128((const __m128i *)p);
+    __m128i non_digits = _mm_or_si128(_mm_cmplt_epi8(chars, _mm_set1_epi8('0')), _mm_cmpgt_epi8(chars, _mm_set1_epi8('9')));
+    return (unsigned)__builtin_ctz((unsigned)_mm_movemask_epi8(non_digits) | 0x10000u);
+}
+
+/**
+ * @brief Value of the `n` (1..8) digits at `p`; reads 8 bytes.
+ */
+static inline uint64_t eight_digits(const char *p, unsigned n)
+{
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+    // the bytes behind the digits are shifted out, the freed low bytes act as leading zeros
+    chunk = (chunk - 0x3030303030303030ULL) << (8 * (8 - n));
+    chunk = chunk * 10 + (chunk >> 8);
+    return (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+            (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+}
+
+/**
+ * @brief Parses the decimal digits at `p` into `*value`.
+ * @return The number of digits (0 if there is none), or -1 if the number does not fit into 64 bits.
+ */
+static inline int parse_digits(const char *p, const char *end, uint64_t *value)
+{
+    if (end - p >= 16)
+    {
+        unsigned n = leading_digits(p);
+        if (n <= 8)
+        {
+            *value = n > 0 ? eight_digits(p, n) : 0;
+            return (int)n;
+        }
+        if (n < 16)
+        {
+            *value = eight_digits(p, 8) * powers_of_ten[n - 8] + eight_digits(p + 8, n - 8);
+            return (int)n;
+        }
+    }
+    // close to the end of the buffer or a very long number
+    uint64_t result = 0;
+    int n = 0;
+    for (; p < end && (unsigned)(*p - '0') <= 9; p++, n++)
+    {
+        unsigned digit = (unsigned)(*p - '0');
+        if (result > (UINT64_MAX - digit) / 10)
+            return -1;
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return n;
+}
+
+/**
+ * @brief Parses an unsigned decimal index.
+ * @return false if there is no digit or the number does not fit into 64 bits.
+ */
+static inline bool parse_index(const char **pos, const char *end, uint64_t *out)
+{
+    int n = parse_digits(*pos, end, out);
+    if (n <= 0)
+        return false;
+    *pos += n;
+    return true;
+}
+
+/**
+ * @brief Parses a float, correctly rounded like strtof.
+ *
+ * Decimal numbers with at most 19 significant digits whose mantissa fits into 24 bits and whose decimal
+ * exponent is within ±10 (e.g. everything `%e` and short `%f` print) are computed with one exact
+ * multiplication or division (Clinger's fast path). Mantissas of up to 53 bits with exponents within ±22
+ * (e.g. the 9 digits `format_float` may write) take the same path in double; rounding that result to float
+ * again is exact unless it lies exactly between two floats. Everything else goes to `parse_float_fallback`.
+ * @return false if no float could be matched or it cannot be represented (then `errno` is ERANGE).
+ */
+static inline bool parse_float(const char **pos, const char *end, float *out)
+{
+    const char *p = *pos;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int int_digits = parse_digits(p, end, &mantissa);
+    if (int_digits < 0)
+        return parse_float_fallback(pos, end, out);
+    p += int_digits;
+    int frac_digits = 0;
+    if (p < end && *p == '.')
+    {
+        uint64_t fraction = 0;
+        p++;
+        frac_digits = parse_digits(p, end, &fraction);
+        if (frac_digits < 0 || int_digits + frac_digits > 19)
+            return parse_float_fallback(pos, end, out);
+        mantissa = mantissa * powers_of_ten[frac_digits] + fraction;
+        p += frac_digits;
+    }
+    if (int_digits + frac_digits == 0)
+        return parse_float_fallback(pos, end, out);
+    int exponent = -frac_digits;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool negative_exponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative_exponent = *p == '-';
+            p++;
+        }
+        uint64_t exponent_value = 0;
+        int exponent_digits = parse_digits(p, end, &exponent_value);
+        if (exponent_digits <= 0 || exponent_value > 100)
+            return parse_float_fallback(pos, end, out);
+        p += exponent_digits;
+        exponent += negative_exponent ? -(int)exponent_value : (int)exponent_value;
+    }
+    // hex floats and the like are left to strtof
+    if (p < end && (*p == 'x' || *p == 'X' || *p == '.'))
+        return parse_float_fallback(pos, end, out);
+    float value;
+    if (mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10)
+    {
+        // both operands are exact, so the single rounding of the operation is the correct rounding
+        value = (float)mantissa;
+        value = exponent < 0 ? value / float_powers_of_ten[-exponent] : value * float_powers_of_ten[exponent];
+    }
+    else if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        // every midpoint between two floats is a double, so the correctly rounded double is on the same side
+        // of it as the exact value, unless it is the midpoint itself (the 29 bits below a float are 100..0)
+        double exact = (double)mantissa;
+        exact = exponent < 0 ? exact / double_powers_of_ten[-exponent] : exact * double_powers_of_ten[exponent];
+        uint64_t bits;
+        memcpy(&bits, &exact, sizeof(bits));
+        if ((bits & ((1ULL << 29) - 1)) == (1ULL << 28))
+            return parse_float_fallback(pos, end, out);
+        value = (float)exact;
+    }
+    else
+    {
+        return parse_float_fallback(pos, end, out);
+    }
+    *out = negative ? -value : value;
+    *pos = p;
+    return true;
+}
+
+/**
+ * @brief Number of consecutive `*,` tokens at `p` (at most `max_stars`), compared 8 tokens per SSE2 load.
+ *        Padding of ELLPACK files consists of such runs in both lines.
+ */
+static inline uint64_t count_star_run(const char *p, const char *end, uint64_t max_stars)
+{
+    const __m128i pattern = _mm_set1_epi16('*' | (',' << 8));
+    uint64_t stars = 0;
+    while (max_stars - stars >= 8 && end - p >= 16)
+    {
+        unsigned match = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), pattern));
+        if (match != 0xFFFF)
+            return stars + (unsigned)__builtin_ctz(~match) / 2;
+        stars += 8;
+        p += 16;
+    }
+    while (stars < max_stars && end - p >= 2 && p[0] == '*' && p[1] == ',')
+    {
+        stars++;
+        p += 2;
+    }
+    return stars;
+}
+
+#endif // TEXT_PARSER_H
@@ -3,9 +3,16 @@ import pathlib
 
 def read_ellpack(path):
     with open(path) as f:
-        rows, cols, k = map(int, f.readline().strip().split(","))
+        header = list(map(int, f.readline().strip().split(",")))
+        rows, cols, k = header[:3]
         vals = f.readline().strip().split(",")
         inds = f.readline().strip().split(",")
+        # HYB: <#overflow> COO entries follow the ELLPACK part
+        overflow = header[3] if len(header) > 3 else 0
+        if overflow:
+            over_vals = f.readline().strip().split(",")
+            over_rows = f.readline().strip().split(",")
+            over_cols = f.readline().strip().split(",")
     # Build dense matrix by columns
     M = [[0.0 for _ in range(cols)] for _ in range(rows)]
     pos = 0
@@ -15,6 +22,8 @@ def read_ellpack(path):
             if v != "*" and i != "*":
                 r = int(i)
                 M[r][c] = float(v)
+    for p in range(overflow):
+        M[int(over_rows[p])][int(over_cols[p])] = float(over_vals[p])
     return M
 
 def read_result_ellpack(path):
@@ -0,0 +1,50 @@
+import sys
+
+# Same rule as get_hyb_width in Implementierung/src/matrix_utils.c:
+# the ELLPACK part is as wide as the longest column after dropping the longest 1/32 of the columns.
+HYB_TAIL_FRACTION = 32
+
+def convert(src, dst):
+    with open(src) as f:
+        header = f.readline().strip().split(",")
+        if len(header) != 3:
+            raise ValueError("%s is not a plain ELLPACK file" % src)
+        rows, cols, k = map(int, header)
+        vals = f.readline().strip().split(",")
+        inds = f.readline().strip().split(",")
+    columns = []
+    for c in range(cols):
+        col = [(vals[p], inds[p]) for p in range(c * k, (c + 1) * k) if vals[p].strip() != "*"]
+        columns.append(col)
+    lengths = sorted(len(col) for col in columns)
+    width = lengths[cols - 1 - cols // HYB_TAIL_FRACTION] if cols else 0
+
+    head_vals, head_inds = [], []
+    over_vals, over_rows, over_cols = [], [], []
+    for c, col in enumerate(columns):
+        for v, i in col[:width]:
+            head_vals.append(v.strip())
+            head_inds.append(i.strip())
+        head_vals.extend(["*"] * (width - min(len(col), width)))
+        head_inds.extend(["*"] * (width - min(len(col), width)))
+        for v, i in col[width:]:
+            over_vals.append(v.strip())
+            over_rows.append(i.strip())
+            over_cols.append(str(c))
+    with open(dst, "w") as f:
+        f.write("%d,%d,%d,%d\n" % (rows, cols, width, len(over_vals)))
+        f.write(",".join(head_vals) + "\n")
+        f.write(",".join(head_inds) + "\n")
+        f.write(",".join(over_vals) + "\n")
+        f.write(",".join(over_rows) + "\n")
+        f.write(",".join(over_cols) + "\n")
+    print("%s: width %d instead of %d, %d overflow entries" % (dst, width, k, len(over_vals)))
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: ellpack_to_hyb.py <input.ellpack> <output.hyb>")
+        sys.exit(2)
+    convert(sys.argv[1], sys.argv[2])
+
+if __name__ == "__main__":
+    main()